@@ -0,0 +1,314 @@
+#include "alphabeta.h"
+#include "eval.h"
+#include <iostream>
+
+namespace Reversi {
+    AlphaBeta::Options AlphaBeta::Options::from_description(const EngineDescription& desc) {
+        desc.check_keys({ "ms", "depth", "tt_mb", "threads", "weights", "nnue", "book" });
+        Options ans;
+        ans.ms = desc.get_int("ms", ans.ms);
+        if (ans.ms <= 0)
+            throw ReversiError("ms should be positive");
+        ans.depth = desc.get_int("depth", ans.depth);
+        if (ans.depth < 0)
+            throw ReversiError("depth should not be negative");
+        ans.tt_mb = desc.get_int("tt_mb", ans.tt_mb);
+        if (ans.tt_mb <= 0 || ans.tt_mb > 65536)
+            throw ReversiError("tt_mb should be between 1 and 65536");
+        ans.threads = desc.get_int("threads", ans.threads);
+        if (ans.threads <= 0 || ans.threads > 256)
+            throw ReversiError("threads should be between 1 and 256");
+        ans.weights = desc.get_string("weights", ans.weights);
+        ans.nnue = desc.get_string("nnue", ans.nnue);
+        if (!ans.weights.empty() && !ans.nnue.empty())
+            throw ReversiError("weights and nnue can't be used together");
+        ans.book = desc.get_string("book", ans.book);
+        return ans;
+    }
+
+    void AlphaBeta::Options::to_description(EngineDescription& desc) const {
+        const Options def;
+        if (ms != def.ms)
+            desc.set_int("ms", ms);
+        if (depth != def.depth)
+            desc.set_int("depth", depth);
+        if (tt_mb != def.tt_mb)
+            desc.set_int("tt_mb", tt_mb);
+        if (threads != def.threads)
+            desc.set_int("threads", threads);
+        if (!weights.empty())
+            desc.set_string("weights", weights);
+        if (!nnue.empty())
+            desc.set_string("nnue", nnue);
+        if (!book.empty())
+            desc.set_string("book", book);
+    }
+
+    AlphaBeta::AlphaBeta() : AlphaBeta(Options()) {}
+
+    AlphaBeta::AlphaBeta(Options opt) : mOptions(opt), mTable(opt.tt_mb), mWorkers(opt.threads) {
+        mWorkers[0].is_main = true;
+        if (!opt.weights.empty())
+            mWeights = std::make_unique<const PatternWeights>(PatternWeights::load(opt.weights));
+        if (!opt.nnue.empty())
+            mNnue = std::make_unique<const NnueNetwork>(NnueNetwork::load(opt.nnue));
+        if (!opt.book.empty())
+            mBook = std::make_unique<const OpeningBook>(opt.book);
+    }
+
+    AlphaBeta::~AlphaBeta() noexcept {
+        stop_computation();
+    }
+
+    std::string AlphaBeta::get_name() {
+        EngineDescription desc{ "AlphaBeta", {} };
+        mOptions.to_description(desc);
+        return desc.to_string();
+    }
+
+    // The score of a finished game for the player to move.
+    static int terminal_score(const BitBoard& b, int win_score) noexcept {
+        const int diff = b.final_score();
+        return diff > 0 ? win_score + diff : diff < 0 ? -win_score + diff : 0;
+    }
+
+    int AlphaBeta::evaluate(const Worker& w, const BitBoard& b) const noexcept {
+        return mNnue ? mNnue->eval(w.nnue) : mWeights ? mWeights->eval(w.patterns, b) : quick_eval(b);
+    }
+
+    void AlphaBeta::play_eval(Worker& w, int sq, std::uint64_t flips) const noexcept {
+        if (mWeights)
+            w.patterns.play(sq, flips);
+        else if (mNnue)
+            w.nnue.play(sq, flips);
+    }
+
+    void AlphaBeta::undo_eval(Worker& w, int sq, std::uint64_t flips) const noexcept {
+        if (mWeights)
+            w.patterns.undo(sq, flips);
+        else if (mNnue)
+            w.nnue.undo(sq, flips);
+    }
+
+    void AlphaBeta::pass_eval(Worker& w) const noexcept {
+        if (mWeights)
+            w.patterns.pass();
+        else if (mNnue)
+            w.nnue.pass();
+    }
+
+    void AlphaBeta::reset_eval(Worker& w, const BitBoard& b) const noexcept {
+        if (mWeights)
+            w.patterns = PatternState(b);
+        else if (mNnue)
+            w.nnue = NnueAccumulator(*mNnue, b);
+    }
+
+    void AlphaBeta::check_abort(Worker& w) {
+        if ((++w.node_cnt & 4095) != 0)
+            return;
+        if (w.is_main ? mCancel.load(std::memory_order_relaxed)
+                || std::chrono::steady_clock::now() >= mDeadline
+            : mStop.load(std::memory_order_relaxed))
+            throw SearchAborted();
+    }
+
+    int AlphaBeta::order_moves(const Worker& w, const BitBoard& b, std::uint64_t moves,
+        int tt_move, int ply, std::array<int, 64>& out)
+    {
+        std::array<int, 64> keys;
+        int cnt = 0;
+        const auto& killers = w.killers[std::min(ply, MAX_PLY - 1)];
+        while (moves) {
+            const int sq = std::countr_zero(moves);
+            moves &= moves - 1;
+            int key;
+            if (sq == tt_move)
+                key = 1 << 30;
+            else if (sq == killers[0])
+                key = 1 << 29;
+            else if (sq == killers[1])
+                key = 1 << 28;
+            else
+                // The heuristic dominates until the history has seen a few cutoffs.
+                key = int(std::min<std::uint32_t>(w.history[sq], 1 << 20)) + 1024 * move_order_score(b, sq);
+            // Insertion sort, there are few moves.
+            int i = cnt++;
+            for (; i > 0 && keys[i - 1] < key; i--) {
+                keys[i] = keys[i - 1];
+                out[i] = out[i - 1];
+            }
+            keys[i] = key;
+            out[i] = sq;
+        }
+        return cnt;
+    }
+
+    void AlphaBeta::record_cutoff(Worker& w, int sq, int depth, int ply) {
+        auto& killers = w.killers[std::min(ply, MAX_PLY - 1)];
+        if (killers[0] != sq) {
+            killers[1] = killers[0];
+            killers[0] = sq;
+        }
+        w.history[sq] += depth * depth;
+    }
+
+    int AlphaBeta::pvs(Worker& w, const BitBoard& b, int depth, int ply, int alpha, int beta, bool passed) {
+        check_abort(w);
+        if (depth <= 0)
+            return b.empties() ? evaluate(w, b) : terminal_score(b, WIN_SCORE);
+        const std::uint64_t moves = b.moves();
+        if (!moves) {
+            if (passed)
+                return terminal_score(b, WIN_SCORE);
+            // A pass doesn't use up depth. Two passes in a row end the game.
+            pass_eval(w);
+            const int score = -pvs(w, b.pass(), depth, ply + 1, -beta, -alpha, true);
+            pass_eval(w);
+            return score;
+        }
+        const std::uint64_t key = b.hash();
+        TransTable::Entry entry;
+        int tt_move = -1;
+        if (mTable.probe(key, entry)) {
+            tt_move = entry.move;
+            if (entry.depth >= depth) {
+                if (entry.bound == TransTable::Bound::Exact
+                    || (entry.bound == TransTable::Bound::Lower && entry.score >= beta)
+                    || (entry.bound == TransTable::Bound::Upper && entry.score <= alpha))
+                    return entry.score;
+            }
+        }
+        std::array<int, 64> list;
+        const int cnt = order_moves(w, b, moves, tt_move, ply, list);
+        const int alpha0 = alpha;
+        int best = -INF_SCORE, best_move = -1;
+        for (int i = 0; i < cnt; i++) {
+            const std::uint64_t flips = b.flips(list[i]);
+            const BitBoard next{ b.opp ^ flips, b.own ^ flips ^ (std::uint64_t(1) << list[i]) };
+            play_eval(w, list[i], flips);
+            int score;
+            if (i == 0) {
+                score = -pvs(w, next, depth - 1, ply + 1, -beta, -alpha, false);
+            } else {
+                // Prove that the move is worse than the first with a null
+                // window, and search again if that fails.
+                score = -pvs(w, next, depth - 1, ply + 1, -alpha - 1, -alpha, false);
+                if (alpha < score && score < beta)
+                    score = -pvs(w, next, depth - 1, ply + 1, -beta, -alpha, false);
+            }
+            undo_eval(w, list[i], flips);
+            if (score > best) {
+                best = score;
+                best_move = list[i];
+                if (score > alpha && (alpha = score) >= beta) {
+                    record_cutoff(w, list[i], depth, ply);
+                    break;
+                }
+            }
+        }
+        const auto bound = best <= alpha0 ? TransTable::Bound::Upper
+            : best >= beta ? TransTable::Bound::Lower : TransTable::Bound::Exact;
+        mTable.store(key, best, depth, bound, best_move);
+        return best;
+    }
+
+    int AlphaBeta::pvs_root(Worker& w, const BitBoard& b, int depth, int best, int& score) {
+        std::array<int, 64> list;
+        const int cnt = order_moves(w, b, b.moves(), best, 0, list);
+        int alpha = -INF_SCORE;
+        for (int i = 0; i < cnt; i++) {
+            const std::uint64_t flips = b.flips(list[i]);
+            const BitBoard next{ b.opp ^ flips, b.own ^ flips ^ (std::uint64_t(1) << list[i]) };
+            // Starts from scratch, since an aborted search leaves the
+            // evaluation state behind.
+            reset_eval(w, b);
+            play_eval(w, list[i], flips);
+            int curr;
+            if (i == 0) {
+                curr = -pvs(w, next, depth - 1, 1, -INF_SCORE, -alpha, false);
+            } else {
+                curr = -pvs(w, next, depth - 1, 1, -alpha - 1, -alpha, false);
+                if (curr > alpha)
+                    curr = -pvs(w, next, depth - 1, 1, -INF_SCORE, -alpha, false);
+            }
+            if (curr > alpha) {
+                alpha = curr;
+                best = list[i];
+            }
+        }
+        mTable.store(b.hash(), alpha, depth, TransTable::Bound::Exact, best);
+        score = alpha;
+        return best;
+    }
+
+    void AlphaBeta::helper_loop(Worker& w, const BitBoard& root, int depth, int max_depth) {
+        int best = -1, score;
+        try {
+            // Past max_depth, keep the helper busy on the deepest iteration so
+            // that it fills the table until the main worker is done.
+            for (; !mStop.load(std::memory_order_relaxed); depth = std::min(depth + 1, max_depth))
+                best = pvs_root(w, root, depth, best, score);
+        } catch (SearchAborted) {}
+    }
+
+    std::pair<int, int> AlphaBeta::do_make_move() {
+        const BitBoard root = BitBoard::from_board(mBoard);
+        const std::uint64_t moves = root.moves();
+        if (!moves)
+            return { 0, 0 };
+        if (mBook) {
+            if (const auto m = mBook->best_move(root)) {
+                report_score(m->score);
+                std::cerr << "AlphaBeta: book move, score " << m->score << ", " << m->visits << " games\n";
+                return from_index(m->sq);
+            }
+        }
+        mDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(mOptions.ms);
+        for (auto& w : mWorkers) {
+            w.node_cnt = 0;
+            for (auto& k : w.killers)
+                k.fill(-1);
+            // Age the history so that old games don't dominate.
+            for (auto& h : w.history)
+                h /= 2;
+        }
+        Worker& main = mWorkers[0];
+        std::array<int, 64> list;
+        order_moves(main, root, moves, -1, 0, list);
+        int best = list[0], score = 0, depth_done = 0;
+        // Passes don't use up depth, so searching as deep as there are empties
+        // reaches the end of every line.
+        const int max_depth = mOptions.depth ? std::min(mOptions.depth, root.empties()) : root.empties();
+        // Half of the helpers start one iteration ahead, so that the threads
+        // spread over two depths and fill the table with different subtrees.
+        mStop.store(false, std::memory_order_relaxed);
+        // A helper the pool gets to only after mStop returns at once.
+        TaskGroup helpers;
+        for (std::size_t i = 1; i < mWorkers.size(); i++) {
+            helpers.run([this, &root, i, max_depth] {
+                helper_loop(mWorkers[i], root, std::min(int(1 + i % 2), max_depth), max_depth);
+            });
+        }
+        for (int depth = 1; depth <= max_depth; depth++) {
+            try {
+                best = pvs_root(main, root, depth, best, score);
+                depth_done = depth;
+            } catch (SearchAborted) {
+                // The unfinished iteration is thrown away, the last completed
+                // one decides the move.
+                break;
+            }
+        }
+        mStop.store(true, std::memory_order_relaxed);
+        std::uint64_t node_cnt = 0;
+        helpers.wait();
+        for (const auto& w : mWorkers)
+            node_cnt += w.node_cnt;
+        // Proven results are offset by WIN_SCORE, evaluations are already in discs.
+        report_score(score >= WIN_SCORE ? score - WIN_SCORE : score <= -WIN_SCORE ? score + WIN_SCORE : score);
+        std::cerr << "AlphaBeta: depth " << depth_done << ", score " << score
+            << ", " << node_cnt << " nodes\n";
+        return from_index(best);
+    }
+}
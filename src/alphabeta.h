@@ -0,0 +1,154 @@
+// Alpha-beta search engine
+#ifndef REVERSI_ALPHABETA_H
+#define REVERSI_ALPHABETA_H
+#include "engi.h"
+#include "bitboard.h"
+#include "ttable.h"
+#include "pattern.h"
+#include "nnue.h"
+#include "book.h"
+#include <array>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace Reversi {
+    // Negamax with iterative deepening, principal variation search and a
+    // transposition table. Moves are ordered by the table move, the killer
+    // moves and then by history and move_order_score().
+    // With more than one thread, helpers search the same position at staggered
+    // depths and share their results through the table (lazy SMP).
+    class AlphaBeta : public Engine {
+    public:
+        struct Options {
+            // The thinking time per move, in milliseconds.
+            int ms = 1000;
+            // The deepest iteration, 0 for no limit but the end of the game.
+            int depth = 0;
+            // The size of the transposition table in MB.
+            int tt_mb = 16;
+            // The number of search threads, including the one that reports
+            // the move.
+            int threads = 1;
+            // A pattern weights file for the evaluation. Empty for quick_eval().
+            std::string weights;
+            // A network file for the evaluation, instead of the patterns.
+            std::string nnue;
+            // An opening book to play from while it knows the position.
+            std::string book;
+
+            // Reads the options, throwing ReversiError on unknown keys or bad values.
+            static Options from_description(const EngineDescription& desc);
+
+            // Writes the options that differ from the defaults into `desc`.
+            void to_description(EngineDescription& desc) const;
+        };
+
+    private:
+        // Thrown inside the search when the time is up or the move is canceled.
+        struct SearchAborted {};
+
+        // Scores of finished games are offset by this much, so that any win is
+        // better than any evaluation.
+        static constexpr int WIN_SCORE = 10000, INF_SCORE = 30000;
+
+        static constexpr int MAX_PLY = 128;
+
+        // The state private to each search thread.
+        struct Worker {
+            // Two killer moves per ply: quiet moves that recently caused a cutoff
+            // at this ply in a sibling subtree.
+            std::array<std::array<int, 2>, MAX_PLY> killers;
+
+            // How often each square caused a cutoff, weighted by depth squared.
+            std::array<std::uint32_t, 64> history{};
+
+            // Nodes visited in the current move.
+            std::uint64_t node_cnt = 0;
+
+            // The pattern indices of the node being searched, if mWeights is set.
+            PatternState patterns;
+
+            // The accumulator of the node being searched, if mNnue is set.
+            NnueAccumulator nnue;
+
+            // Only the main worker watches the clock and mCancel, the helpers
+            // are stopped by mStop.
+            bool is_main = false;
+        };
+
+        const Options mOptions;
+
+        // Shared by all the workers.
+        TransTable mTable;
+
+        // The pattern evaluation, or null to use quick_eval().
+        std::unique_ptr<const PatternWeights> mWeights;
+
+        // The network evaluation, or null. At most one of it and mWeights is set.
+        std::unique_ptr<const NnueNetwork> mNnue;
+
+        // The opening book, or null.
+        std::unique_ptr<const OpeningBook> mBook;
+
+        // mWorkers[0] is the main worker, run by the engine's task. The helpers
+        // run as tasks on the shared thread pool.
+        std::vector<Worker> mWorkers;
+
+        // Tells the helpers to finish the current move.
+        std::atomic_bool mStop = false;
+
+        // When the current move must be finished.
+        std::chrono::steady_clock::time_point mDeadline;
+
+        // The static evaluation of a node.
+        int evaluate(const Worker& w, const BitBoard& b) const noexcept;
+
+        // Updates the incremental state of the evaluation for a move, and
+        // takes it back. Passes are their own undo.
+        void play_eval(Worker& w, int sq, std::uint64_t flips) const noexcept;
+
+        void undo_eval(Worker& w, int sq, std::uint64_t flips) const noexcept;
+
+        void pass_eval(Worker& w) const noexcept;
+
+        // Sets the incremental state of the evaluation to b from scratch.
+        void reset_eval(Worker& w, const BitBoard& b) const noexcept;
+
+        // Counts a node and throws SearchAborted if the search should stop.
+        // Only looks at the clock every few thousand nodes.
+        void check_abort(Worker& w);
+
+        // Sorts the moves of b into `out`, best first. Returns the count.
+        static int order_moves(const Worker& w, const BitBoard& b, std::uint64_t moves,
+            int tt_move, int ply, std::array<int, 64>& out);
+
+        // Remembers a move that caused a beta cutoff.
+        static void record_cutoff(Worker& w, int sq, int depth, int ply);
+
+        // Fail-soft principal variation search. `passed` is true if the
+        // previous ply was a pass.
+        int pvs(Worker& w, const BitBoard& b, int depth, int ply, int alpha, int beta, bool passed);
+
+        // Searches the root to `depth`, trying `best` first, and returns the
+        // best move. The score is stored in `score`.
+        int pvs_root(Worker& w, const BitBoard& b, int depth, int best, int& score);
+
+        // The iterative deepening of a helper thread, starting at `depth`.
+        // Runs until mStop is set.
+        void helper_loop(Worker& w, const BitBoard& root, int depth, int max_depth);
+
+        virtual std::pair<int, int> do_make_move() override;
+
+    public:
+        AlphaBeta();
+
+        explicit AlphaBeta(Options opt);
+
+        virtual ~AlphaBeta() noexcept;
+
+        virtual std::string get_name() override;
+    };
+}
+
+#endif
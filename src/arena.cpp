@@ -0,0 +1,91 @@
+#include "arena.h"
+#include "record.h"
+#include <algorithm>
+#include <random>
+
+namespace Reversi {
+    namespace {
+        // Where one game at a time is played. It tells the arena when its
+        // game has ended.
+        class Table : public GameObserver {
+            MpscQueue<int>& mFinished;
+            const int mIndex;
+
+        public:
+            // The number and the engines of the game being played.
+            int game = -1;
+            ArenaGame spec;
+            // Declared last, so that its thread stops before the rest goes.
+            std::shared_ptr<GameMan> man;
+
+            Table(MpscQueue<int>& finished, int index) :
+                mFinished(finished), mIndex(index), man(GameMan::create(*this)) {}
+
+            void update_board(const Board&, std::pair<int, int>) override {}
+
+            void announce_game_result(MatchResult) override {
+                mFinished.push(mIndex);
+            }
+        };
+
+        nlohmann::json game_json(const ArenaGame& spec, const std::vector<std::pair<int, int>>& moves) {
+            using nlohmann::json;
+            json ans;
+            ans["annotation"] = json::array();
+            for (const auto& [x, y] : moves)
+                ans["annotation"].push_back(json::array({ x, y }));
+            ans["black"] = spec.black;
+            ans["white"] = spec.white;
+            return ans;
+        }
+    }
+
+    std::vector<std::pair<int, int>> random_opening(unsigned seed, int plies) {
+        std::mt19937 rng(seed);
+        std::vector<std::pair<int, int>> ans;
+        Board board;
+        for (int i = 0; i < plies; i++) {
+            const auto moves = board.get_placable();
+            if (moves.empty())
+                break;
+            const auto [x, y] = moves[rng() % moves.size()];
+            board.place(x, y);
+            ans.emplace_back(x, y);
+        }
+        return ans;
+    }
+
+    int play_games(int count, int concurrency, const std::function<ArenaGame(int)>& game,
+        const std::function<bool(int, const nlohmann::json&)>& done, const Adjudication& adjudication)
+    {
+        // Each table has at most one game ending at a time.
+        MpscQueue<int> finished(std::max(concurrency, 1));
+        std::vector<std::unique_ptr<Table>> tables;
+        int next = 0, running = 0, played = 0;
+        const auto start = [&](Table& t) {
+            t.game = next;
+            t.spec = game(next++);
+            t.man->from_json(game_json(t.spec, t.spec.opening));
+            ++running;
+        };
+        for (int i = 0; i < std::min(count, concurrency); i++) {
+            tables.push_back(std::make_unique<Table>(finished, i));
+            tables.back()->man->set_adjudication(adjudication);
+            start(*tables.back());
+        }
+        while (running) {
+            Table& t = *tables[finished.pop()];
+            --running;
+            nlohmann::json js = game_json(t.spec, t.man->annotation());
+            if (const auto adj = t.man->adjudicated())
+                js["adjudicated"] = *adj;
+            js["result"] = GameRecord::from_json(js).result;
+            ++played;
+            if (!done(t.game, js))
+                break;
+            if (next < count)
+                start(t);
+        }
+        return played;
+    }
+}
@@ -0,0 +1,39 @@
+// Engine-vs-engine games played by game managers without the GUI
+#ifndef REVERSI_ARENA_H
+#define REVERSI_ARENA_H
+#include "game.h"
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Reversi {
+    // A game for play_games() to play.
+    struct ArenaGame {
+        // The engines, as descriptions for make_engine_from_description().
+        std::string black, white;
+        // The moves played before the engines take over, (0, 0) for a skip.
+        std::vector<std::pair<int, int>> opening;
+    };
+
+    // `plies` random legal moves from the initial position, fewer if a side
+    // has to skip before. The same seed gives the same moves.
+    std::vector<std::pair<int, int>> random_opening(unsigned seed, int plies);
+
+    // Plays games 0, 1, ..., count - 1, `concurrency` at a time, each on a
+    // GameMan of its own that reports to an observer instead of the GUI. The
+    // engines compute on the thread pool, so no display is needed.
+    //
+    // game(i) says what game i is. done(i, js) is called on the calling
+    // thread as each game ends, in the order they end, with the game as
+    // GameMan::to_json() saves it plus its "result", Black's discs minus
+    // White's. If done() returns false, the games in progress are abandoned
+    // and no more are started. The managers adjudicate as `adjudication` says.
+    //
+    // Returns the number of games finished. Throws ReversiError if an engine
+    // description or an opening is invalid.
+    int play_games(int count, int concurrency, const std::function<ArenaGame(int)>& game,
+        const std::function<bool(int, const nlohmann::json&)>& done, const Adjudication& adjudication = {});
+}
+
+#endif
@@ -0,0 +1,54 @@
+#include "batch_eval.h"
+
+namespace Reversi {
+    BatchEvaluator::BatchEvaluator(const NnueNetwork& net, std::size_t batch_size, std::chrono::microseconds timeout) :
+        mNet(net), mBatchSize(std::max<std::size_t>(batch_size, 1)), mTimeout(timeout) {}
+
+    void BatchEvaluator::run(std::unique_lock<std::mutex>& lock) {
+        std::vector<Request*> batch;
+        batch.swap(mQueue);
+        for (auto* r : batch)
+            r->state = Request::State::Running;
+        ++mStats.batches;
+        mStats.full += batch.size() >= mBatchSize;
+        mStats.positions += batch.size();
+        lock.unlock();
+        std::vector<BitBoard> pos(batch.size());
+        std::vector<int> scores(batch.size());
+        for (std::size_t i = 0; i < batch.size(); i++)
+            pos[i] = batch[i]->b;
+        mNet.eval_batch(pos.data(), scores.data(), pos.size());
+        lock.lock();
+        for (std::size_t i = 0; i < batch.size(); i++) {
+            batch[i]->score = scores[i];
+            batch[i]->state = Request::State::Done;
+        }
+        // Under the lock, since the waiters' requests live on their stacks.
+        mDone.notify_all();
+    }
+
+    int BatchEvaluator::eval(const BitBoard& b) {
+        Request req{ b };
+        std::unique_lock lock(mMutex);
+        if (mQueue.empty())
+            mOldest = std::chrono::steady_clock::now();
+        mQueue.push_back(&req);
+        if (mQueue.size() >= mBatchSize)
+            run(lock);
+        while (req.state != Request::State::Done) {
+            if (req.state == Request::State::Running) {
+                mDone.wait(lock);
+            } else if (mDone.wait_until(lock, mOldest + mTimeout) == std::cv_status::timeout
+                && req.state == Request::State::Queued) {
+                // Nobody filled the batch in time, so it runs partly empty.
+                run(lock);
+            }
+        }
+        return req.score;
+    }
+
+    BatchEvaluator::Stats BatchEvaluator::stats() {
+        std::lock_guard lock(mMutex);
+        return mStats;
+    }
+}
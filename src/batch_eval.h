@@ -0,0 +1,61 @@
+// Evaluating positions from many threads in batches
+#ifndef REVERSI_BATCH_EVAL_H
+#define REVERSI_BATCH_EVAL_H
+#include "nnue.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace Reversi {
+    // Collects the positions that search threads want evaluated and runs the
+    // network on them together. A batch runs once it has `batch_size`
+    // positions, or once the oldest position in it has waited `timeout`.
+    // There is no thread of its own: the thread that fills the batch, or the
+    // first one to time out, evaluates it for everybody.
+    class BatchEvaluator {
+    public:
+        struct Stats {
+            // The batches run, the ones of them that were full, and the
+            // positions evaluated.
+            std::uint64_t batches = 0, full = 0, positions = 0;
+        };
+
+    private:
+        // A position waiting in a batch, on the stack of its thread.
+        struct Request {
+            BitBoard b;
+            int score = 0;
+            enum class State {
+                Queued, Running, Done
+            } state = State::Queued;
+        };
+
+        const NnueNetwork& mNet;
+        const std::size_t mBatchSize;
+        const std::chrono::microseconds mTimeout;
+
+        // Guards everything below and the requests.
+        std::mutex mMutex;
+        std::condition_variable mDone;
+        std::vector<Request*> mQueue;
+        // When the first request of mQueue came in.
+        std::chrono::steady_clock::time_point mOldest;
+        Stats mStats;
+
+        // Takes the queue and evaluates it, with the lock released meanwhile.
+        void run(std::unique_lock<std::mutex>& lock);
+
+    public:
+        BatchEvaluator(const NnueNetwork& net, std::size_t batch_size, std::chrono::microseconds timeout);
+
+        // (Any thread) The network's evaluation of b. Blocks until its batch
+        // has run.
+        int eval(const BitBoard& b);
+
+        Stats stats();
+    };
+}
+
+#endif
@@ -0,0 +1,38 @@
+// Measures the leaf evaluations per second of multithreaded MCTS with the
+// network at each batch size.
+// Usage: bench_batch [threads = 4] [simulations = 20000] [network file]
+// Without a file, a network with random weights is used.
+#include "mctse.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+using namespace Reversi;
+
+int main(int argc, char** argv) {
+    const int threads = argc > 1 ? std::stoi(argv[1]) : 4;
+    const int simulations = argc > 2 ? std::stoi(argv[2]) : 20000;
+    std::string path = argc > 3 ? argv[3] : "";
+    try {
+        if (path.empty()) {
+            path = "bench_batch.nnue";
+            NnueNetwork::random(1).save(path);
+        }
+        std::cout << threads << " threads, " << simulations << " simulations\n";
+        for (int batch = 1; batch <= threads; batch *= 2) {
+            const auto desc = EngineDescription::parse("MCTSe:puct=1.5,ms=1000000,playouts=" + std::to_string(simulations)
+                + ",threads=" + std::to_string(threads) + ",batch=" + std::to_string(batch) + ",nnue=" + path);
+            MCTS engine(MCTS::Options::from_description(desc));
+            const auto start = std::chrono::steady_clock::now();
+            engine.search(Board());
+            const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "batch " << batch << ": " << std::lround(simulations / sec) << " positions/s\n";
+        }
+    } catch (const ReversiError& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    if (argc <= 3)
+        std::remove(path.c_str());
+}
@@ -0,0 +1,148 @@
+// Runs the FFO endgame test suite through the exact solver, checks the scores
+// and reports the speed, as text on stdout and optionally as JSON.
+// Usage: bench_ffo [threads = 1] [suite file, - for the default] [json file]
+//
+// A suite file has one position per line in the usual "obf" form:
+//   <64 squares a1..h1, a2..h2, ...> <side to move>; <best move>:<score>;
+// with X for black, O for white and - for empty. Lines starting with % are
+// ignored. The positions are numbered from 40, as in fforum-40-59.obf.
+// By default that file is read from the working directory, and if it isn't
+// there the positions built in are solved instead.
+#include "endgame.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace Reversi;
+
+struct Problem {
+    int id;
+    BitBoard b;
+    // The best move from the suite, for the report only: some positions
+    // have several.
+    std::string move;
+    int score;
+};
+
+// The file of the whole suite, #40 to #59.
+static const char* const SUITE_FILE = "fforum-40-59.obf";
+
+// Some positions of the suite with the published results, for when the file
+// isn't at hand.
+static const std::pair<int, const char*> BUILTIN[] = {
+    { 40, "O--OOOOX-OOOOOOXOOXXOOOXOOXOOOXXOOOOOOXX---OOOOX----O--X-------- X; A2:+38;" },
+    { 41, "-OOOOO----OOOOX--OOOOOO-XXXXXOO--XXOOX--OOXOXX----OXXO---OOO--O- X; H4:+0;" },
+    { 42, "--OOO-------XX-OOOOOOXOO-OOOOXOOX-OOOXXO---OOXOO---OOOXO--OOOO-- X; G2:+6;" },
+    { 43, "--XXXXX---XXXX---OOOXX---OOXXXX--OOXXXO-OOOOXOO----XOX----XXXXX- O; C7:-12;" },
+    { 45, "---XXXX-X-XXXO--XXOXOO--XXXOXO--XXOXXO---OXXXOO-O-OOOO------OO-- X; B2:+6;" },
+};
+
+// Parses one line of a suite, throwing ReversiError if it is malformed.
+static Problem parse_problem(int id, const std::string& line) {
+    std::istringstream in(line);
+    std::string squares, side, result;
+    in >> squares >> side >> result;
+    if (squares.size() != 64 || side.size() < 2 || (side[0] != 'X' && side[0] != 'O'))
+        throw ReversiError("Bad position: " + line);
+    Problem ans{ id, {}, {}, 0 };
+    for (int i = 0; i < 64; i++) {
+        if (squares[i] == '-')
+            continue;
+        if (squares[i] != 'X' && squares[i] != 'O')
+            throw ReversiError("Bad position: " + line);
+        // Numbered as in the suite rather than by to_index(). That at most
+        // transposes the board, which doesn't change any score.
+        (squares[i] == side[0] ? ans.b.own : ans.b.opp) |= std::uint64_t(1) << i;
+    }
+    const auto colon = result.find(':');
+    if (colon == std::string::npos)
+        throw ReversiError("Bad result: " + line);
+    ans.move = result.substr(0, colon);
+    ans.score = std::stoi(result.substr(colon + 1));
+    return ans;
+}
+
+// The name of square i in the numbering of the suite.
+static std::string square_name(int i) {
+    if (i < 0)
+        return "pass";
+    std::string ans;
+    ans += char('a' + i % 8);
+    ans += char('1' + i / 8);
+    return ans;
+}
+
+int main(int argc, char** argv) {
+    using namespace std::chrono;
+    const int threads = argc > 1 ? std::stoi(argv[1]) : 1;
+    std::vector<Problem> suite;
+    try {
+        const bool named = argc > 2 && std::string(argv[2]) != "-";
+        const std::string path = named ? argv[2] : SUITE_FILE;
+        std::ifstream fin(path);
+        if (!fin && named)
+            throw ReversiError("Can't open " + path);
+        if (fin) {
+            std::string line;
+            while (std::getline(fin, line)) {
+                if (!line.empty() && line[0] != '%')
+                    suite.push_back(parse_problem(40 + int(suite.size()), line));
+            }
+        } else {
+            std::cout << "No " << path << ", solving the built-in positions\n";
+            for (const auto& [id, line] : BUILTIN)
+                suite.push_back(parse_problem(id, line));
+        }
+    } catch (const ReversiError& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+
+    std::cout << suite.size() << " positions, " << threads << " threads\n";
+    nlohmann::json js;
+    js["threads"] = threads;
+    js["hardware_threads"] = std::thread::hardware_concurrency();
+    js["positions"] = nlohmann::json::array();
+    std::uint64_t total_nodes = 0;
+    double total_seconds = 0;
+    int failures = 0;
+    for (const Problem& p : suite) {
+        // A fresh solver for each position, so the table starts empty.
+        EndgameSolver solver(64, threads);
+        const auto start = steady_clock::now();
+        const auto res = solver.solve(p.b);
+        const double seconds = duration<double>(steady_clock::now() - start).count();
+        const std::uint64_t nodes = solver.node_count();
+        const bool ok = res.score == p.score;
+        failures += !ok;
+        total_nodes += nodes;
+        total_seconds += seconds;
+        std::cout << "#" << p.id << ": " << p.b.empties() << " empties, "
+            << square_name(res.move) << " " << res.score;
+        if (!ok)
+            std::cout << " WRONG, expected " << p.move << " " << p.score;
+        std::cout << ", " << nodes << " nodes, " << seconds << " s, "
+            << std::uint64_t(nodes / seconds) << " nodes/s" << std::endl;
+        js["positions"].push_back({
+            { "id", p.id }, { "empties", p.b.empties() },
+            { "move", square_name(res.move) }, { "score", res.score },
+            { "expected", p.score }, { "correct", ok },
+            { "nodes", nodes }, { "seconds", seconds }, { "nodes_per_second", nodes / seconds }
+        });
+    }
+    std::cout << "total: " << total_nodes << " nodes, " << total_seconds << " s, "
+        << std::uint64_t(total_nodes / total_seconds) << " nodes/s, "
+        << failures << " wrong" << std::endl;
+    js["total"] = {
+        { "nodes", total_nodes }, { "seconds", total_seconds },
+        { "nodes_per_second", total_nodes / total_seconds }, { "wrong", failures }
+    };
+    if (argc > 3) {
+        std::ofstream fout(argv[3]);
+        fout << js.dump(4) << "\n";
+    }
+    return failures ? 1 : 0;
+}
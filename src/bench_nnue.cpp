@@ -0,0 +1,87 @@
+// Measures the evaluations per second of the network, from scratch and with
+// incremental updates, against quick_eval().
+// Usage: bench_nnue [network file]
+// Without a file, a network with random weights is measured, which is just
+// as fast.
+#include "eval.h"
+#include "nnue.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace Reversi;
+
+// Positions from random games, each with a legal move.
+static std::vector<BitBoard> make_positions(int cnt) {
+    std::mt19937 mt(4321);
+    std::vector<BitBoard> ans;
+    while (int(ans.size()) < cnt) {
+        BitBoard b = BitBoard::from_board(Board());
+        while (int(ans.size()) < cnt) {
+            std::uint64_t moves = b.moves();
+            if (!moves) {
+                b = b.pass();
+                if (!b.moves())
+                    break;
+                continue;
+            }
+            ans.push_back(b);
+            for (int k = mt() % std::popcount(moves); k > 0; k--)
+                moves &= moves - 1;
+            b = b.play(std::countr_zero(moves));
+        }
+    }
+    return ans;
+}
+
+// Runs `round` over the indices of the positions until a second has passed,
+// and prints the evaluations per second.
+template <typename F>
+static void measure(const char* name, const std::vector<BitBoard>& pos, F round) {
+    using namespace std::chrono;
+    long long sum = 0, evals = 0;
+    const auto start = steady_clock::now();
+    double sec = 0;
+    while (sec < 1) {
+        for (std::size_t i = 0; i < pos.size(); i++)
+            sum += round(i);
+        evals += pos.size();
+        sec = duration<double>(steady_clock::now() - start).count();
+    }
+    std::cout << name << ": " << std::lround(evals / sec) << " evals/s, "
+        << sec * 1e9 / evals << " ns each (checksum " << sum << ")\n";
+}
+
+int main(int argc, char** argv) {
+    try {
+        const NnueNetwork net = argc > 1 ? NnueNetwork::load(argv[1]) : NnueNetwork::random(1);
+#if defined(__AVX2__)
+        std::cout << "dense layers: AVX2\n";
+#else
+        std::cout << "dense layers: scalar\n";
+#endif
+        const auto pos = make_positions(10000);
+        std::vector<NnueAccumulator> accs;
+        for (const auto& b : pos)
+            accs.emplace_back(net, b);
+        measure("quick_eval", pos, [&](std::size_t i) {
+            return quick_eval(pos[i]);
+        });
+        measure("network from scratch", pos, [&](std::size_t i) {
+            return net.eval(pos[i]);
+        });
+        // What a search does at each leaf: update for the move, evaluate, undo.
+        measure("network incremental", pos, [&](std::size_t i) {
+            const int sq = std::countr_zero(pos[i].moves());
+            const std::uint64_t flips = pos[i].flips(sq);
+            accs[i].play(sq, flips);
+            const int score = net.eval(accs[i]);
+            accs[i].undo(sq, flips);
+            return score;
+        });
+    } catch (const ReversiError& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,102 @@
+// Measures how long a move takes to get from an engine to the game manager's
+// thread: with the mutex, condition variable and std::queue the manager used
+// to have, and with the lock-free command queue it has now.
+// Usage: bench_queue [moves = 20000] [producers = 2]
+// Half of the moves come after a pause, like a move after a search, so that
+// the manager is asleep; the other half come in bursts.
+#include "game.h"
+#include "engi.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Reversi;
+using Clock = std::chrono::steady_clock;
+
+// The old queue of GameMan: packed commands under a mutex.
+class LockedQueue {
+    std::queue<unsigned> mQueue;
+    std::mutex mMutex;
+    std::condition_variable mCondVar;
+
+public:
+    void push(unsigned cmd) {
+        {
+            std::lock_guard lk(mMutex);
+            mQueue.push(cmd);
+        }
+        mCondVar.notify_one();
+    }
+
+    unsigned pop() {
+        std::unique_lock lk(mMutex);
+        mCondVar.wait(lk, [this] { return !mQueue.empty(); });
+        const unsigned ans = mQueue.front();
+        mQueue.pop();
+        return ans;
+    }
+};
+
+// The send times of the moves, indexed by move, so that the commands carry
+// only the index like the real ones carry the square.
+static std::vector<Clock::time_point> sent;
+
+// Sends `moves` moves from `producers` threads, pausing before every other
+// one when `pauses`, and returns the latencies in microseconds, sorted.
+template <class Send, class Receive>
+static std::vector<double> run(int moves, int producers, bool pauses, Send send, Receive receive) {
+    sent.assign(moves, {});
+    std::vector<double> ans(moves);
+    std::thread consumer([&] {
+        for (int i = 0; i < moves; i++) {
+            const unsigned idx = receive();
+            ans[i] = std::chrono::duration<double, std::micro>(Clock::now() - sent[idx]).count();
+        }
+    });
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&, p] {
+            for (int i = p; i < moves; i += producers) {
+                if (pauses && i % 2 == 0)
+                    std::this_thread::sleep_for(std::chrono::microseconds(500));
+                sent[i] = Clock::now();
+                send(unsigned(i));
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+    consumer.join();
+    std::sort(ans.begin(), ans.end());
+    return ans;
+}
+
+static void report(const std::string& name, const std::vector<double>& lat) {
+    const auto at = [&](double q) {
+        return lat[std::min(lat.size() - 1, std::size_t(q * lat.size()))];
+    };
+    std::cout << name << ": median " << at(0.5) << " us, p90 " << at(0.9) << " us, p99 " << at(0.99) << " us\n";
+}
+
+int main(int argc, char** argv) {
+    const int moves = argc > 1 ? std::stoi(argv[1]) : 20000;
+    const int producers = argc > 2 ? std::stoi(argv[2]) : 2;
+    std::cout << moves << " moves from " << producers << " threads\n";
+    for (const bool pauses : { true, false }) {
+        std::cout << (pauses ? "with pauses\n" : "in bursts\n");
+        LockedQueue locked;
+        report("  mutex queue   ", run(moves, producers, pauses,
+            [&](unsigned i) { locked.push(3 + (i << 8)); },
+            [&] { return locked.pop() >> 8; }));
+        MpscQueue<GameCommand> commands(256);
+        report("  lock-free MPSC", run(moves, producers, pauses,
+            [&](unsigned i) { commands.push(Command::Place{ int(i), 0, 0 }); },
+            [&] { return unsigned(std::get<Command::Place>(commands.pop()).x); }));
+    }
+}
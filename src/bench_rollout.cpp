@@ -0,0 +1,60 @@
+// Compares truncated rollouts against full rollouts at the same thinking time,
+// i.e. strength per CPU-second.
+// Usage: bench_rollout [games = 20] [ms per move = 100] [rollout plies = 8]
+#include "mctse.h"
+#include <cmath>
+#include <ctime>
+#include <iostream>
+#include <string>
+
+using namespace Reversi;
+
+// Plays a game between the two engines from the initial position.
+static MatchResult play_game(Engine& black, Engine& white) {
+    Board b;
+    bool prev_skip = false;
+    while (true) {
+        Engine& side = b.whos_next() == Player::Black ? black : white;
+        const auto [x, y] = side.search(b);
+        if (x) {
+            b.place(x, y);
+            prev_skip = false;
+        } else {
+            if (prev_skip)
+                return b.count();
+            b.skip();
+            prev_skip = true;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const int games = argc > 1 ? std::stoi(argv[1]) : 20;
+    const std::string ms = argc > 2 ? argv[2] : "100";
+    const std::string plies = argc > 3 ? argv[3] : "8";
+    const auto full = EngineDescription::parse("MCTSe:ms=" + ms);
+    const auto truncated = EngineDescription::parse("MCTSe:ms=" + ms + ",rollout_plies=" + plies);
+    std::cout << full.to_string() << " vs " << truncated.to_string() << ", " << games << " games\n";
+    // Wins, draws and losses of the truncated engine.
+    int wins = 0, draws = 0, losses = 0;
+    const std::clock_t cpu_start = std::clock();
+    for (int i = 0; i < games; i++) {
+        MCTS a(MCTS::Options::from_description(full)), b(MCTS::Options::from_description(truncated));
+        // Colours alternate, the truncated engine is black in the odd games.
+        const bool trunc_black = i & 1;
+        const MatchResult res = trunc_black ? play_game(b, a) : play_game(a, b);
+        if (res == MatchResult::Draw)
+            ++draws;
+        else if ((res == MatchResult::Black) == trunc_black)
+            ++wins;
+        else
+            ++losses;
+        std::cout << "game " << i + 1 << ": +" << wins << " =" << draws << " -" << losses << std::endl;
+    }
+    const double cpu_sec = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    const double score = (wins + 0.5 * draws) / games;
+    std::cout << "truncated score: " << 100 * score << "%";
+    if (0 < score && score < 1)
+        std::cout << " (" << std::lround(-400 * std::log10(1 / score - 1)) << " Elo)";
+    std::cout << "\nCPU time: " << cpu_sec << " s\n";
+}
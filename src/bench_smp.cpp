@@ -0,0 +1,55 @@
+// Measures the speedup of the lazy SMP alpha-beta search over the number of
+// threads, searching a fixed suite of midgame positions to a fixed depth.
+// Usage: bench_smp [depth = 10] [max threads = hardware threads]
+#include "alphabeta.h"
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace Reversi;
+
+// The suite: positions after random openings from a fixed seed. mt19937 is
+// specified exactly by the standard, so every machine gets the same suite.
+static std::vector<Board> make_suite() {
+    std::mt19937 mt(20220601);
+    std::vector<Board> ans;
+    for (int plies = 16; plies <= 30; plies += 2) {
+        Board b;
+        for (int i = 0; i < plies; i++) {
+            const auto plc = b.get_placable();
+            if (plc.empty()) {
+                b.skip();
+                continue;
+            }
+            const auto [x, y] = plc[mt() % plc.size()];
+            b.place(x, y);
+        }
+        ans.push_back(b);
+    }
+    return ans;
+}
+
+int main(int argc, char** argv) {
+    using namespace std::chrono;
+    const int depth = argc > 1 ? std::stoi(argv[1]) : 10;
+    const int max_threads = argc > 2 ? std::stoi(argv[2])
+        : std::max(1, int(std::thread::hardware_concurrency()));
+    const auto suite = make_suite();
+    std::cout << suite.size() << " positions, depth " << depth << "\n";
+    double base = 0;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        const auto desc = EngineDescription::parse("AlphaBeta:ms=3600000,depth="
+            + std::to_string(depth) + ",threads=" + std::to_string(threads));
+        double total = 0;
+        for (const Board& b : suite) {
+            // A fresh engine for each position, so the table starts empty.
+            AlphaBeta engine(AlphaBeta::Options::from_description(desc));
+            const auto start = steady_clock::now();
+            engine.search(b);
+            total += duration<double>(steady_clock::now() - start).count();
+        }
+        if (threads == 1)
+            base = total;
+        std::cout << "threads " << threads << ": " << total << " s, speedup " << base / total << std::endl;
+    }
+}
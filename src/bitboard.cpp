@@ -0,0 +1,157 @@
+#include "bitboard.h"
+#include <array>
+
+namespace Reversi {
+    namespace {
+        // The eight directions as shifts of the square index. A positive shift
+        // moves towards bit 63. `dest` masks out the squares a shift can't land on
+        // without wrapping around the edge of the board.
+        struct Direction {
+            int shift;
+            std::uint64_t dest;
+        };
+
+        constexpr std::uint64_t NOT_Y1 = 0xFEFEFEFEFEFEFEFE, NOT_Y8 = 0x7F7F7F7F7F7F7F7F;
+
+        constexpr Direction DIRS[8] = {
+            { 1, NOT_Y1 }, { -1, NOT_Y8 }, { 8, ~std::uint64_t(0) }, { -8, ~std::uint64_t(0) },
+            { 9, NOT_Y1 }, { -9, NOT_Y8 }, { 7, NOT_Y8 }, { -7, NOT_Y1 }
+        };
+
+        constexpr std::uint64_t shift(std::uint64_t b, const Direction& d) noexcept {
+            return (d.shift > 0 ? b << d.shift : b >> -d.shift) & d.dest;
+        }
+
+        // RAYS[i][sq] holds the squares from sq (exclusive) to the edge of the
+        // board in direction DIRS[i].
+        using RayTable = std::array<std::array<std::uint64_t, 64>, 8>;
+
+        constexpr RayTable make_rays() noexcept {
+            RayTable ans{};
+            for (int i = 0; i < 8; i++) {
+                for (int sq = 0; sq < 64; sq++) {
+                    std::uint64_t curr = shift(std::uint64_t(1) << sq, DIRS[i]);
+                    while (curr) {
+                        ans[i][sq] |= curr;
+                        curr = shift(curr, DIRS[i]);
+                    }
+                }
+            }
+            return ans;
+        }
+
+        constexpr RayTable RAYS = make_rays();
+
+        // The squares next to each square.
+        constexpr std::array<std::uint64_t, 64> make_neighbours() noexcept {
+            std::array<std::uint64_t, 64> ans{};
+            for (int sq = 0; sq < 64; sq++) {
+                for (const auto& d : DIRS)
+                    ans[sq] |= shift(std::uint64_t(1) << sq, d);
+            }
+            return ans;
+        }
+
+        constexpr std::array<std::uint64_t, 64> NEIGHBOURS = make_neighbours();
+    }
+
+    BitBoard BitBoard::from_board(const Board& b) noexcept {
+        const Square mine = b.whos_next() == Player::Black ? Square::Black : Square::White;
+        BitBoard ans;
+        for (int x = 1; x <= Board::MAX_FILES; x++) {
+            for (int y = 1; y <= Board::MAX_RANK; y++) {
+                const Square sq = b(x, y);
+                if (sq == Square::Empty)
+                    continue;
+                (sq == mine ? ans.own : ans.opp) |= std::uint64_t(1) << to_index(x, y);
+            }
+        }
+        return ans;
+    }
+
+    // The moves along one line direction, both ways. `inner` masks out the
+    // opponent discs a run can't pass through without wrapping around the
+    // edge. A run is at most six discs long.
+    template <int S>
+    static inline std::uint64_t line_moves(std::uint64_t own, std::uint64_t opp, std::uint64_t inner) noexcept {
+        const std::uint64_t o = opp & inner;
+        std::uint64_t l = o & (own << S), r = o & (own >> S);
+        for (int i = 0; i < 5; i++) {
+            l |= o & (l << S);
+            r |= o & (r >> S);
+        }
+        return (l << S) | (r >> S);
+    }
+
+    std::uint64_t BitBoard::moves() const noexcept {
+        constexpr std::uint64_t INNER_Y = 0x7E7E7E7E7E7E7E7E;
+        const std::uint64_t ans = line_moves<1>(own, opp, INNER_Y) | line_moves<8>(own, opp, ~std::uint64_t(0))
+            | line_moves<9>(own, opp, INNER_Y) | line_moves<7>(own, opp, INNER_Y);
+        return ans & ~(own | opp);
+    }
+
+    std::uint64_t BitBoard::flips(int sq) const noexcept {
+        // Nothing to flip without an opponent disc next to sq, which is common
+        // among the last empties of the endgame.
+        if (((own | opp) >> sq & 1) || !(opp & NEIGHBOURS[sq]))
+            return 0;
+        // Without branches on the rays, which the endgame can't predict. The
+        // even directions go towards bit 63, the odd ones towards bit 0.
+        std::uint64_t ans = 0;
+        for (int i = 0; i < 8; i += 2) {
+            const std::uint64_t ray = RAYS[i][sq];
+            // The first square along the ray that doesn't hold an opponent
+            // disc. If there is none, `end - 1` covers the whole ray, but
+            // then `end` isn't ours either.
+            const std::uint64_t stop = ray & ~opp, end = stop & -stop;
+            ans |= ray & (end - 1) & -std::uint64_t((end & own) != 0);
+        }
+        for (int i = 1; i < 8; i += 2) {
+            const std::uint64_t ray = RAYS[i][sq];
+            const std::uint64_t end = std::bit_floor(ray & ~opp);
+            ans |= ray & ~(end | (end - 1)) & -std::uint64_t((end & own) != 0);
+        }
+        return ans;
+    }
+
+    std::uint64_t transform_squares(std::uint64_t s, int t) noexcept {
+        if (t & 4) {
+            // Swaps the bits across the diagonal in three rounds of
+            // exchanging blocks: 4x4, then 2x2, then single squares.
+            std::uint64_t d = 0x0F0F0F0F00000000 & (s ^ (s << 28));
+            s ^= d ^ (d >> 28);
+            d = 0x3333000033330000 & (s ^ (s << 14));
+            s ^= d ^ (d >> 14);
+            d = 0x5500550055005500 & (s ^ (s << 7));
+            s ^= d ^ (d >> 7);
+        }
+        if (t & 1) {
+            // The rows are the bytes.
+            s = (s >> 32) | (s << 32);
+            s = (s >> 16 & 0x0000FFFF0000FFFF) | (s & 0x0000FFFF0000FFFF) << 16;
+            s = (s >> 8 & 0x00FF00FF00FF00FF) | (s & 0x00FF00FF00FF00FF) << 8;
+        }
+        if (t & 2) {
+            // The columns are the bits within each byte.
+            s = (s >> 4 & 0x0F0F0F0F0F0F0F0F) | (s & 0x0F0F0F0F0F0F0F0F) << 4;
+            s = (s >> 2 & 0x3333333333333333) | (s & 0x3333333333333333) << 2;
+            s = (s >> 1 & 0x5555555555555555) | (s & 0x5555555555555555) << 1;
+        }
+        return s;
+    }
+
+    BitBoard canonical(const BitBoard& b, int* sym) noexcept {
+        BitBoard ans = b;
+        int best = 0;
+        for (int t = 1; t < SYMMETRIES; t++) {
+            const BitBoard img = transform(b, t);
+            if (img < ans) {
+                ans = img;
+                best = t;
+            }
+        }
+        if (sym)
+            *sym = best;
+        return ans;
+    }
+}
@@ -0,0 +1,114 @@
+// Bitboard representation of a position, used by the search engines
+#ifndef REVERSI_BITBOARD_H
+#define REVERSI_BITBOARD_H
+#include "game.h"
+#include <bit>
+#include <cstdint>
+#include <utility>
+
+namespace Reversi {
+    // Squares are numbered (x - 1) * 8 + (y - 1), so bit 0 is (1, 1) and bit 63 is (8, 8).
+    constexpr int to_index(int x, int y) noexcept {
+        return (x - 1) * 8 + (y - 1);
+    }
+
+    constexpr std::pair<int, int> from_index(int sq) noexcept {
+        return { sq / 8 + 1, sq % 8 + 1 };
+    }
+
+    // A position seen from the side to move. Unlike Board this doesn't remember
+    // whose turn it is, which is what negamax searches want.
+    struct BitBoard {
+        // The discs of the player to move and of the opponent.
+        std::uint64_t own = 0, opp = 0;
+
+        // Converts the board, seen from the side of b.whos_next().
+        static BitBoard from_board(const Board& b) noexcept;
+
+        // The squares the player to move can place at.
+        std::uint64_t moves() const noexcept;
+
+        // The discs flipped by placing at sq. Zero if sq isn't a legal move.
+        std::uint64_t flips(int sq) const noexcept;
+
+        // Plays at sq, which must be legal, and hands the turn over.
+        inline BitBoard play(int sq) const noexcept {
+            const std::uint64_t f = flips(sq);
+            return { opp ^ f, own ^ f ^ (std::uint64_t(1) << sq) };
+        }
+
+        // Hands the turn over without playing.
+        inline BitBoard pass() const noexcept {
+            return { opp, own };
+        }
+
+        inline int empties() const noexcept {
+            return 64 - std::popcount(own | opp);
+        }
+
+        // The final disc difference for the player to move, assuming neither
+        // side can move any more. Empty squares go to the winner.
+        inline int final_score() const noexcept {
+            const int diff = std::popcount(own) - std::popcount(opp);
+            return diff > 0 ? diff + empties() : diff < 0 ? diff - empties() : 0;
+        }
+
+        // A well mixed 64 bit hash of the position, for transposition tables.
+        inline std::uint64_t hash() const noexcept {
+            // The finalizer of MurmurHash3.
+            const auto mix = [](std::uint64_t h) {
+                h ^= h >> 33;
+                h *= 0xff51afd7ed558ccd;
+                h ^= h >> 33;
+                h *= 0xc4ceb9fe1a85ec53;
+                h ^= h >> 33;
+                return h;
+            };
+            return mix(own ^ mix(opp));
+        }
+
+        friend inline bool operator == (const BitBoard& lhs, const BitBoard& rhs) noexcept {
+            return lhs.own == rhs.own && lhs.opp == rhs.opp;
+        }
+
+        friend inline bool operator < (const BitBoard& lhs, const BitBoard& rhs) noexcept {
+            return lhs.own != rhs.own ? lhs.own < rhs.own : lhs.opp < rhs.opp;
+        }
+    };
+
+    // The eight symmetries of the board, numbered as in the patterns: bit 2
+    // transposes, then bit 0 flips the rows and bit 1 the columns.
+    constexpr int SYMMETRIES = 8;
+
+    // Where symmetry t takes square sq.
+    constexpr int transform_square(int sq, int t) noexcept {
+        int r = sq / 8, c = sq % 8;
+        if (t & 4)
+            std::swap(r, c);
+        if (t & 1)
+            r = 7 - r;
+        if (t & 2)
+            c = 7 - c;
+        return r * 8 + c;
+    }
+
+    // The symmetry that undoes t. The flips are their own inverses, but once
+    // a transposition is involved they trade places.
+    constexpr int inverse_symmetry(int t) noexcept {
+        return t & 4 ? (t & 4) | (t & 1) << 1 | (t & 2) >> 1 : t;
+    }
+
+    // Symmetry t applied to every square of a set.
+    std::uint64_t transform_squares(std::uint64_t s, int t) noexcept;
+
+    inline BitBoard transform(const BitBoard& b, int t) noexcept {
+        return { transform_squares(b.own, t), transform_squares(b.opp, t) };
+    }
+
+    // The least (by operator <) of the symmetric images of b, which is the
+    // same for all of them. If `sym` isn't null, it gets the symmetry that
+    // takes b there.
+    BitBoard canonical(const BitBoard& b, int* sym = nullptr) noexcept;
+}
+
+#endif
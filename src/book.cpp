@@ -0,0 +1,96 @@
+#include "book.h"
+#include <algorithm>
+#include <fstream>
+
+namespace Reversi {
+    namespace {
+        constexpr char MAGIC[4] = { 'R', 'V', 'B', 'K' };
+        constexpr std::uint32_t VERSION = 1;
+
+        bool entry_less(const BookEntry& lhs, const BookEntry& rhs) noexcept {
+            return lhs.pos < rhs.pos || (lhs.pos == rhs.pos && lhs.move.sq < rhs.move.sq);
+        }
+    }
+
+    OpeningBook::OpeningBook(const std::string& path) : mFile(path) {
+        const unsigned char* p = mFile.data();
+        if (mFile.size() < HEADER_SIZE || !std::equal(MAGIC, MAGIC + 4, p))
+            throw ReversiError(path + " is not an opening book");
+        if (read_le(p + 4, 4) != VERSION)
+            throw ReversiError(path + " has an unknown book format version");
+        const std::uint64_t cnt = read_le(p + 8, 8);
+        if (cnt != (mFile.size() - HEADER_SIZE) / ENTRY_SIZE || (mFile.size() - HEADER_SIZE) % ENTRY_SIZE)
+            throw ReversiError(path + " is truncated");
+        mSize = std::size_t(cnt);
+    }
+
+    BitBoard OpeningBook::position(std::size_t i) const noexcept {
+        const unsigned char* p = mFile.data() + HEADER_SIZE + i * ENTRY_SIZE;
+        return { read_le(p, 8), read_le(p + 8, 8) };
+    }
+
+    BookMove OpeningBook::move(std::size_t i) const noexcept {
+        const unsigned char* p = mFile.data() + HEADER_SIZE + i * ENTRY_SIZE;
+        return { int(p[16]), int(std::int16_t(read_le(p + 18, 2))), std::uint32_t(read_le(p + 20, 4)) };
+    }
+
+    std::vector<BookMove> OpeningBook::lookup(const BitBoard& b) const {
+        int sym;
+        const BitBoard key = canonical(b, &sym);
+        // The first entry not before the key.
+        std::size_t lo = 0, hi = mSize;
+        while (lo < hi) {
+            const std::size_t mid = lo + (hi - lo) / 2;
+            if (position(mid) < key)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        std::vector<BookMove> ans;
+        const int back = inverse_symmetry(sym);
+        for (; lo < mSize && position(lo) == key; lo++) {
+            BookMove m = move(lo);
+            m.sq = transform_square(m.sq, back);
+            ans.push_back(m);
+        }
+        return ans;
+    }
+
+    std::optional<BookMove> OpeningBook::best_move(const BitBoard& b) const {
+        const std::uint64_t legal = b.moves();
+        std::optional<BookMove> ans;
+        for (const auto& m : lookup(b)) {
+            // A book for a different game could list anything.
+            if (m.sq >= 64 || !(legal >> m.sq & 1))
+                continue;
+            if (!ans || m.score > ans->score || (m.score == ans->score && m.visits > ans->visits))
+                ans = m;
+        }
+        return ans;
+    }
+
+    void OpeningBook::write(const std::string& path, std::vector<BookEntry> entries) {
+        std::sort(entries.begin(), entries.end(), entry_less);
+        for (std::size_t i = 1; i < entries.size(); i++) {
+            if (!entry_less(entries[i - 1], entries[i]))
+                throw ReversiError("Duplicate book entry");
+        }
+        std::ofstream out(path, std::ios::binary);
+        if (!out)
+            throw ReversiError("Can't create " + path);
+        out.write(MAGIC, 4);
+        write_le(out, VERSION, 4);
+        write_le(out, entries.size(), 8);
+        for (const auto& e : entries) {
+            write_le(out, e.pos.own, 8);
+            write_le(out, e.pos.opp, 8);
+            out.put(char(e.move.sq));
+            out.put(0);
+            write_le(out, std::uint16_t(std::clamp(e.move.score, -64, 64)), 2);
+            write_le(out, e.move.visits, 4);
+        }
+        out.close();
+        if (!out)
+            throw ReversiError("Error writing " + path);
+    }
+}
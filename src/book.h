@@ -0,0 +1,77 @@
+// Opening books: what is known about the moves of early positions, in a
+// memory mapped file
+#ifndef REVERSI_BOOK_H
+#define REVERSI_BOOK_H
+#include "bitboard.h"
+#include "mapped_file.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace Reversi {
+    // A move of a book position.
+    struct BookMove {
+        // The square (see to_index()).
+        int sq = 0;
+        // The expected final disc difference for the player making the move.
+        int score = 0;
+        // The games that played it. 0 if the score comes from a search alone.
+        std::uint32_t visits = 0;
+    };
+
+    // One record of a book file: a move of a canonical position, with the
+    // square in the frame of that position.
+    struct BookEntry {
+        BitBoard pos;
+        BookMove move;
+    };
+
+    // A book file, looked up in place. The file is the magic "RVBK", the
+    // format version as a little endian 32 bit integer and the number of
+    // entries as a little endian 64 bit integer, followed by the entries of
+    // ENTRY_SIZE bytes each, sorted by position and then square:
+    //  - own and opp of the canonical position (see canonical()), little
+    //    endian 64 bit integers,
+    //  - the square as a byte, and a zero byte,
+    //  - the score as a little endian 16 bit integer,
+    //  - the visits as a little endian 32 bit integer.
+    // Nothing is read when the book is opened. A lookup is a binary search over
+    // the mapped file, so only the pages it touches are ever loaded.
+    class OpeningBook {
+    public:
+        static constexpr std::size_t HEADER_SIZE = 16, ENTRY_SIZE = 24;
+
+    private:
+        MappedFile mFile;
+        std::size_t mSize = 0;
+
+        // The position of entry i, and the rest of it.
+        BitBoard position(std::size_t i) const noexcept;
+        BookMove move(std::size_t i) const noexcept;
+
+    public:
+        // Maps the file, throwing ReversiError if it can't be read or doesn't
+        // look like a book.
+        explicit OpeningBook(const std::string& path);
+
+        // The number of entries.
+        inline std::size_t size() const noexcept {
+            return mSize;
+        }
+
+        // The moves the book has for b, with the squares in the frame of b.
+        // Empty if b isn't in the book.
+        std::vector<BookMove> lookup(const BitBoard& b) const;
+
+        // The legal move of b with the best score, preferring the one played
+        // more often on ties. Nothing if b isn't in the book.
+        std::optional<BookMove> best_move(const BitBoard& b) const;
+
+        // Writes a book with the entries, whose positions must be canonical,
+        // sorting them first. Throws ReversiError if the file can't be
+        // written or two entries are for the same move.
+        static void write(const std::string& path, std::vector<BookEntry> entries);
+    };
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "command_line.h"
+#include "game.h"
+#include <algorithm>
+
+namespace Reversi {
+    CommandLine CommandLine::parse(int argc, char** argv, std::initializer_list<const char*> switches) {
+        CommandLine ans;
+        for (int i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            if (arg.rfind("--", 0) != 0) {
+                ans.positional.push_back(arg);
+                continue;
+            }
+            const auto eq = arg.find('=');
+            const std::string key = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+            if (eq != std::string::npos && !key.empty())
+                ans.options[key] = arg.substr(eq + 1);
+            else if (eq == std::string::npos && std::find(switches.begin(), switches.end(), key) != switches.end())
+                ans.options[key] = "1";
+            else
+                throw ReversiError("Expected --key=value: " + arg);
+        }
+        return ans;
+    }
+
+    void CommandLine::check_keys(std::initializer_list<const char*> known) const {
+        for (const auto& [key, value] : options) {
+            if (std::find(known.begin(), known.end(), key) == known.end())
+                throw ReversiError("Unknown option --" + key);
+        }
+    }
+
+    bool CommandLine::has(const std::string& key) const {
+        return options.count(key) != 0;
+    }
+
+    int CommandLine::get_int(const std::string& key, int def) const {
+        const auto it = options.find(key);
+        if (it == options.end())
+            return def;
+        try {
+            std::size_t used = 0;
+            const int ans = std::stoi(it->second, &used);
+            if (used == it->second.size())
+                return ans;
+        } catch (const std::logic_error&) {}
+        throw ReversiError("Option --" + key + " expects an integer, got " + it->second);
+    }
+
+    unsigned long long CommandLine::get_unsigned(const std::string& key, unsigned long long def) const {
+        const auto it = options.find(key);
+        if (it == options.end())
+            return def;
+        try {
+            std::size_t used = 0;
+            const unsigned long long ans = std::stoull(it->second, &used);
+            if (used == it->second.size() && it->second.find('-') == std::string::npos)
+                return ans;
+        } catch (const std::logic_error&) {}
+        throw ReversiError("Option --" + key + " expects a non-negative integer, got " + it->second);
+    }
+
+    double CommandLine::get_double(const std::string& key, double def) const {
+        const auto it = options.find(key);
+        if (it == options.end())
+            return def;
+        try {
+            std::size_t used = 0;
+            const double ans = std::stod(it->second, &used);
+            if (used == it->second.size())
+                return ans;
+        } catch (const std::logic_error&) {}
+        throw ReversiError("Option --" + key + " expects a number, got " + it->second);
+    }
+
+    std::string CommandLine::get_string(const std::string& key, const std::string& def) const {
+        const auto it = options.find(key);
+        return it == options.end() ? def : it->second;
+    }
+}
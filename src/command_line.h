@@ -0,0 +1,42 @@
+// Command line parsing shared by the tools
+#ifndef REVERSI_COMMAND_LINE_H
+#define REVERSI_COMMAND_LINE_H
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Reversi {
+    // The arguments of a tool: `--key=value` options and the other arguments
+    // in order. Like EngineDescription, the getters throw ReversiError for a
+    // value they can't read, so that a tool reports it instead of dying on an
+    // uncaught exception from std::stoi().
+    struct CommandLine {
+        // The arguments that don't start with "--".
+        std::vector<std::string> positional;
+        // The options by key, without the "--". Switches read as "1".
+        std::map<std::string, std::string> options;
+
+        // Splits argv. Only the `switches` may come without "=value".
+        // Throws ReversiError for any other option without one.
+        static CommandLine parse(int argc, char** argv, std::initializer_list<const char*> switches = {});
+
+        // Throws ReversiError if an option key is not in `known`.
+        void check_keys(std::initializer_list<const char*> known) const;
+
+        bool has(const std::string& key) const;
+
+        // Typed getters. They return `def` if the key is absent, and throw
+        // ReversiError unless the whole value is a number that fits.
+        int get_int(const std::string& key, int def) const;
+
+        // Rejects a minus sign, which std::stoull would wrap around.
+        unsigned long long get_unsigned(const std::string& key, unsigned long long def) const;
+
+        double get_double(const std::string& key, double def) const;
+
+        std::string get_string(const std::string& key, const std::string& def) const;
+    };
+}
+
+#endif
@@ -0,0 +1,136 @@
+#include "coro.h"
+#include <future>
+#include <map>
+#include <thread>
+
+namespace Reversi {
+    void Cancellation::cancel() {
+        std::function<void()> hook;
+        {
+            std::lock_guard lock(mMutex);
+            mCanceled = true;
+            if (!mHook)
+                return;
+            hook = mHook;
+            mRunning = true;
+        }
+        // Outside the lock, since the hook takes the lock of what the
+        // coroutine waits on, which is held while the hook is set.
+        hook();
+        {
+            std::lock_guard lock(mMutex);
+            mRunning = false;
+        }
+        mHookDone.notify_all();
+    }
+
+    void Cancellation::reset() {
+        std::lock_guard lock(mMutex);
+        mCanceled = false;
+    }
+
+    bool Cancellation::set_hook(std::function<void()> hook) {
+        std::lock_guard lock(mMutex);
+        if (mCanceled)
+            return false;
+        mHook = std::move(hook);
+        return true;
+    }
+
+    void Cancellation::clear_hook() {
+        std::unique_lock lock(mMutex);
+        mHookDone.wait(lock, [this] {
+            return !mRunning;
+        });
+        mHook = nullptr;
+    }
+
+    MoveTask::~MoveTask() noexcept {
+        if (mHandle)
+            mHandle.destroy();
+    }
+
+    void MoveTask::start(TaskGroup& group, Cancellation& cancel, Callback done, void* ctx) && {
+        auto& p = mHandle.promise();
+        p.group = &group;
+        p.cancel = &cancel;
+        p.done = done;
+        p.ctx = ctx;
+        // From here on the coroutine destroys itself.
+        std::exchange(mHandle, {}).resume();
+    }
+
+    MoveTask::Move MoveTask::run(Cancellation& cancel) && {
+        struct Outcome {
+            std::promise<Move> result;
+        } outcome;
+        auto fut = outcome.result.get_future();
+        TaskGroup group;
+        std::move(*this).start(group, cancel, [](void* ctx, Move move, std::exception_ptr error) {
+            auto& result = static_cast<Outcome*>(ctx)->result;
+            if (error)
+                result.set_exception(error);
+            else
+                result.set_value(move);
+        }, &outcome);
+        fut.wait();
+        // The task that finished it may still be returning.
+        group.wait();
+        return fut.get();
+    }
+
+    namespace {
+        class Timer {
+            std::mutex mMutex;
+            std::condition_variable mWake;
+            std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> mQueue;
+            bool mStop = false;
+            std::thread mThread;
+
+            void loop() {
+                std::unique_lock lock(mMutex);
+                while (!mStop) {
+                    if (mQueue.empty()) {
+                        mWake.wait(lock);
+                        continue;
+                    }
+                    const auto first = mQueue.begin();
+                    if (first->first > std::chrono::steady_clock::now()) {
+                        mWake.wait_until(lock, first->first);
+                        continue;
+                    }
+                    auto fn = std::move(first->second);
+                    mQueue.erase(first);
+                    lock.unlock();
+                    fn();
+                    lock.lock();
+                }
+            }
+
+        public:
+            Timer() : mThread(&Timer::loop, this) {}
+
+            ~Timer() noexcept {
+                {
+                    std::lock_guard lock(mMutex);
+                    mStop = true;
+                }
+                mWake.notify_one();
+                mThread.join();
+            }
+
+            void add(std::chrono::steady_clock::time_point when, std::function<void()> fn) {
+                {
+                    std::lock_guard lock(mMutex);
+                    mQueue.emplace(when, std::move(fn));
+                }
+                mWake.notify_one();
+            }
+        };
+    }
+
+    void call_at(std::chrono::steady_clock::time_point when, std::function<void()> fn) {
+        static Timer timer;
+        timer.add(when, std::move(fn));
+    }
+}
@@ -0,0 +1,247 @@
+// Coroutines for engines that spend their time waiting
+#ifndef REVERSI_CORO_H
+#define REVERSI_CORO_H
+#include "thread_pool.h"
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <variant>
+
+namespace Reversi {
+    // How a computation tells the coroutine waiting for it that it was
+    // canceled. The coroutine sets a hook while it waits, which cancel() runs.
+    class Cancellation {
+        std::mutex mMutex;
+        std::condition_variable mHookDone;
+        bool mCanceled = false;
+        // Whether cancel() is running the hook outside the lock.
+        bool mRunning = false;
+        std::function<void()> mHook;
+
+    public:
+        // (Any thread) Raises the flag and runs the hook, if there is one.
+        void cancel();
+
+        // Lowers the flag for the next computation.
+        void reset();
+
+        // Makes cancel() run `hook`, or returns false if it was already canceled.
+        bool set_hook(std::function<void()> hook);
+
+        // Removes the hook, waiting for a call of it to finish, so that it
+        // can't act on a later wait.
+        void clear_hook();
+    };
+
+    // The coroutine of a move computation, as returned by
+    // Engine::make_move_async(). It starts suspended. While it waits on a
+    // Signal or a timer, it holds no thread; once the event comes, the rest
+    // of it runs as a task of its TaskGroup.
+    class MoveTask {
+    public:
+        using Move = std::pair<int, int>;
+        // Told the move, or the exception the coroutine threw.
+        using Callback = void (*)(void* ctx, Move move, std::exception_ptr error);
+
+        struct promise_type {
+            Move move{ 0, 0 };
+            std::exception_ptr error;
+            // Where it resumes after waiting, and what wakes it early.
+            TaskGroup* group = nullptr;
+            Cancellation* cancel = nullptr;
+            Callback done = nullptr;
+            void* ctx = nullptr;
+
+            struct FinalAwaiter {
+                bool await_ready() const noexcept {
+                    return false;
+                }
+
+                void await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                    auto& p = h.promise();
+                    const Callback done = p.done;
+                    void* const ctx = p.ctx;
+                    const Move move = p.move;
+                    auto error = std::move(p.error);
+                    // The coroutine is gone before the owner hears, so the
+                    // owner may go away as soon as it does.
+                    h.destroy();
+                    done(ctx, move, std::move(error));
+                }
+
+                void await_resume() const noexcept {}
+            };
+
+            MoveTask get_return_object() noexcept {
+                return MoveTask(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() const noexcept {
+                return {};
+            }
+
+            FinalAwaiter final_suspend() const noexcept {
+                return {};
+            }
+
+            void return_value(Move m) noexcept {
+                move = m;
+            }
+
+            void unhandled_exception() noexcept {
+                error = std::current_exception();
+            }
+        };
+
+    private:
+        std::coroutine_handle<promise_type> mHandle;
+
+        explicit MoveTask(std::coroutine_handle<promise_type> h) noexcept : mHandle(h) {}
+
+    public:
+        MoveTask(MoveTask&& other) noexcept : mHandle(std::exchange(other.mHandle, {})) {}
+
+        MoveTask& operator = (MoveTask&&) = delete;
+
+        // Destroys the coroutine if it was never started.
+        ~MoveTask() noexcept;
+
+        // Runs the coroutine on the calling thread until it first waits.
+        // After waiting it goes on as a task of `group`, and `cancel` wakes
+        // it early. At the end it destroys itself and calls done(ctx, ...).
+        void start(TaskGroup& group, Cancellation& cancel, Callback done, void* ctx) &&;
+
+        // Runs the coroutine to the end, blocking the calling thread while it
+        // waits. Returns the move, or rethrows what it threw.
+        Move run(Cancellation& cancel) &&;
+    };
+
+    // An event with a value that one coroutine at a time waits for, such as a
+    // click. `co_await signal.wait()` gives the value, or nothing if the
+    // computation was canceled.
+    template <class T>
+    class Signal {
+        // Guards everything below.
+        std::mutex mMutex;
+        // The coroutine waiting, if any.
+        std::coroutine_handle<> mWaiter;
+        TaskGroup* mGroup = nullptr;
+        // What the waiter is woken with.
+        std::optional<T> mValue;
+
+        // Wakes h with nothing if it's still waiting.
+        void cancel_waiter(std::coroutine_handle<> h) {
+            TaskGroup* group;
+            {
+                std::lock_guard lock(mMutex);
+                if (!mWaiter || mWaiter != h)
+                    return;
+                mWaiter = {};
+                mValue.reset();
+                group = mGroup;
+            }
+            group->run([h] { h.resume(); });
+        }
+
+    public:
+        class Awaiter {
+            Signal& mSignal;
+            Cancellation* mCancel = nullptr;
+
+        public:
+            explicit Awaiter(Signal& signal) noexcept : mSignal(signal) {}
+
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            bool await_suspend(std::coroutine_handle<MoveTask::promise_type> h) {
+                auto& p = h.promise();
+                mCancel = p.cancel;
+                std::lock_guard lock(mSignal.mMutex);
+                mSignal.mValue.reset();
+                // Once the waiter is set, the coroutine may be resumed on
+                // another thread, so it comes last.
+                if (!mCancel->set_hook([&signal = mSignal, h] { signal.cancel_waiter(h); }))
+                    return false;
+                mSignal.mWaiter = h;
+                mSignal.mGroup = p.group;
+                return true;
+            }
+
+            std::optional<T> await_resume() {
+                mCancel->clear_hook();
+                std::lock_guard lock(mSignal.mMutex);
+                return std::exchange(mSignal.mValue, std::nullopt);
+            }
+        };
+
+        // (Any thread) Hands v to the coroutine waiting, which goes on as a
+        // task on the pool. Returns false if none is waiting.
+        bool set(T v) {
+            std::coroutine_handle<> h;
+            TaskGroup* group;
+            {
+                std::lock_guard lock(mMutex);
+                if (!mWaiter)
+                    return false;
+                h = std::exchange(mWaiter, {});
+                mValue = std::move(v);
+                group = mGroup;
+            }
+            group->run([h] { h.resume(); });
+            return true;
+        }
+
+        // Whether a coroutine is waiting.
+        bool waiting() {
+            std::lock_guard lock(mMutex);
+            return bool(mWaiter);
+        }
+
+        Awaiter wait() noexcept {
+            return Awaiter(*this);
+        }
+    };
+
+    // Calls fn on the timer thread of the process at `when`. One thread
+    // serves all the timers.
+    void call_at(std::chrono::steady_clock::time_point when, std::function<void()> fn);
+
+    // `co_await sleep_for(d)` resumes the coroutine after d without holding a
+    // thread meanwhile. Gives false if it was canceled before.
+    class sleep_for {
+        std::shared_ptr<Signal<std::monostate>> mSignal = std::make_shared<Signal<std::monostate>>();
+        Signal<std::monostate>::Awaiter mAwaiter{ *mSignal };
+        std::chrono::steady_clock::duration mDuration;
+
+    public:
+        explicit sleep_for(std::chrono::steady_clock::duration d) noexcept : mDuration(d) {}
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<MoveTask::promise_type> h) {
+            // The awaiter may be gone once the coroutine waits.
+            auto signal = mSignal;
+            const auto when = std::chrono::steady_clock::now() + mDuration;
+            if (!mAwaiter.await_suspend(h))
+                return false;
+            call_at(when, [signal] { signal->set({}); });
+            return true;
+        }
+
+        bool await_resume() {
+            return mAwaiter.await_resume().has_value();
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include "elo.h"
+#include "game.h"
+#include <cmath>
+#include <limits>
+
+namespace Reversi {
+    double elo_to_score(double elo) {
+        return 1 / (1 + std::pow(10.0, -elo / 400));
+    }
+
+    double score_to_elo(double score) {
+        if (score <= 0)
+            return -std::numeric_limits<double>::infinity();
+        if (score >= 1)
+            return std::numeric_limits<double>::infinity();
+        return -400 * std::log10(1 / score - 1);
+    }
+
+    Sprt::Sprt(double elo0, double elo1, double alpha, double beta) :
+        mScore0(elo_to_score(elo0)), mScore1(elo_to_score(elo1)),
+        mLower(std::log(beta / (1 - alpha))), mUpper(std::log((1 - beta) / alpha))
+    {
+        if (!(elo0 < elo1))
+            throw ReversiError("elo0 should be less than elo1");
+        if (!(alpha > 0 && alpha < 1 && beta > 0 && beta < 1))
+            throw ReversiError("alpha and beta should be between 0 and 1");
+    }
+
+    void Sprt::add_pair(double first, double second) {
+        const int halves = int(std::lround(2 * (first + second)));
+        if (halves < 0 || halves > 4)
+            throw ReversiError("A game scores 0, 0.5 or 1");
+        ++mPairs[halves];
+    }
+
+    int Sprt::pairs() const noexcept {
+        int ans = 0;
+        for (const int n : mPairs)
+            ans += n;
+        return ans;
+    }
+
+    std::pair<double, double> Sprt::moments() const {
+        const int n = pairs() + 5;
+        double mean = 0, sq = 0;
+        for (int i = 0; i < 5; i++) {
+            mean += (mPairs[i] + 1) * (i / 4.0);
+            sq += (mPairs[i] + 1) * (i / 4.0) * (i / 4.0);
+        }
+        mean /= n;
+        return { mean, sq / n - mean * mean };
+    }
+
+    double Sprt::llr() const {
+        const auto [mean, var] = moments();
+        return pairs() * (mScore1 - mScore0) * (2 * mean - mScore0 - mScore1) / (2 * var);
+    }
+
+    Sprt::Verdict Sprt::verdict() const {
+        const double x = llr();
+        if (x <= mLower)
+            return Verdict::AcceptH0;
+        if (x >= mUpper)
+            return Verdict::AcceptH1;
+        return Verdict::Continue;
+    }
+
+    std::pair<double, double> Sprt::elo() const {
+        const auto [mean, var] = moments();
+        const int n = pairs();
+        const double margin = n ? 1.96 * std::sqrt(var / n) : 0.5;
+        const double lo = score_to_elo(mean - margin), hi = score_to_elo(mean + margin);
+        return { score_to_elo(mean), (hi - lo) / 2 };
+    }
+}
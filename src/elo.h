@@ -0,0 +1,76 @@
+// Elo estimates and the sequential probability ratio test for engine matches
+#ifndef REVERSI_ELO_H
+#define REVERSI_ELO_H
+#include <array>
+#include <utility>
+
+namespace Reversi {
+    // The expected score of a player `elo` points stronger, in the logistic
+    // model.
+    double elo_to_score(double elo);
+
+    // The inverse of elo_to_score(). Infinite for a score of 0 or 1.
+    double score_to_elo(double score);
+
+    // A sequential probability ratio test of whether an engine is `elo0` or
+    // `elo1` Elo stronger than another, fed with game pairs: an opening
+    // played with both colours. Pairs cancel most of the bias of the
+    // openings, so their scores vary less than those of single games and the
+    // test ends sooner.
+    //
+    // The log likelihood ratio uses the normal approximation over the pair
+    // scores, LLR = N (s1 - s0) (2 mean - s0 - s1) / (2 variance), where s0
+    // and s1 are the expected scores of elo0 and elo1. The mean and variance
+    // count one extra pair of each outcome, so that the variance is never 0:
+    // otherwise an engine against itself, or one that wins every pair, would
+    // never conclude.
+    class Sprt {
+    public:
+        enum class Verdict {
+            Continue, AcceptH0, AcceptH1
+        };
+
+    private:
+        double mScore0, mScore1;
+        // The LLR at which H0 and H1 are accepted.
+        double mLower, mUpper;
+        // The number of pairs by the points the engine tested scored, 0 to 4
+        // in halves of a game.
+        std::array<int, 5> mPairs{};
+
+        // The mean and variance of the pair scores, each from 0 to 1, with
+        // the extra pairs.
+        std::pair<double, double> moments() const;
+
+    public:
+        // H0 is elo0 and H1 elo1, which must be greater. `alpha` and `beta`
+        // are the rates of false positives and false negatives, between 0 and
+        // 1. Throws ReversiError on bad bounds.
+        Sprt(double elo0, double elo1, double alpha, double beta);
+
+        // Adds a pair with the scores of the engine tested in its two games:
+        // 0, 0.5 or 1 each.
+        void add_pair(double first, double second);
+
+        int pairs() const noexcept;
+
+        // The log likelihood ratio of H1 against H0 so far.
+        double llr() const;
+
+        inline double lower_bound() const noexcept {
+            return mLower;
+        }
+
+        inline double upper_bound() const noexcept {
+            return mUpper;
+        }
+
+        Verdict verdict() const;
+
+        // The Elo difference measured, and the half width of its 95%
+        // confidence interval.
+        std::pair<double, double> elo() const;
+    };
+}
+
+#endif
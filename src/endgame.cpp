@@ -0,0 +1,686 @@
+#include "endgame.h"
+#include "eval.h"
+#include "solve_cache.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace Reversi {
+    namespace {
+        // The four 4x4 quadrants of the board.
+        constexpr std::uint64_t QUADRANTS[4] = {
+            0x000000000F0F0F0F, 0x00000000F0F0F0F0, 0x0F0F0F0F00000000, 0xF0F0F0F000000000
+        };
+
+        // The squares of the quadrants with an odd number of empties. Moving
+        // there first tends to leave the last move in each region to us.
+        // Rather than counting, folds the rows of each half and then the
+        // columns of each nibble, which leaves the parities of the quadrants
+        // in bits 0, 4, 32 and 36.
+        inline std::uint64_t odd_quadrants(std::uint64_t empty) noexcept {
+            std::uint64_t x = empty ^ (empty >> 16);
+            x ^= x >> 8;
+            x ^= x >> 2;
+            x ^= x >> 1;
+            return (QUADRANTS[0] & -(x & 1)) | (QUADRANTS[1] & -(x >> 4 & 1))
+                | (QUADRANTS[2] & -(x >> 32 & 1)) | (QUADRANTS[3] & -(x >> 36 & 1));
+        }
+
+        constexpr std::uint64_t CORNERS = 0x8100000000000081;
+
+        // Plays the move at sq whose flips are already known.
+        inline BitBoard play_flips(const BitBoard& b, int sq, std::uint64_t flips) noexcept {
+            return { b.opp ^ flips, b.own ^ flips ^ (std::uint64_t(1) << sq) };
+        }
+
+        // The static evaluation of b after the best reply by the static
+        // evaluation, from the side of the player to move.
+        int best_reply_eval(const BitBoard& b) noexcept {
+            std::uint64_t moves = b.moves();
+            if (!moves)
+                return -quick_eval(b.pass());
+            int ans = -1000000;
+            while (moves) {
+                const int sq = std::countr_zero(moves);
+                moves &= moves - 1;
+                ans = std::max(ans, -quick_eval(b.play(sq)));
+            }
+            return ans;
+        }
+
+        constexpr std::uint64_t COLUMN_A = 0x0101010101010101, COLUMN_H = 0x8080808080808080;
+        constexpr std::uint64_t EDGES = 0xFF818181818181FF;
+
+        // The lines of the board in each of the four directions, used to find
+        // the full ones.
+        struct Lines {
+            std::uint64_t rows[8], columns[8], diagonals[15], antidiagonals[15];
+
+            constexpr Lines() : rows(), columns(), diagonals(), antidiagonals() {
+                for (int r = 0; r < 8; r++) {
+                    for (int c = 0; c < 8; c++) {
+                        const std::uint64_t bit = std::uint64_t(1) << (r * 8 + c);
+                        rows[r] |= bit;
+                        columns[c] |= bit;
+                        diagonals[r - c + 7] |= bit;
+                        antidiagonals[r + c] |= bit;
+                    }
+                }
+            }
+        };
+
+        constexpr Lines LINES;
+
+        // The squares whose line is full, among `lines`.
+        template <std::size_t N>
+        inline std::uint64_t full_lines(std::uint64_t occupied, const std::uint64_t (&lines)[N]) noexcept {
+            std::uint64_t ans = 0;
+            for (const std::uint64_t line : lines) {
+                if ((occupied & line) == line)
+                    ans |= line;
+            }
+            return ans;
+        }
+
+        // Discs of `own` that can never be flipped, by a conservative test: in
+        // each direction the line through the disc is full, or it is next to
+        // the edge or to another stable disc of `own`.
+        std::uint64_t stable_discs(std::uint64_t own, std::uint64_t opp) noexcept {
+            const std::uint64_t occupied = own | opp;
+            const std::uint64_t rows = full_lines(occupied, LINES.rows) | COLUMN_A | COLUMN_H;
+            const std::uint64_t columns = full_lines(occupied, LINES.columns) | 0xFF000000000000FF;
+            const std::uint64_t diagonals = full_lines(occupied, LINES.diagonals) | EDGES;
+            const std::uint64_t antidiagonals = full_lines(occupied, LINES.antidiagonals) | EDGES;
+            std::uint64_t stable = 0;
+            while (true) {
+                const std::uint64_t next = own
+                    & (rows | (stable << 1 & ~COLUMN_A) | (stable >> 1 & ~COLUMN_H))
+                    & (columns | stable << 8 | stable >> 8)
+                    & (diagonals | (stable << 9 & ~COLUMN_A) | (stable >> 9 & ~COLUMN_H))
+                    & (antidiagonals | (stable << 7 & ~COLUMN_H) | (stable >> 7 & ~COLUMN_A));
+                if (next == stable)
+                    return stable;
+                stable = next;
+            }
+        }
+
+        // The discs flipped along one line by a move at `pos`, by the bits
+        // of the mover on the line, when every other square of the line is
+        // taken: a run of the opponent's discs flips if the mover's disc ends
+        // it before the edge.
+        struct LineFlips {
+            std::uint8_t count[8][256];
+
+            constexpr LineFlips() : count() {
+                for (int pos = 0; pos < 8; pos++) {
+                    for (int line = 0; line < 256; line++) {
+                        int n = 0;
+                        for (const int dir : { -1, 1 }) {
+                            int i = pos + dir;
+                            while (i >= 0 && i < 8 && !(line >> i & 1))
+                                i += dir;
+                            if (i >= 0 && i < 8)
+                                n += (i - pos) * dir - 1;
+                        }
+                        count[pos][line] = std::uint8_t(n);
+                    }
+                }
+            }
+        };
+
+        constexpr LineFlips LINE_FLIPS;
+
+        // The diagonals through each square, to pick out their bits.
+        struct DiagonalMasks {
+            std::uint64_t diagonal[64], antidiagonal[64];
+
+            constexpr DiagonalMasks() : diagonal(), antidiagonal() {
+                for (int sq = 0; sq < 64; sq++) {
+                    diagonal[sq] = LINES.diagonals[(sq >> 3) - (sq & 7) + 7];
+                    antidiagonal[sq] = LINES.antidiagonals[(sq >> 3) + (sq & 7)];
+                }
+            }
+        };
+
+        constexpr DiagonalMasks DIAGONAL_MASKS;
+
+        // The number of discs `own` flips by playing at sq, the only empty
+        // square, without finding the flips themselves. Each line through sq
+        // is gathered into a byte indexed by column, or by row for the column
+        // through sq. Squares off a short diagonal read as the opponent's,
+        // which flips nothing since the run then reaches the edge.
+        inline int count_last_flips(std::uint64_t own, int sq) noexcept {
+            constexpr std::uint64_t FILE = 0x0101010101010101;
+            const int r = sq >> 3, c = sq & 7;
+            return LINE_FLIPS.count[c][own >> (r * 8) & 0xFF]
+                + LINE_FLIPS.count[r][((own >> c) & FILE) * 0x0102040810204080 >> 56]
+                + LINE_FLIPS.count[c][(own & DIAGONAL_MASKS.diagonal[sq]) * FILE >> 56]
+                + LINE_FLIPS.count[c][(own & DIAGONAL_MASKS.antidiagonal[sq]) * FILE >> 56];
+        }
+
+        // Pops the lowest square of the mask.
+        inline int pop_square(std::uint64_t& mask) noexcept {
+            const int sq = std::countr_zero(mask);
+            mask &= mask - 1;
+            return sq;
+        }
+    }
+
+    struct EndgameSolver::SplitPoint {
+        // The split point this one is below, or null.
+        SplitPoint* const parent;
+        const BitBoard b;
+        const std::array<int, 64>& list;
+        const int cnt, beta;
+
+        // Set when a brother cuts off or the search is abandoned.
+        std::atomic_bool stop = false;
+
+        // The fields below are guarded by mutex.
+        std::mutex mutex;
+        // The next brother to hand out.
+        int next;
+        int alpha, best, best_move;
+        std::uint64_t nodes = 0;
+
+        SplitPoint(SplitPoint* parent, const BitBoard& b, const std::array<int, 64>& list,
+            int first, int cnt, int alpha, int beta, int best, int best_move)
+            : parent(parent), b(b), list(list), cnt(cnt), beta(beta), next(first),
+            alpha(alpha), best(best), best_move(best_move) {}
+
+        // Whether this split point or one above it was stopped.
+        bool stopped() const noexcept {
+            for (const SplitPoint* sp = this; sp; sp = sp->parent) {
+                if (sp->stop.load(std::memory_order_relaxed))
+                    return true;
+            }
+            return false;
+        }
+    };
+
+    int EndgameSolver::last1(Worker& w, const BitBoard& b, int sq) {
+        ++w.nodes;
+        // 63 discs are on the board, so the difference is odd and there are no draws.
+        const int diff = 2 * std::popcount(b.own) - 63;
+        if (const int n = count_last_flips(b.own, sq))
+            return diff + 2 * n + 1;
+        if (const int n = count_last_flips(b.opp, sq))
+            return diff - 2 * n - 1;
+        // Nobody can fill the last square, which goes to the winner.
+        return diff > 0 ? diff + 1 : diff - 1;
+    }
+
+    int EndgameSolver::last2(Worker& w, const BitBoard& b, int sq1, int sq2, int alpha, int beta, bool passed) {
+        ++w.nodes;
+        int best = -65;
+        if (const std::uint64_t f = b.flips(sq1)) {
+            best = -last1(w, play_flips(b, sq1, f), sq2);
+            if (best >= beta)
+                return best;
+        }
+        if (const std::uint64_t f = b.flips(sq2))
+            best = std::max(best, -last1(w, play_flips(b, sq2, f), sq1));
+        if (best == -65) {
+            if (passed)
+                return b.final_score();
+            return -last2(w, b.pass(), sq1, sq2, -beta, -alpha, true);
+        }
+        return best;
+    }
+
+    int EndgameSolver::last3(Worker& w, const BitBoard& b, int sq1, int sq2, int sq3, int alpha, int beta, bool passed) {
+        ++w.nodes;
+        int best = -65;
+        const auto visit = [&](int sq, int o1, int o2) {
+            const std::uint64_t f = b.flips(sq);
+            if (!f)
+                return false;
+            const int curr = -last2(w, play_flips(b, sq, f), o1, o2, -beta, -alpha, false);
+            if (curr > best) {
+                best = curr;
+                if (curr > alpha && (alpha = curr) >= beta)
+                    return true;
+            }
+            return false;
+        };
+        if (visit(sq1, sq2, sq3) || visit(sq2, sq1, sq3) || visit(sq3, sq1, sq2))
+            return best;
+        if (best == -65) {
+            if (passed)
+                return b.final_score();
+            return -last3(w, b.pass(), sq1, sq2, sq3, -beta, -alpha, true);
+        }
+        return best;
+    }
+
+    int EndgameSolver::last4(Worker& w, const BitBoard& b, int sq1, int sq2, int sq3, int sq4, int alpha, int beta, bool passed) {
+        ++w.nodes;
+        int best = -65;
+        const auto visit = [&](int sq, int o1, int o2, int o3) {
+            const std::uint64_t f = b.flips(sq);
+            if (!f)
+                return false;
+            const int curr = -last3(w, play_flips(b, sq, f), o1, o2, o3, -beta, -alpha, false);
+            if (curr > best) {
+                best = curr;
+                if (curr > alpha && (alpha = curr) >= beta)
+                    return true;
+            }
+            return false;
+        };
+        if (visit(sq1, sq2, sq3, sq4) || visit(sq2, sq1, sq3, sq4)
+            || visit(sq3, sq1, sq2, sq4) || visit(sq4, sq1, sq2, sq3))
+            return best;
+        if (best == -65) {
+            if (passed)
+                return b.final_score();
+            return -last4(w, b.pass(), sq1, sq2, sq3, sq4, -beta, -alpha, true);
+        }
+        return best;
+    }
+
+    int EndgameSolver::dispatch(Worker& w, const BitBoard& b, int alpha, int beta, bool passed) {
+        const std::uint64_t empty = ~(b.own | b.opp);
+        switch (std::popcount(empty)) {
+        case 0:
+            ++w.nodes;
+            return b.final_score();
+        case 1:
+            return last1(w, b, std::countr_zero(empty));
+        case 2: {
+            std::uint64_t e = empty;
+            const int sq1 = pop_square(e);
+            return last2(w, b, sq1, std::countr_zero(e), alpha, beta, passed);
+        }
+        case 3: {
+            std::uint64_t e = empty;
+            const int sq1 = pop_square(e), sq2 = pop_square(e);
+            return last3(w, b, sq1, sq2, std::countr_zero(e), alpha, beta, passed);
+        }
+        case 4: {
+            // Squares in odd quadrants first.
+            const std::uint64_t odd = odd_quadrants(empty);
+            std::uint64_t e1 = empty & odd, e2 = empty & ~odd;
+            int sq[4];
+            for (int i = 0; i < 4; i++)
+                sq[i] = e1 ? pop_square(e1) : pop_square(e2);
+            return last4(w, b, sq[0], sq[1], sq[2], sq[3], alpha, beta, passed);
+        }
+        default:
+            return std::popcount(empty) <= SHALLOW_EMPTIES
+                ? search_shallow(w, b, alpha, beta, passed) : search(w, b, alpha, beta, passed);
+        }
+    }
+
+    int EndgameSolver::search_shallow(Worker& w, const BitBoard& b, int alpha, int beta, bool passed) {
+        ++w.nodes;
+        const std::uint64_t empty = ~(b.own | b.opp);
+        const std::uint64_t odd = odd_quadrants(empty);
+        int best = -65;
+        // Walks the empties directly instead of generating the moves, the
+        // squares in odd quadrants first.
+        for (std::uint64_t part : { empty & odd, empty & ~odd }) {
+            while (part) {
+                const int sq = pop_square(part);
+                const std::uint64_t f = b.flips(sq);
+                if (!f)
+                    continue;
+                const int curr = -dispatch(w, play_flips(b, sq, f), -beta, -alpha, false);
+                if (curr > best) {
+                    best = curr;
+                    if (curr > alpha && (alpha = curr) >= beta)
+                        return best;
+                }
+            }
+        }
+        if (best == -65) {
+            if (passed)
+                return b.final_score();
+            return -search_shallow(w, b.pass(), -beta, -alpha, true);
+        }
+        return best;
+    }
+
+    int EndgameSolver::order_moves(const BitBoard& b, std::uint64_t moves, const std::array<std::uint64_t, 64>& flips,
+        int first, std::array<int, 64>& out) {
+        std::array<int, 64> keys;
+        const std::uint64_t odd = odd_quadrants(~(b.own | b.opp));
+        const int empties = b.empties();
+        int cnt = 0;
+        while (moves) {
+            const int sq = pop_square(moves);
+            // Fewer replies first, counting corner replies twice, and then
+            // the worse positions for the opponent. Far from the end, where
+            // the ordering matters most, the position after their best reply.
+            // Close to it, the evaluation isn't worth generating our moves
+            // for.
+            int key = -1000000;
+            if (sq != first) {
+                const BitBoard next = play_flips(b, sq, flips[sq]);
+                const std::uint64_t replies = next.moves();
+                key = 16 * (std::popcount(replies) + std::popcount(replies & CORNERS)) - 4 * ((odd >> sq) & 1);
+                if (empties >= REPLY_ORDER_EMPTIES)
+                    key += best_reply_eval(next);
+                else if (empties >= EVAL_ORDER_EMPTIES)
+                    key += quick_eval(next, replies);
+            }
+            int i = cnt++;
+            for (; i > 0 && keys[i - 1] > key; i--) {
+                keys[i] = keys[i - 1];
+                out[i] = out[i - 1];
+            }
+            keys[i] = key;
+            out[i] = sq;
+        }
+        return cnt;
+    }
+
+    int EndgameSolver::search(Worker& w, const BitBoard& b, int alpha, int beta, bool passed, int* best_move) {
+        if ((mCancel && mCancel->load(std::memory_order_relaxed)) || (w.split && w.split->stopped())
+            || (++w.nodes % DEADLINE_NODES == 0 && std::chrono::steady_clock::now() >= mDeadline))
+            throw Aborted();
+        const std::uint64_t moves = b.moves();
+        if (!moves) {
+            if (passed)
+                return b.final_score();
+            return -search(w, b.pass(), -beta, -alpha, true);
+        }
+        const int empties = b.empties();
+        // The opponent keeps its stable discs, which caps our score. Only
+        // worth finding out when the cap could be low enough.
+        if (!best_move && empties >= STABILITY_EMPTIES && alpha >= 64 - 2 * std::popcount(b.opp)) {
+            const int cap = 64 - 2 * std::popcount(stable_discs(b.opp, b.own));
+            if (cap <= alpha)
+                return cap;
+        }
+        const bool use_table = empties >= HASH_EMPTIES;
+        const std::uint64_t key = use_table ? b.hash() : 0;
+        int tt_move = -1;
+        TransTable::Entry entry;
+        if (use_table && mTable->probe(key, entry)) {
+            // The number of empties is fixed by the position, so the stored
+            // depth, which is the empties, only decides what is replaced.
+            tt_move = entry.move;
+            if (entry.bound == TransTable::Bound::Exact
+                || (entry.bound == TransTable::Bound::Lower && entry.score >= beta)
+                || (entry.bound == TransTable::Bound::Upper && entry.score <= alpha)) {
+                if (best_move)
+                    *best_move = entry.move;
+                return entry.score;
+            }
+        }
+        // The flips of each move, found once for the cutoffs, the ordering
+        // and the search.
+        std::array<std::uint64_t, 64> flips;
+        for (std::uint64_t m = moves; m; ) {
+            const int sq = pop_square(m);
+            flips[sq] = b.flips(sq);
+        }
+        // Enhanced transposition cutoff: a move into a position the table
+        // already knows to be bad enough for the opponent cuts off at once.
+        if (empties >= ETC_EMPTIES) {
+            for (std::uint64_t m = moves; m; ) {
+                const int sq = pop_square(m);
+                if (mTable->probe(play_flips(b, sq, flips[sq]).hash(), entry)
+                    && (entry.bound == TransTable::Bound::Exact || entry.bound == TransTable::Bound::Upper)
+                    && -entry.score >= beta) {
+                    if (best_move)
+                        *best_move = sq;
+                    return -entry.score;
+                }
+            }
+        }
+        std::array<int, 64> list;
+        const int cnt = order_moves(b, moves, flips, tt_move, list);
+        const bool can_split = mThreads > 1 && b.empties() >= mSplitEmpties;
+        const int alpha0 = alpha;
+        int best = -65, move = -1;
+        for (int i = 0; i < cnt; i++) {
+            if (i == 1 && can_split) {
+                split(w, b, list, i, cnt, alpha, beta, best, move);
+                break;
+            }
+            const BitBoard next = play_flips(b, list[i], flips[list[i]]);
+            int curr;
+            if (i == 0) {
+                curr = -dispatch(w, next, -beta, -alpha, false);
+            } else {
+                curr = -dispatch(w, next, -alpha - 1, -alpha, false);
+                if (alpha < curr && curr < beta)
+                    curr = -dispatch(w, next, -beta, -alpha, false);
+            }
+            if (curr > best) {
+                best = curr;
+                move = list[i];
+                if (curr > alpha && (alpha = curr) >= beta)
+                    break;
+            }
+        }
+        if (use_table) {
+            const auto bound = best <= alpha0 ? TransTable::Bound::Upper
+                : best >= beta ? TransTable::Bound::Lower : TransTable::Bound::Exact;
+            mTable->store(key, best, b.empties(), bound, move);
+        }
+        if (best_move)
+            *best_move = move;
+        return best;
+    }
+
+    int EndgameSolver::take_move(SplitPoint& sp) {
+        std::lock_guard lock(sp.mutex);
+        if (sp.next >= sp.cnt || sp.stop.load(std::memory_order_relaxed))
+            return -1;
+        return sp.next++;
+    }
+
+    void EndgameSolver::search_move(Worker& w, SplitPoint& sp, int idx) {
+        const std::uint64_t nodes = w.nodes;
+        SplitPoint* const saved = w.split;
+        w.split = &sp;
+        const BitBoard next = sp.b.play(sp.list[idx]);
+        int alpha;
+        {
+            std::lock_guard lock(sp.mutex);
+            alpha = sp.alpha;
+        }
+        bool done = true;
+        int curr = 0;
+        try {
+            curr = -dispatch(w, next, -alpha - 1, -alpha, false);
+            if (alpha < curr && curr < sp.beta)
+                curr = -dispatch(w, next, -sp.beta, -alpha, false);
+        } catch (Aborted) {
+            done = false;
+        }
+        w.split = saved;
+        {
+            std::lock_guard lock(sp.mutex);
+            sp.nodes += w.nodes - nodes;
+            if (done && curr > sp.best) {
+                sp.best = curr;
+                sp.best_move = sp.list[idx];
+                if (curr > sp.alpha && (sp.alpha = curr) >= sp.beta)
+                    sp.stop.store(true, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void EndgameSolver::split(Worker& w, const BitBoard& b, const std::array<int, 64>& list, int first, int cnt,
+        int& alpha, int beta, int& best, int& best_move) {
+        const auto start = std::chrono::steady_clock::now();
+        SplitPoint sp(w.split, b, list, first, cnt, alpha, beta, best, best_move);
+        // Searches brothers like the helpers, then waits for the ones they took.
+        // A helper the pool gets to late finds no brothers left.
+        TaskGroup helpers;
+        for (int i = 1; i < std::min(mThreads, cnt - first); i++)
+            helpers.run([this, &sp] { help(sp); });
+        for (int idx; (idx = take_move(sp)) >= 0; )
+            search_move(w, sp, idx);
+        helpers.wait();
+        {
+            std::lock_guard lock(mStatsMutex);
+            SplitStats& stats = mStats[b.empties()];
+            ++stats.splits;
+            stats.nodes += sp.nodes;
+            stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        // The brothers may have been stopped from above rather than by a
+        // cutoff, or by the deadline.
+        if ((mCancel && mCancel->load(std::memory_order_relaxed)) || (sp.parent && sp.parent->stopped())
+            || std::chrono::steady_clock::now() >= mDeadline)
+            throw Aborted();
+        alpha = sp.alpha;
+        best = sp.best;
+        best_move = sp.best_move;
+    }
+
+    void EndgameSolver::help(SplitPoint& sp) {
+        Worker w;
+        for (int idx; (idx = take_move(sp)) >= 0; )
+            search_move(w, sp, idx);
+        mHelperNodes.fetch_add(w.nodes, std::memory_order_relaxed);
+    }
+
+    EndgameSolver::EndgameSolver(std::size_t table_mb, int threads, int split_empties)
+        : EndgameSolver(std::make_shared<TransTable>(table_mb), threads, split_empties) {}
+
+    EndgameSolver::EndgameSolver(std::shared_ptr<TransTable> table, int threads, int split_empties)
+        : mTable(std::move(table)), mSplitEmpties(std::max(split_empties, SHALLOW_EMPTIES + 1)),
+        mThreads(std::max(threads, 1)) {}
+
+    int EndgameSolver::search_root(const BitBoard& b, int alpha, int beta, int& best_move) {
+        // The true score lies in [lower, upper]. Each null window search
+        // around the guess moves one of them to its result, starting from
+        // the score of the previous solve if the table has it.
+        int lower = alpha, upper = beta;
+        TransTable::Entry entry;
+        int guess = mTable->probe(b.hash(), entry) ? entry.score : 0;
+        best_move = -1;
+        while (lower < upper) {
+            guess = std::clamp(guess, lower + 1, upper);
+            int move = -1;
+            const int curr = search(mMain, b, guess - 1, guess, false, &move);
+            if (curr >= guess) {
+                lower = curr;
+                best_move = move;
+            } else {
+                upper = curr;
+                if (best_move < 0)
+                    best_move = move;
+            }
+            guess = curr;
+        }
+        return lower >= beta ? lower : upper;
+    }
+
+    EndgameSolver::Result EndgameSolver::solve(const BitBoard& b, int alpha, int beta) {
+        const bool cached = mCache && b.empties() >= SolveCache::MIN_EMPTIES;
+        if (cached) {
+            if (const auto res = mCache->lookup(b, alpha, beta))
+                return *res;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        Result ans{ 0, -1 };
+        ans.score = search_root(b, alpha, beta, ans.move);
+        if (cached)
+            mCache->store(b, ans, alpha, beta, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        return ans;
+    }
+
+    std::array<EndgameSolver::SplitStats, 65> EndgameSolver::split_stats() {
+        std::lock_guard lock(mStatsMutex);
+        return mStats;
+    }
+
+    SolverEngine::Options SolverEngine::Options::from_description(const EngineDescription& desc) {
+        desc.check_keys({ "max_empties", "tt_mb", "threads", "split_empties", "cache" });
+        Options ans;
+        ans.max_empties = desc.get_int("max_empties", ans.max_empties);
+        if (ans.max_empties < 0 || ans.max_empties > 64)
+            throw ReversiError("max_empties should be between 0 and 64");
+        ans.tt_mb = desc.get_int("tt_mb", ans.tt_mb);
+        if (ans.tt_mb <= 0 || ans.tt_mb > 65536)
+            throw ReversiError("tt_mb should be between 1 and 65536");
+        ans.threads = desc.get_int("threads", ans.threads);
+        if (ans.threads <= 0 || ans.threads > 256)
+            throw ReversiError("threads should be between 1 and 256");
+        ans.split_empties = desc.get_int("split_empties", ans.split_empties);
+        if (ans.split_empties < 7 || ans.split_empties > 64)
+            throw ReversiError("split_empties should be between 7 and 64");
+        ans.cache = desc.get_string("cache", ans.cache);
+        return ans;
+    }
+
+    void SolverEngine::Options::to_description(EngineDescription& desc) const {
+        const Options def;
+        if (max_empties != def.max_empties)
+            desc.set_int("max_empties", max_empties);
+        if (tt_mb != def.tt_mb)
+            desc.set_int("tt_mb", tt_mb);
+        if (threads != def.threads)
+            desc.set_int("threads", threads);
+        if (split_empties != def.split_empties)
+            desc.set_int("split_empties", split_empties);
+        if (!cache.empty())
+            desc.set_string("cache", cache);
+    }
+
+    SolverEngine::SolverEngine() : SolverEngine(Options()) {}
+
+    SolverEngine::SolverEngine(Options opt) : mOptions(opt), mSolver(opt.tt_mb, opt.threads, opt.split_empties) {
+        mSolver.set_cancel(&mCancel);
+        if (!opt.cache.empty())
+            mSolver.set_cache(SolveCache::open(opt.cache));
+    }
+
+    SolverEngine::~SolverEngine() noexcept {
+        stop_computation();
+    }
+
+    std::string SolverEngine::get_name() {
+        EngineDescription desc{ "Solver", {} };
+        mOptions.to_description(desc);
+        return desc.to_string();
+    }
+
+    std::pair<int, int> SolverEngine::do_make_move() {
+        const BitBoard b = BitBoard::from_board(mBoard);
+        std::uint64_t moves = b.moves();
+        if (!moves)
+            return { 0, 0 };
+        if (b.empties() > mOptions.max_empties) {
+            // Too early to solve.
+            int best = -1, best_score = 0;
+            while (moves) {
+                const int sq = pop_square(moves);
+                if (const int curr = move_order_score(b, sq); best < 0 || curr > best_score) {
+                    best = sq;
+                    best_score = curr;
+                }
+            }
+            return from_index(best);
+        }
+        const std::uint64_t nodes = mSolver.node_count();
+        const auto stats = mSolver.split_stats();
+        const auto start = std::chrono::steady_clock::now();
+        EndgameSolver::Result res;
+        try {
+            res = mSolver.solve(b);
+        } catch (EndgameSolver::Aborted) {
+            throw OperationCanceled();
+        }
+        report_score(res.score);
+        std::cerr << "Solver: score " << res.score << ", " << mSolver.node_count() - nodes << " nodes, "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s\n";
+        // For tuning split_empties: the work done below the splits at each depth.
+        const auto new_stats = mSolver.split_stats();
+        for (int e = 64; e >= 0; e--) {
+            if (const auto splits = new_stats[e].splits - stats[e].splits) {
+                std::cerr << "  split at " << e << " empties: " << splits << " splits, "
+                    << new_stats[e].nodes - stats[e].nodes << " nodes, "
+                    << new_stats[e].seconds - stats[e].seconds << " s\n";
+            }
+        }
+        return from_index(res.move);
+    }
+}
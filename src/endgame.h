@@ -0,0 +1,243 @@
+// Exact endgame solver
+#ifndef REVERSI_ENDGAME_H
+#define REVERSI_ENDGAME_H
+#include "engi.h"
+#include "bitboard.h"
+#include "ttable.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Reversi {
+    class SolveCache;
+
+    // Searches a position to the end of the game. Meant for positions with up
+    // to about 24 empties.
+    //
+    // The root closes in on the score with null window searches. Nodes with
+    // many empties order their moves fastest-first (fewest replies), use a
+    // small hash table of their own, also to look up their children before
+    // searching them, and give up when the opponent's stable discs leave no
+    // score above alpha. Nodes with few empties skip the move generation, try
+    // the squares in regions with an odd number of empties first (parity),
+    // and the last four empties have their own routines.
+    class EndgameSolver {
+    public:
+        struct Result {
+            // The final disc difference for the player to move under perfect play.
+            int score;
+            // The square index of the best move, or -1 if the player must pass.
+            int move;
+        };
+
+        // Thrown by solve() when the cancel flag is raised.
+        struct Aborted {};
+
+        // What the parallel search did at the nodes with a given number of
+        // empties, summed over all the solves so far.
+        struct SplitStats {
+            // How often the younger brothers were handed out to the helpers.
+            std::uint64_t splits = 0;
+            // Nodes searched below those splits, by all the threads.
+            std::uint64_t nodes = 0;
+            // Wall time from each split until its last brother was done.
+            double seconds = 0;
+        };
+
+    private:
+        // Nodes with at most this many empties use the parity ordering,
+        // and nodes with more use fastest-first.
+        static constexpr int SHALLOW_EMPTIES = 6;
+        // Nodes with at least this many empties use the hash table.
+        static constexpr int HASH_EMPTIES = 8;
+        // Nodes with at least this many empties break the ties of mobility
+        // with the evaluation when ordering their moves.
+        static constexpr int EVAL_ORDER_EMPTIES = 10;
+        // Nodes with at least this many empties look one reply ahead to order
+        // their moves.
+        static constexpr int REPLY_ORDER_EMPTIES = 14;
+        // Nodes with at least this many empties look their children up in the
+        // hash table before searching them (enhanced transposition cutoff).
+        static constexpr int ETC_EMPTIES = 10;
+        // Nodes with at least this many empties check whether the opponent's
+        // stable discs leave them a score above alpha.
+        static constexpr int STABILITY_EMPTIES = 8;
+
+        // A node whose younger brothers are being searched by several threads.
+        // Defined in endgame.cpp.
+        struct SplitPoint;
+
+        // The state private to each search thread.
+        struct Worker {
+            // Nodes visited so far.
+            std::uint64_t nodes = 0;
+            // The innermost split point the worker is searching below, or null.
+            SplitPoint* split = nullptr;
+        };
+
+        // Shared by all the threads, and by the other solvers made with the
+        // same table.
+        std::shared_ptr<TransTable> mTable;
+
+        // Nodes with at least this many empties are split.
+        const int mSplitEmpties;
+
+        // The number of threads a split point is searched by, counting the
+        // one that split it. The others are tasks on the shared thread pool.
+        const int mThreads;
+
+        // The worker of the thread calling solve().
+        Worker mMain;
+
+        // Nodes visited by the helpers so far.
+        std::atomic<std::uint64_t> mHelperNodes = 0;
+
+        // Checked once per deep node. May be null.
+        const std::atomic_bool* mCancel = nullptr;
+
+        // Checked every DEADLINE_NODES deep nodes of each thread.
+        static constexpr std::uint64_t DEADLINE_NODES = 256;
+        std::chrono::steady_clock::time_point mDeadline = std::chrono::steady_clock::time_point::max();
+
+        // Where solve() looks for and keeps its results. May be null.
+        std::shared_ptr<SolveCache> mCache;
+
+        // Guards mStats.
+        std::mutex mStatsMutex;
+        std::array<SplitStats, 65> mStats;
+
+        // The searches below are all fail-soft alpha-beta. `passed` is true if
+        // the previous ply was a pass.
+
+        // Nodes with more than SHALLOW_EMPTIES empties. Stores the best move
+        // in `best_move` if it isn't null.
+        int search(Worker& w, const BitBoard& b, int alpha, int beta, bool passed, int* best_move = nullptr);
+
+        // The root: null window searches (MTD(f)) that close in on the score
+        // within (alpha, beta), which cut off far more than full windows.
+        int search_root(const BitBoard& b, int alpha, int beta, int& best_move);
+
+        // Nodes with 5 to SHALLOW_EMPTIES empties.
+        int search_shallow(Worker& w, const BitBoard& b, int alpha, int beta, bool passed);
+
+        // The last few empties, which are passed in as square indices.
+        int last4(Worker& w, const BitBoard& b, int sq1, int sq2, int sq3, int sq4, int alpha, int beta, bool passed);
+
+        int last3(Worker& w, const BitBoard& b, int sq1, int sq2, int sq3, int alpha, int beta, bool passed);
+
+        int last2(Worker& w, const BitBoard& b, int sq1, int sq2, int alpha, int beta, bool passed);
+
+        // The exact score with one empty square left, found by counting the flips.
+        int last1(Worker& w, const BitBoard& b, int sq);
+
+        // Picks the routine for the number of empties of b.
+        int dispatch(Worker& w, const BitBoard& b, int alpha, int beta, bool passed);
+
+        // Sorts the moves of b fastest-first into `out`, with `first` in front
+        // if it is legal. `flips` holds the flips of each move by square.
+        // Returns the count.
+        static int order_moves(const BitBoard& b, std::uint64_t moves, const std::array<std::uint64_t, 64>& flips,
+            int first, std::array<int, 64>& out);
+
+        // Searches the moves list[first, cnt) of b with the help of the idle
+        // pool, after the eldest brother has failed to cut off. Updates
+        // alpha, best and best_move like the sequential loop.
+        void split(Worker& w, const BitBoard& b, const std::array<int, 64>& list, int first, int cnt,
+            int& alpha, int beta, int& best, int& best_move);
+
+        // Takes the next brother of sp, or returns -1 if there is none left
+        // or the split point was stopped.
+        static int take_move(SplitPoint& sp);
+
+        // Searches the brother list[idx] of sp and merges the result.
+        void search_move(Worker& w, SplitPoint& sp, int idx);
+
+        // A helper task: searches brothers of sp until there are none left.
+        void help(SplitPoint& sp);
+
+    public:
+        // The hash table takes about `table_mb` MB. With `threads` above 1,
+        // nodes with at least `split_empties` empties are searched in parallel
+        // (young brothers wait).
+        explicit EndgameSolver(std::size_t table_mb = 4, int threads = 1, int split_empties = 12);
+
+        // Uses `table`, which other solvers may be using at the same time.
+        explicit EndgameSolver(std::shared_ptr<TransTable> table, int threads = 1, int split_empties = 12);
+
+        // Solves b within the window (alpha, beta). As usual with alpha-beta,
+        // a score outside the window is only a bound: solve(b, -1, 1) is enough
+        // to tell a win from a draw from a loss.
+        Result solve(const BitBoard& b, int alpha = -64, int beta = 64);
+
+        // Makes solve() look positions with enough empties up in the cache
+        // before searching them, and store the results there.
+        inline void set_cache(std::shared_ptr<SolveCache> cache) noexcept {
+            mCache = std::move(cache);
+        }
+
+        // Makes solve() throw Aborted soon after *cancel becomes true.
+        inline void set_cancel(const std::atomic_bool* cancel) noexcept {
+            mCancel = cancel;
+        }
+
+        // Makes solve() throw Aborted soon after `deadline`, until another
+        // deadline is set. time_point::max() for none.
+        inline void set_deadline(std::chrono::steady_clock::time_point deadline) noexcept {
+            mDeadline = deadline;
+        }
+
+        inline std::uint64_t node_count() const noexcept {
+            return mMain.nodes + mHelperNodes.load(std::memory_order_relaxed);
+        }
+
+        // The statistics of the parallel search, indexed by empties.
+        std::array<SplitStats, 65> split_stats();
+    };
+
+    // The solver as an engine, for analysis and for playing out endgames.
+    // Positions with more than max_empties empties are beyond it: there it just
+    // plays the best move by move_order_score().
+    class SolverEngine : public Engine {
+    public:
+        struct Options {
+            // The most empties the engine will try to solve.
+            int max_empties = 24;
+            // The size of the solver's hash table in MB.
+            int tt_mb = 4;
+            // The number of search threads.
+            int threads = 1;
+            // With more than one thread, nodes with at least this many empties
+            // are searched in parallel.
+            int split_empties = 12;
+            // A file to cache the results in across runs (see SolveCache).
+            std::string cache;
+
+            // Reads the options, throwing ReversiError on unknown keys or bad values.
+            static Options from_description(const EngineDescription& desc);
+
+            // Writes the options that differ from the defaults into `desc`.
+            void to_description(EngineDescription& desc) const;
+        };
+
+    private:
+        const Options mOptions;
+
+        EndgameSolver mSolver;
+
+        virtual std::pair<int, int> do_make_move() override;
+
+    public:
+        SolverEngine();
+
+        explicit SolverEngine(Options opt);
+
+        virtual ~SolverEngine() noexcept;
+
+        virtual std::string get_name() override;
+    };
+}
+
+#endif
@@ -1,59 +1,205 @@
 #include "engi.h"
 #include <random>
 #include <iostream>
-#include "reversi_widgets.h"
+#include <algorithm>
+#include <charconv>
 #include "mctse.h"
+#include "alphabeta.h"
+#include "endgame.h"
 
 namespace Reversi {
-    Engine::Engine() : mThread(&Engine::mainloop, this) {}
+    EngineDescription EngineDescription::parse(const std::string& desc) {
+        EngineDescription ans;
+        const auto colon = desc.find(':');
+        ans.name = desc.substr(0, colon);
+        if (colon == std::string::npos)
+            return ans;
+        std::size_t pos = colon + 1;
+        while (pos <= desc.size()) {
+            const auto comma = std::min(desc.find(',', pos), desc.size());
+            const std::string item = desc.substr(pos, comma - pos);
+            const auto eq = item.find('=');
+            if (eq == std::string::npos || eq == 0)
+                throw ReversiError("Malformed engine option \"" + item + "\" in " + desc);
+            ans.options[item.substr(0, eq)] = item.substr(eq + 1);
+            pos = comma + 1;
+        }
+        return ans;
+    }
+
+    std::string EngineDescription::to_string() const {
+        std::string ans = name;
+        char sep = ':';
+        for (const auto& [key, value] : options) {
+            ans += sep;
+            ans += key;
+            ans += '=';
+            ans += value;
+            sep = ',';
+        }
+        return ans;
+    }
+
+    void EngineDescription::check_keys(std::initializer_list<const char*> known) const {
+        for (const auto& [key, value] : options) {
+            if (std::find(known.begin(), known.end(), key) == known.end())
+                throw ReversiError("Unknown option \"" + key + "\" for engine " + name);
+        }
+    }
+
+    bool EngineDescription::get_bool(const std::string& key, bool def) const {
+        const auto it = options.find(key);
+        if (it == options.end())
+            return def;
+        if (it->second == "1" || it->second == "true")
+            return true;
+        if (it->second == "0" || it->second == "false")
+            return false;
+        throw ReversiError("Option " + key + " expects a boolean, got " + it->second);
+    }
+
+    long long EngineDescription::get_int(const std::string& key, long long def) const {
+        const auto it = options.find(key);
+        if (it == options.end())
+            return def;
+        try {
+            std::size_t used = 0;
+            const long long ans = std::stoll(it->second, &used);
+            if (used == it->second.size())
+                return ans;
+        } catch (const std::logic_error&) {}
+        throw ReversiError("Option " + key + " expects an integer, got " + it->second);
+    }
+
+    double EngineDescription::get_double(const std::string& key, double def) const {
+        const auto it = options.find(key);
+        if (it == options.end())
+            return def;
+        try {
+            std::size_t used = 0;
+            const double ans = std::stod(it->second, &used);
+            if (used == it->second.size())
+                return ans;
+        } catch (const std::logic_error&) {}
+        throw ReversiError("Option " + key + " expects a number, got " + it->second);
+    }
+
+    std::string EngineDescription::get_string(const std::string& key, const std::string& def) const {
+        const auto it = options.find(key);
+        return it == options.end() ? def : it->second;
+    }
+
+    void EngineDescription::set_bool(const std::string& key, bool value) {
+        options[key] = std::string(value ? "1" : "0");
+    }
+
+    void EngineDescription::set_int(const std::string& key, long long value) {
+        options[key] = std::to_string(value);
+    }
+
+    void EngineDescription::set_double(const std::string& key, double value) {
+        // The shortest text that reads back as the same double: "1.5", not
+        // std::to_string's "1.500000", and "1234567", not ostream's "1.23457e+06".
+        char buf[32];
+        const auto res = std::to_chars(buf, buf + sizeof buf, value);
+        options[key] = std::string(buf, res.ptr);
+    }
+
+    void EngineDescription::set_string(const std::string& key, const std::string& value) {
+        // parse() splits the name at the first ':' and each option at the
+        // first '=', so only a ',' would be misread.
+        if (value.find(',') != std::string::npos)
+            throw ReversiError("Option values can't contain ',': " + value);
+        options[key] = value;
+    }
+
+    Engine::Engine() = default;
 
     Engine::~Engine() noexcept {
         std::cerr << "~Engine()\n";
-        // The thread might be busying computing or waiting for GUI input
-        // in do_make_move. First cancel that.
-        mCancel.store(true, std::memory_order_release);
-        // First we notify the thread to exit
+        stop_computation();
+        std::cerr << "Engine tasks done\n";
+    }
+
+    void Engine::stop_computation() {
         {
             std::lock_guard lk(mMutex);
-            mSemaphore = Sema::Exit;
+            mExiting = true;
         }
-        mCondVar.notify_one();
-        mThread.join();
-        std::cerr << "Engine thread joined\n";
+        // The computation might be busy or waiting for GUI input in
+        // do_make_move. First cancel that.
+        request_cancel();
+        // A computation that hasn't started yet sees mExiting and doesn't.
+        // One waiting is woken by the cancellation and goes on as a task.
+        mTasks.wait();
+        lock_idle();
+        mTasks.wait();
+    }
+
+    std::unique_lock<std::mutex> Engine::lock_idle() {
+        std::unique_lock lk(mMutex);
+        mIdle.wait(lk, [this] { return !mBusy; });
+        return lk;
     }
 
     void Engine::mainloop() {
-        while (true) {
-            std::unique_lock lk(mMutex);
-            mCondVar.wait(lk, [this]{ return mSemaphore != Sema::None; });
-            // Now we have the mutex locked, and semaphore != none
-            if (mSemaphore == Sema::Exit)
-                break;
-            // semaphore == Sema::compute
-            try {
-                auto result = do_make_move();
-                if (!mCancel.load(std::memory_order_acquire)) {
-                    // important: Thread safety
-                    // Case 1: exception thrown
-                    //   All further calls will continue to throw the exception,
-                    //   so no pointer access will be made, so no dangling pointers.
-                    // Case 2: exception not thrown
-                    //   Then we have a shared pointer that prevents the manager from being destroyed.
-                    //   This means it's safe to access the manager.
-                    std::shared_ptr<GameMan>(mGameMan)->enter_move(result, mGameID);
-                }
-            } catch (OperationCanceled) {
-            } catch (const std::bad_weak_ptr&) {
-                // The related object has already been destructed.
+        {
+            std::lock_guard lk(mMutex);
+            mScore.reset();
+            if (mExiting) {
+                mBusy = false;
+                mIdle.notify_all();
+                return;
             }
-            // Reset the flags
-            mCancel.store(false, std::memory_order_release);
-            mSemaphore = Sema::None;
         }
+        std::optional<MoveTask> task;
+        try {
+            task.emplace(make_move_async());
+        } catch (...) {
+            finish_move(this, { 0, 0 }, std::current_exception());
+            return;
+        }
+        std::move(*task).start(mTasks, mCancellation, &Engine::finish_move, this);
+    }
+
+    void Engine::finish_move(void* engine, std::pair<int, int> move, std::exception_ptr error) {
+        Engine& self = *static_cast<Engine*>(engine);
+        try {
+            if (error)
+                std::rethrow_exception(error);
+            if (!self.mCancel.load(std::memory_order_acquire)) {
+                // important: Thread safety
+                // Case 1: exception thrown
+                //   All further calls will continue to throw the exception,
+                //   so no pointer access will be made, so no dangling pointers.
+                // Case 2: exception not thrown
+                //   Then we have a shared pointer that prevents the manager from being destroyed.
+                //   This means it's safe to access the manager.
+                std::shared_ptr<GameMan>(self.mGameMan)->enter_move(move, self.mGameID);
+            }
+        } catch (OperationCanceled) {
+        } catch (const std::bad_weak_ptr&) {
+            // The related object has already been destructed.
+        }
+        // Reset the flags
+        std::lock_guard lk(self.mMutex);
+        self.mCancel.store(false, std::memory_order_release);
+        self.mCancellation.reset();
+        self.mBusy = false;
+        // Under the lock, since the destructor may go on as soon as it sees this.
+        self.mIdle.notify_all();
+    }
+
+    std::pair<int, int> Engine::do_make_move() {
+        return make_move_async().run(mCancellation);
+    }
+
+    MoveTask Engine::make_move_async() {
+        co_return do_make_move();
     }
 
     void Engine::enter_move(std::pair<int, int> mov) {
-        std::lock_guard lk(mMutex);
+        auto lk = lock_idle();
         if (mov.first)
             mBoard.place(mov.first, mov.second);
         else
@@ -61,26 +207,48 @@ namespace Reversi {
     }
 
     void Engine::change_position(Board new_pos) {
-        std::lock_guard lk(mMutex);
+        auto lk = lock_idle();
         mBoard = std::move(new_pos);
     }
 
     void Engine::request_compute(unsigned char gid) {
         {
-            std::lock_guard lk(mMutex);
+            auto lk = lock_idle();
+            if (mExiting)
+                return;
             mCancel.store(false, std::memory_order_release);
+            mCancellation.reset();
             mGameID = gid;
-            mSemaphore = Sema::Compute;
+            mBusy = true;
         }
-        mCondVar.notify_one();
+        mTasks.run([this] { mainloop(); });
     }
 
     void Engine::request_cancel() {
         mCancel.store(true, std::memory_order_release);
+        mCancellation.cancel();
+    }
+
+    std::pair<int, int> Engine::search(const Board& b) {
+        auto lk = lock_idle();
+        mBoard = b;
+        mScore.reset();
+        try {
+            return do_make_move();
+        } catch (OperationCanceled) {
+            mCancel.store(false, std::memory_order_release);
+            mCancellation.reset();
+            throw ReversiError("Search canceled");
+        }
+    }
+
+    std::optional<int> Engine::last_score() {
+        auto lk = lock_idle();
+        return mScore;
     }
 
     void Engine::link_game_man(std::weak_ptr<GameMan> gm) {
-        std::lock_guard lk(mMutex);
+        auto lk = lock_idle();
         mGameMan = gm;
     }
 
@@ -90,26 +258,36 @@ namespace Reversi {
         mRandomGen = std::bind(dist, mt);
     }
 
-    std::pair<int, int> RandomChoice::do_make_move() {
-        std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    RandomChoice::~RandomChoice() noexcept {
+        stop_computation();
+    }
+
+    MoveTask RandomChoice::make_move_async() {
+        if (!co_await sleep_for(std::chrono::milliseconds(400)))
+            throw OperationCanceled();
         // The placable squares
         auto plc = mBoard.get_placable();
-        return plc.size() ? plc.at(mRandomGen() % plc.size()) : std::pair(0, 0);
+        co_return plc.size() ? plc.at(mRandomGen() % plc.size()) : std::pair(0, 0);
     }
     
     std::string RandomChoice::get_name() {
         return "RandomChoice";
     }
 
-    std::unique_ptr<Engine> make_engine_from_description(
-        const std::string& name, MainWindow& mw
-    ) {
-        if (name == "RandomChoice")
+    std::unique_ptr<Engine> make_engine_from_description(const std::string& name) {
+        const auto desc = EngineDescription::parse(name);
+        if (desc.name == "RandomChoice") {
+            desc.check_keys({});
             return std::make_unique<RandomChoice>();
-        if (name == "UserInput")
-            return std::make_unique<UserInputEngine>(mw.mBoardWidget, mw.mSkipButton);
-        if (name == "MCTSe")
-            return std::make_unique<MCTS>();
+        }
+        if (desc.name == "UserInput")
+            throw ReversiError("UserInput needs the GUI");
+        if (desc.name == "MCTSe")
+            return std::make_unique<MCTS>(MCTS::Options::from_description(desc));
+        if (desc.name == "AlphaBeta")
+            return std::make_unique<AlphaBeta>(AlphaBeta::Options::from_description(desc));
+        if (desc.name == "Solver")
+            return std::make_unique<SolverEngine>(SolverEngine::Options::from_description(desc));
         throw ReversiError("Unrecognized engine type: " + name);
     }
 }
\ No newline at end of file
@@ -2,24 +2,61 @@
 #ifndef REVERSI_ENGI_H
 #define REVERSI_ENGI_H
 #include "game.h"
+#include "coro.h"
+#include "thread_pool.h"
 #include <chrono>
 #include <functional>
 #include <thread>
 #include <future>
 #include <atomic>
 #include <condition_variable>
+#include <map>
+#include <optional>
+#include <string>
 
 namespace Reversi {
+    // The textual description of an engine, as stored in saved games and passed
+    // to make_engine_from_description(). The format is "Name" or
+    // "Name:key=value,key=value", where the options tune the engine.
+    struct EngineDescription {
+        // The type name of the engine, as returned by Engine::get_name() sans options.
+        std::string name;
+        // The options, sorted by key so that to_string() is canonical.
+        std::map<std::string, std::string> options;
+
+        // Parses the description. Throws ReversiError if it is malformed.
+        static EngineDescription parse(const std::string& desc);
+
+        // Formats the description back into the "Name:key=value,..." form.
+        std::string to_string() const;
+
+        // Throws ReversiError if an option key is not in `known`.
+        void check_keys(std::initializer_list<const char*> known) const;
+
+        // Typed getters. They return `def` if the key is absent, and throw
+        // ReversiError if the value can't be parsed.
+        bool get_bool(const std::string& key, bool def) const;
+
+        long long get_int(const std::string& key, long long def) const;
+
+        double get_double(const std::string& key, double def) const;
+
+        std::string get_string(const std::string& key, const std::string& def) const;
+
+        // Typed setters, formatting the values so that the getters read them back.
+        void set_bool(const std::string& key, bool value);
+
+        void set_int(const std::string& key, long long value);
+
+        void set_double(const std::string& key, double value);
+
+        void set_string(const std::string& key, const std::string& value);
+    };
+
     // An interface for the async engine.
     class Engine {
-        // The semaphore that is given by the main thread.
-        // Exit is only set by the dtor of the class.
-        // Compute means the manager wants to the engine to compute the next move.
-        // By design the manager thread should be asleep when computation is being
-        // carried out.
-        enum class Sema {
-            None, Exit, Compute
-        } mSemaphore = Sema::None;
+        // Set by stop_computation(), so that no computation starts after.
+        bool mExiting = false;
         // The game id passed in by `request_computation()`.
         unsigned char mGameID = 0;
         // The pointer to game manager passed in by request_computation.
@@ -27,38 +64,70 @@ namespace Reversi {
     protected:
         // The board, accessible by derived classes.
         Board mBoard;
-        // Atomic bool that signals a cancellation.
-        // We can't use the mutex for sync because the mutex is held by the class
-        // thread when computation is being done.
+        // Atomic bool that signals a cancellation, for computations that
+        // check it as they go.
         std::atomic_bool mCancel = false;
+        // Wakes a computation waiting in make_move_async() when it is canceled.
+        Cancellation mCancellation;
 
         // Interesting exception that can be used to cancel the do_make_move().
         struct OperationCanceled {};
+
+        // Cancels the computation and waits for it to end, after which no
+        // more start. Derived classes whose computation uses their own
+        // members call this first in their destructors, since those members
+        // are gone by the time ~Engine() runs.
+        void stop_computation();
+
+        // (In do_make_move()) Reports the value of the position
+        // in discs of final disc difference for the player to move.
+        inline void report_score(int discs) noexcept {
+            mScore = discs;
+        }
     private:
-        // The mutex guards mSemaphore and mBoard, mGameID and mGameMan
+        // The value reported by the last computation, guarded by mMutex.
+        std::optional<int> mScore;
+
+        // The mutex guards mExiting, mBusy and mBoard, mGameID and mGameMan.
         std::mutex mMutex;
-        // This condition variable works with mMutex.
-        // The thread that runs mainloop() waits on this cond var for notification
-        // from the manager's thread.
-        std::condition_variable mCondVar;
-        // The thread handle to the main thread (as opposed to worker threads
-        // derived classes may spawn).
-        std::thread mThread;
-
-        // The mainloop of the thread. Waits on the condition var to handle cmds.
-        // I don't think there's any way to override this correctly.
+        // Whether a computation owns the board, from request_compute() until
+        // it is done. It doesn't hold mMutex meanwhile, since a coroutine
+        // may be waiting on another thread, so the others wait on mIdle.
+        bool mBusy = false;
+        std::condition_variable mIdle;
+        // The engine has no thread of its own: its computations run as tasks
+        // on the shared thread pool, like the parallel searches derived
+        // classes may start.
+        TaskGroup mTasks;
+
+        // Locks mMutex once no computation owns the board.
+        std::unique_lock<std::mutex> lock_idle();
+
+        // Starts the computation requested. Runs as a task of mTasks.
         void mainloop();
 
+        // Called when the computation is done, with its move or exception.
+        static void finish_move(void* engine, std::pair<int, int> move, std::exception_ptr error);
+
         // important: Customization point
-        // Computes the move.
-        // Ran by the thread owned by this class. This function can safely access
-        // the members protected by the class's mutex.
+        // Computes the move. Derived classes override this or
+        // make_move_async(), each of which by default runs the other.
+        // Ran by the engine's task on the pool, or by search(). This function
+        // can safely access the members protected by the class's mutex.
         // The function should be aware that a cancellation request may come at any
         // time and should respect that by throwing OperationCanceled.
-        virtual std::pair<int, int> do_make_move() = 0;
+        // By default it runs make_move_async(), blocking while it waits.
+        virtual std::pair<int, int> do_make_move();
+
+        // important: Customization point
+        // Computes the move as a coroutine, for engines that mostly wait, on
+        // clicks or timers: a coroutine that waits holds no thread, so any
+        // number of such engines can be waiting at once. The awaits give
+        // nothing when the computation is canceled, and it should then throw
+        // OperationCanceled. By default it runs do_make_move().
+        virtual MoveTask make_move_async();
 
     public:
-        // Constructs the engine, launching the main thread.
         Engine();
 
         // Prohibit copying and moving.
@@ -70,8 +139,8 @@ namespace Reversi {
 
         Engine& operator= (Engine&&) = delete;
 
-        // Virtual destructor. Joins the thread handle, so it's very important
-        // to set this as a virtual function.
+        // Virtual destructor. Cancels and waits for the computation, so it's
+        // very important to set this as a virtual function.
         virtual ~Engine() noexcept;
 
         // Enter a move. Since the engine should be wrapped inside
@@ -92,6 +161,21 @@ namespace Reversi {
         // This does not block.
         void request_cancel();
 
+        // (Any thread) Computes a move for position b on the calling thread and
+        // returns it, bypassing the game manager. The engine's position is set
+        // to b. Throws ReversiError if the computation is canceled.
+        // This is for benchmarks and tools that drive engines directly.
+        std::pair<int, int> search(const Board& b);
+
+        // (Any thread) The value the last computation reported through
+        // report_score(), if any. Engines that can't estimate the final disc
+        // difference never report one.
+        std::optional<int> last_score();
+
+        // (Any thread) Writes what the engine keeps across runs to disk, if
+        // anything. Throws ReversiError if it can't.
+        virtual void save_state() {}
+
         // (Game man) links to a game manager.
         void link_game_man(std::weak_ptr<GameMan> gm);
 
@@ -105,25 +189,25 @@ namespace Reversi {
     class RandomChoice : public Engine {
         std::function<std::size_t()> mRandomGen;
 
-        // Overrides the customization point
-        virtual std::pair<int, int> do_make_move() override;
+        // Overrides the customization point. Waits a bit before moving,
+        // without holding a thread.
+        virtual MoveTask make_move_async() override;
     public:
         // Default constructor.
         RandomChoice();
 
-        virtual ~RandomChoice() noexcept = default;
+        virtual ~RandomChoice() noexcept;
 
         virtual std::string get_name() override;
     };
 
-    // Fwd for the MainWindow class.
-    struct MainWindow;
-
     // Constructs a new std::unique_ptr<Engine> that points
     // to an object of the correct derived type of Engine.
-    // Throws ReversiError if the engine's name isn't recognized.
-    std::unique_ptr<Engine> make_engine_from_description(
-        const std::string& name, MainWindow& mw);
+    // The name is parsed as an EngineDescription.
+    // Throws ReversiError if the engine's name isn't recognized or the options
+    // are invalid for that engine. Engines that take their moves from the GUI
+    // are rejected too; the GUI has its own overload for them.
+    std::unique_ptr<Engine> make_engine_from_description(const std::string& name);
 }
 
 #endif
\ No newline at end of file
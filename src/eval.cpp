@@ -0,0 +1,80 @@
+#include "eval.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Reversi {
+    namespace {
+        constexpr std::uint64_t CORNERS = 0x8100000000000081;
+
+        // The diagonal neighbours of the corners (X-squares) whose corner is
+        // still empty. Taking one of them usually gives the corner away.
+        constexpr std::uint64_t open_x_squares(std::uint64_t empty) noexcept {
+            std::uint64_t ans = 0;
+            if (empty & (std::uint64_t(1) << 0))
+                ans |= std::uint64_t(1) << 9;
+            if (empty & (std::uint64_t(1) << 7))
+                ans |= std::uint64_t(1) << 14;
+            if (empty & (std::uint64_t(1) << 56))
+                ans |= std::uint64_t(1) << 49;
+            if (empty & (std::uint64_t(1) << 63))
+                ans |= std::uint64_t(1) << 54;
+            return ans;
+        }
+
+        // The classic positional square values. The board is symmetric, so the
+        // numbering of the squares doesn't matter here.
+        constexpr int SQUARE_VALUE[64] = {
+            100, -20,  10,   5,   5,  10, -20, 100,
+            -20, -50,  -2,  -2,  -2,  -2, -50, -20,
+             10,  -2,  -1,  -1,  -1,  -1,  -2,  10,
+              5,  -2,  -1,  -1,  -1,  -1,  -2,   5,
+              5,  -2,  -1,  -1,  -1,  -1,  -2,   5,
+             10,  -2,  -1,  -1,  -1,  -1,  -2,  10,
+            -20, -50,  -2,  -2,  -2,  -2, -50, -20,
+            100, -20,  10,   5,   5,  10, -20, 100
+        };
+
+        // Weights, hand-tuned to keep the scores about as large as disc differences.
+        constexpr int MOBILITY_WEIGHT = 2, CORNER_WEIGHT = 8, X_SQUARE_WEIGHT = 4, PARITY_WEIGHT = 1;
+
+        // How much a move that leaves the opponent one option fewer is worth in
+        // square values.
+        constexpr int ORDER_MOBILITY_WEIGHT = 5;
+
+        // The scale of the logistic curve of win_probability(). A lead of 10
+        // "discs" is worth about 73%.
+        constexpr double WIN_SCALE = 10.0;
+    }
+
+    int quick_eval(const BitBoard& b) noexcept {
+        return quick_eval(b, b.moves());
+    }
+
+    int quick_eval(const BitBoard& b, std::uint64_t moves) noexcept {
+        const std::uint64_t empty = ~(b.own | b.opp);
+        const std::uint64_t xsq = open_x_squares(empty);
+        const int mobility = std::popcount(moves) - std::popcount(b.pass().moves());
+        const int corners = std::popcount(b.own & CORNERS) - std::popcount(b.opp & CORNERS);
+        const int x_squares = std::popcount(b.own & xsq) - std::popcount(b.opp & xsq);
+        // With an odd number of empties, the player to move gets the last move.
+        const int parity = (std::popcount(empty) & 1) ? 1 : -1;
+        return MOBILITY_WEIGHT * mobility + CORNER_WEIGHT * corners
+            - X_SQUARE_WEIGHT * x_squares + PARITY_WEIGHT * parity;
+    }
+
+    int move_order_score(const BitBoard& b, int sq) noexcept {
+        return SQUARE_VALUE[sq] - ORDER_MOBILITY_WEIGHT * std::popcount(b.play(sq).moves());
+    }
+
+    double win_probability(int score) noexcept {
+        return 1.0 / (1.0 + std::exp(-score / WIN_SCALE));
+    }
+
+    int probability_score(double p) noexcept {
+        if (!(p > 0))
+            return -64;
+        if (!(p < 1))
+            return 64;
+        return std::clamp(int(std::lround(WIN_SCALE * std::log(p / (1 - p)))), -64, 64);
+    }
+}
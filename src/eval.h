@@ -0,0 +1,29 @@
+// Static evaluation of positions
+#ifndef REVERSI_EVAL_H
+#define REVERSI_EVAL_H
+#include "bitboard.h"
+
+namespace Reversi {
+    // A cheap hand-tuned evaluation from mobility, corners, the squares next to
+    // empty corners and parity. The score is for the player to move, in roughly
+    // the units of the final disc difference.
+    int quick_eval(const BitBoard& b) noexcept;
+
+    // The same, with the moves of b already known.
+    int quick_eval(const BitBoard& b, std::uint64_t moves) noexcept;
+
+    // A fast move ordering heuristic: the positional value of square sq (corners
+    // good, X- and C-squares bad) minus the opponent's mobility after the move.
+    // sq must be a legal move of b. Higher is better.
+    int move_order_score(const BitBoard& b, int sq) noexcept;
+
+    // Maps an evaluation score to the estimated probability that the player
+    // to move wins.
+    double win_probability(int score) noexcept;
+
+    // The inverse of win_probability(): the score that a probability of
+    // winning stands for, within [-64, 64].
+    int probability_score(double p) noexcept;
+}
+
+#endif
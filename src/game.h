@@ -1,13 +1,18 @@
 #ifndef REVERSI_GAME_H
 #define REVERSI_GAME_H
 #include <array>
+#include <atomic>
 #include <mutex>
+#include <condition_variable>
 #include <stdexcept>
+#include <string>
 #include <vector>
 #include <thread>
 #include <memory>
-#include <queue>
+#include <optional>
+#include <variant>
 #include <nlohmann/json.hpp>
+#include "mpsc_queue.h"
 
 namespace Reversi {
     // Friendly enum representation of the status of a square
@@ -100,7 +105,90 @@ namespace Reversi {
 
     // interface fwd
     class Engine;
-    struct MainWindow;
+
+    // What a game manager tells about its game, from the manager's thread:
+    // the GUI, or a tool that plays without one.
+    class GameObserver {
+    public:
+        virtual ~GameObserver() = default;
+
+        // The board has changed. The last move is given to mark it, (0, 0)
+        // for a skip or a new position.
+        virtual void update_board(const Board& b, std::pair<int, int> last_move) = 0;
+
+        // The game has ended.
+        virtual void announce_game_result(MatchResult res) = 0;
+
+        // The engine of `side`, named `engine` as by Engine::get_name(), has
+        // been asked for the next move.
+        virtual void next_to_move(Player side, const std::string& engine);
+
+        // Makes the engines of a game loaded by GameMan::from_json(). By
+        // default only engines that run without the GUI can be made.
+        virtual std::unique_ptr<Engine> make_engine(const std::string& description);
+    };
+
+    // The commands the game manager's thread carries out, in the order they
+    // were sent.
+    namespace Command {
+        // A move by an engine in the game `game_id`. Moves of other games are
+        // refused.
+        struct Place {
+            int x, y;
+            unsigned char game_id;
+        };
+
+        // A skip by an engine in the game `game_id`.
+        struct Skip {
+            unsigned char game_id;
+        };
+
+        // Starts a new game with the engines loaded.
+        struct Start {};
+
+        // Cancels the engines' computations and holds the game where it is.
+        struct Pause {};
+
+        struct Resume {};
+
+        // Takes back the last two moves.
+        struct TakeBack {};
+
+        // Replaces the game with one read from a file, which has been checked.
+        struct Load {
+            std::unique_ptr<Engine> black, white;
+            Board board;
+            std::vector<std::pair<int, int>> annotation;
+        };
+
+        // Ends the manager's thread.
+        struct Exit {};
+    }
+
+    // Load is the big one, so it is kept out of the queue's slots.
+    using GameCommand = std::variant<Command::Place, Command::Skip, Command::Start, Command::Pause,
+        Command::Resume, Command::TakeBack, std::unique_ptr<Command::Load>, Command::Exit>;
+
+    // When a game manager ends a game before the engines have played it out,
+    // which saves time in engine matches. Both ways are off by default.
+    struct Adjudication {
+        // The most empties solve_empties may be. Each two more empties make
+        // a solve several times slower: 20 take a second or two, 24 up to a
+        // minute.
+        static constexpr int MAX_SOLVE_EMPTIES = 20;
+        // Once a move leaves at most this many empties, the position is
+        // solved and the game ends with the proven result. 0 turns it off.
+        int solve_empties = 0;
+        // The game ends when one engine has reported a score of at least this
+        // many discs for itself, and the other at most minus this, for their
+        // last `resign_moves` moves each. The engines' reported scores are disc
+        // differences, so that's the unit. The result is the winner's last
+        // score. 0 turns it off.
+        int resign_score = 0;
+        int resign_moves = 3;
+    };
+
+    class EndgameSolver;
 
     // Manager of a game
     class GameMan : public std::enable_shared_from_this<GameMan> {
@@ -121,51 +209,72 @@ namespace Reversi {
         // true if a game is in progress. This is used by the mainloop to determine
         // whether to get more moves from the engine.
         bool mGameInProgress = false;
-        // The main GUI window. We have to take the responsibility to redraw the
-        // GUI because the GUI thread is blocked by exec() waiting for events.
-        MainWindow& mMainWindow;
-        // The game manager thread.
-        std::thread mThread;
-        // Commands are sent here. The least significant 8 bits are the command.
-        // Available:
-        //   0 -- Exit the thread
-        //   1 -- Cancel engine computation, for example, to start a new game, or
-        //        to load a new position. (unimplemented!)
-        //   2 -- Starts asking the engines to compute the move and push the game
-        //        forward, automatically drawing the GUI (unimplemented!)
-        //   3 -- (sent by engines) x = 9~16 bits, y = 17~24bits, places at (x, y)
-        //        game id = 25~32 bits
-        std::queue<unsigned int> mSemaQueue;
-        // Mutex that protects mSemaQueue.
-        std::mutex mQueueMutex;
+        // When games are ended early, and the result of the game if it was.
+        Adjudication mAdjudication;
+        std::optional<int> mAdjudicated;
+        // For each player, how many of their moves in a row they have
+        // reported a score beyond the resign score, winning or losing, and
+        // their last score.
+        std::array<int, 2> mWinning{}, mLosing{}, mLastScore{};
+        // Solves the positions to adjudicate, made at the first one. Kept for
+        // the later games, along with its hash table.
+        std::unique_ptr<EndgameSolver> mSolver;
+        // Stops a solve, so that the commands behind it don't wait for it.
+        // Raised before sending the commands that pause or leave the game,
+        // and lowered when mThread handles them.
+        std::atomic_bool mSolveCancel = false;
+        // Told about the game. For the GUI we have to take the responsibility
+        // to redraw it, because the GUI thread is blocked by exec() waiting
+        // for events.
+        GameObserver& mObserver;
+        // Commands are sent here, by the engines and the GUI. The engines
+        // never wait on a lock to hand in their moves.
+        MpscQueue<GameCommand> mCommands;
         // Mutex that protects the reversi data members.
         std::mutex mDataMutex;
-        // Condition variable to notify the mainloop thread when there are new
-        // entries in the queue to process.
-        std::condition_variable mCondVar;
+        // The game manager thread. Declared last, since it uses the rest.
+        std::thread mThread;
 
         // The mainloop of mThread.
         void mainloop();
 
-        // Helper function that deals with "place" command in the mainloop.
-        // This function tries to obtain a lock on the data mutex.
-        void handle_place(unsigned int cmd);
+        // The handlers of the commands, run by mThread. They try to obtain a
+        // lock on the data mutex.
+        // (0, 0) means a skip.
+        void handle_place(int x, int y, unsigned char game_id);
+
+        void handle_start();
+
+        void handle_pause();
+
+        void handle_resume();
+
+        void handle_take_back();
+
+        void handle_load(Command::Load& cmd);
+
+        // (mThread, after a move) Ends the game if it can be adjudicated, in
+        // which case the lock is released, the result announced and true
+        // returned.
+        bool adjudicate(std::unique_lock<std::mutex>& lk);
+
+        // Forgets the adjudication of the last game.
+        void reset_adjudication() noexcept;
 
         struct PrivateTag {};
 
-        // Parses the annotation passed in and updates the annotation and board.
-        // This doesn't automatically start the new game. Also doesn't update the
-        // engines according to the JSON.
+        // Parses the annotation passed in into the board and annotation of
+        // `cmd`.
         //
-        // If the annotation contains errors, they are reported via ReversiError. The
-        // mBoard and mAnnotation of *this aren't changed.
-        void read_annotation(const nlohmann::json& js);
+        // If the annotation contains errors, they are reported via ReversiError.
+        static void read_annotation(const nlohmann::json& js, Command::Load& cmd);
 
     public:
-        GameMan(MainWindow& mw, PrivateTag);
+        GameMan(GameObserver& obs, PrivateTag);
 
-        // Constructs a new game manager linked to the main window `mw`.
-        static std::shared_ptr<GameMan> create(MainWindow& mw);
+        // Constructs a new game manager that reports to `obs`, which must
+        // outlive it.
+        static std::shared_ptr<GameMan> create(GameObserver& obs);
 
         // Disallow copying and moving
         GameMan(const GameMan&) = delete;
@@ -192,10 +301,12 @@ namespace Reversi {
         // (GUI thread)
         // Starts a new game in the mainloop.
         // If any side doesn't have an engine loaded, throws Reversi error.
+        // Like the other GUI calls below, this only sends a command, which
+        // the mainloop carries out after the ones sent before.
         void start_new();
 
         // (Engine thread)
-        // Enters the next move.
+        // Enters the next move. This never waits on a lock.
         void enter_move(std::pair<int, int> mov, unsigned char game_id);
 
         // (GUI thread)
@@ -214,14 +325,23 @@ namespace Reversi {
         // Checks if the game needs saving. (GUI thread)
         bool is_dirty();
 
+        // Sets when games are adjudicated, from the next move on.
+        void set_adjudication(const Adjudication& adj);
+
+        // Black's discs minus White's if the game was adjudicated.
+        std::optional<int> adjudicated();
+
+        // The moves played so far, (0, 0) for a skip.
+        std::vector<std::pair<int, int>> annotation();
+
         // (GUI) Loads the annotation and info about the two sides into a JSON.
         nlohmann::json to_json();
 
         // (GUI) Loads the annotation and engines from the JSON, and starts a
         // new game from that.
         //
-        // If errors are detected, reports them by throwing ReversiError. The
-        // original data members are not changed.
+        // If errors are detected, reports them by throwing ReversiError right
+        // away. The original data members are not changed.
         void from_json(const nlohmann::json& js);
     };
 }
@@ -1,35 +1,41 @@
 #include "game.h"
 #include "engi.h"
-#include "reversi_widgets.h"
+#include "endgame.h"
 #include <iostream>
 
 namespace Reversi {
+    void GameObserver::next_to_move(Player, const std::string&) {}
+
+    std::unique_ptr<Engine> GameObserver::make_engine(const std::string& description) {
+        return make_engine_from_description(description);
+    }
+
     void GameMan::mainloop() {
         while (true) {
-            std::unique_lock lk(mQueueMutex);
-            // Because we just acquired the mutex, the call to empty() is thread safe.
-            if (mSemaQueue.empty())
-                mCondVar.wait(lk, [this]{ return !mSemaQueue.empty(); });
-            // Now we have the mutex.
-            auto cmd = mSemaQueue.front();
-            mSemaQueue.pop();
-            // Accept input while we are processing
-            lk.unlock();
-            switch (cmd & 0xFF) {
-                case 0: // Exit
-                    return;
-                case 3:
-                    handle_place(cmd);
-                    break;
-            }
+            // Spins a little, then sleeps until a command comes.
+            GameCommand cmd = mCommands.pop();
+            if (std::holds_alternative<Command::Exit>(cmd))
+                return;
+            if (const auto* place = std::get_if<Command::Place>(&cmd))
+                handle_place(place->x, place->y, place->game_id);
+            else if (const auto* skip = std::get_if<Command::Skip>(&cmd))
+                handle_place(0, 0, skip->game_id);
+            else if (std::holds_alternative<Command::Start>(cmd))
+                handle_start();
+            else if (std::holds_alternative<Command::Pause>(cmd))
+                handle_pause();
+            else if (std::holds_alternative<Command::Resume>(cmd))
+                handle_resume();
+            else if (std::holds_alternative<Command::TakeBack>(cmd))
+                handle_take_back();
+            else if (auto* load = std::get_if<std::unique_ptr<Command::Load>>(&cmd))
+                handle_load(**load);
         }
     }
 
-    void GameMan::handle_place(unsigned cmd) {
+    void GameMan::handle_place(int x, int y, unsigned char id) {
         std::unique_lock lk(mDataMutex);
-        const int x = (cmd >> 8) & 0xFF, y = (cmd >> 16) & 0xFF,
-            id = cmd >> 24;
-        if (id != (int)mGameID || !mGameInProgress)
+        if (id != mGameID || !mGameInProgress)
             return;
         mDirty = true;
         mAnnotation.emplace_back(x, y);
@@ -50,39 +56,98 @@ namespace Reversi {
                 // The nana library contains an internal lock and we can't change
                 // a reference, so let's just drop this lock
                 lk.unlock();
-                mMainWindow.announce_game_result(mBoard.count());
+                mObserver.announce_game_result(mBoard.count());
                 return;
             }
             mBoard.skip();
             mPrevSkip = true;
         }
-        // Since manager is contained in the MainWindow structure,
-        // it's safe to call the GUI process.
+        // The observer outlives the manager, so it's safe to call it.
         // Same as above
         lk.unlock();
-        mMainWindow.update_board(mBoard, { x, y });
+        mObserver.update_board(mBoard, { x, y });
         lk.lock();
-        if (!mGameInProgress)
+        if (!mGameInProgress || adjudicate(lk))
             return;
         // The game is still in progress, we can proceed to the next move.
-        if (mBoard.whos_next() == Player::White) {
-            mWhiteSide->request_compute(mGameID);
-            const UserInputEngine* uie = dynamic_cast<UserInputEngine*>(
-                mWhiteSide.get()
-            );
-            lk.unlock();
-            mMainWindow.input_button_activity(uie);
-        } else {
-            mBlackSide->request_compute(mGameID);
-            const UserInputEngine* uie = dynamic_cast<UserInputEngine*>(
-                mBlackSide.get()
-            );
-            lk.unlock();
-            mMainWindow.input_button_activity(uie);
+        const Player side = mBoard.whos_next();
+        Engine& next = *(side == Player::White ? mWhiteSide : mBlackSide);
+        next.request_compute(mGameID);
+        // The engine may be replaced once the lock is dropped.
+        const std::string name = next.get_name();
+        lk.unlock();
+        mObserver.next_to_move(side, name);
+    }
+
+    bool GameMan::adjudicate(std::unique_lock<std::mutex>& lk) {
+        // The side that has just moved.
+        const int mover = mBoard.whos_next() == Player::Black ? 1 : 0;
+        std::optional<int> result;
+        if (mAdjudication.resign_score > 0) {
+            // Skips usually come without a score, and leave the counts be.
+            if (const auto score = (mover ? mWhiteSide : mBlackSide)->last_score()) {
+                const int bar = mAdjudication.resign_score;
+                mWinning[mover] = *score >= bar ? mWinning[mover] + 1 : 0;
+                mLosing[mover] = *score <= -bar ? mLosing[mover] + 1 : 0;
+                mLastScore[mover] = *score;
+            }
+            const int n = mAdjudication.resign_moves;
+            for (const int side : { 0, 1 }) {
+                // Both engines have to agree.
+                if (mWinning[side] >= n && mLosing[1 - side] >= n)
+                    result = side ? -mLastScore[side] : mLastScore[side];
+            }
+        }
+        if (!result && mAdjudication.solve_empties > 0) {
+            const BitBoard b = BitBoard::from_board(mBoard);
+            if (b.empties() <= mAdjudication.solve_empties) {
+                const bool black_next = mBoard.whos_next() == Player::Black;
+                // Only this thread changes the game or uses the solver, so
+                // the lock can be dropped while solving.
+                lk.unlock();
+                if (!mSolver) {
+                    mSolver = std::make_unique<EndgameSolver>();
+                    mSolver->set_cancel(&mSolveCancel);
+                }
+                int score;
+                try {
+                    score = mSolver->solve(b).score;
+                } catch (EndgameSolver::Aborted) {
+                    // A command that pauses or leaves the game is next. The
+                    // move stands, and the game goes on if it is resumed.
+                    return true;
+                }
+                lk.lock();
+                result = black_next ? score : -score;
+            }
         }
+        if (!result)
+            return false;
+        mAdjudicated = result;
+        mGameInProgress = false;
+        ++mGameID;
+        lk.unlock();
+        mObserver.announce_game_result(*result > 0 ? MatchResult::Black
+            : *result < 0 ? MatchResult::White : MatchResult::Draw);
+        return true;
     }
 
-    void GameMan::take_back() {
+    void GameMan::reset_adjudication() noexcept {
+        mAdjudicated.reset();
+        mWinning = mLosing = mLastScore = {};
+    }
+
+    void GameMan::set_adjudication(const Adjudication& adj) {
+        std::lock_guard lk(mDataMutex);
+        mAdjudication = adj;
+    }
+
+    std::optional<int> GameMan::adjudicated() {
+        std::lock_guard lk(mDataMutex);
+        return mAdjudicated;
+    }
+
+    void GameMan::handle_take_back() {
         // The new board
         Board b2;
         {
@@ -95,7 +160,8 @@ namespace Reversi {
                     b2.place(mAnnotation[i].first, mAnnotation[i].second);
             }
         }
-        pause_game();
+        handle_pause();
+        std::pair<int, int> last_move{ 0, 0 };
         {
             std::lock_guard lk(mDataMutex);
             mBoard = b2;
@@ -104,33 +170,38 @@ namespace Reversi {
                 mAnnotation.pop_back();
             if (!mAnnotation.empty())
                 mAnnotation.pop_back();
+            if (!mAnnotation.empty())
+                last_move = mAnnotation.back();
+            reset_adjudication();
             // Then we notify the engines of the change.
             mBlackSide->change_position(b2);
             mWhiteSide->change_position(b2);
         }
-        mMainWindow.update_board(b2, mAnnotation.empty() ? std::pair(0, 0) : mAnnotation.back());
-        resume_game();
+        mObserver.update_board(b2, last_move);
+        handle_resume();
     }
 
-    GameMan::GameMan(MainWindow& mw, PrivateTag) :
-        mWhiteSide(nullptr), mBlackSide(nullptr), mMainWindow(mw),
-        mThread(&GameMan::mainloop, this)
+    void GameMan::take_back() {
+        mSolveCancel = true;
+        mCommands.push(Command::TakeBack{});
+    }
+
+    GameMan::GameMan(GameObserver& obs, PrivateTag) :
+        mWhiteSide(nullptr), mBlackSide(nullptr), mObserver(obs),
+        mCommands(256), mThread(&GameMan::mainloop, this)
     {
         mAnnotation.reserve(128);
     }
 
-    std::shared_ptr<GameMan> GameMan::create(MainWindow& mw) {
-        return std::make_shared<GameMan>(mw, PrivateTag());
+    std::shared_ptr<GameMan> GameMan::create(GameObserver& obs) {
+        return std::make_shared<GameMan>(obs, PrivateTag());
     }
 
     GameMan::~GameMan() noexcept {
         std::cerr << "~GameMan()\n";
-        {
-            std::lock_guard lk(mQueueMutex);
-            mSemaQueue.push(0);
-        }
-        pause_game();
-        mCondVar.notify_one();
+        mSolveCancel = true;
+        mCommands.push(Command::Pause{});
+        mCommands.push(Command::Exit{});
         mThread.join();
     }
 
@@ -154,34 +225,51 @@ namespace Reversi {
     }
 
     void GameMan::start_new() {
+        {
+            std::lock_guard lk(mDataMutex);
+            if (!(mWhiteSide && mBlackSide))
+                throw ReversiError("Two sides should both have their engine loaded.");
+            if (mWhiteSide == mBlackSide)
+                throw ReversiError("You can't let one engine play two sides.");
+        }
+        mSolveCancel = true;
+        mCommands.push(Command::Start{});
+    }
+
+    void GameMan::handle_start() {
+        mSolveCancel = false;
         std::lock_guard lk(mDataMutex);
+        // The engines may have been unloaded since the command was sent.
         if (!(mWhiteSide && mBlackSide))
-            throw ReversiError("Two sides should both have their engine loaded.");
-        if (mWhiteSide == mBlackSide)
-            throw ReversiError("You can't let one engine play two sides.");
+            return;
         // Reset the game related data
         mAnnotation.clear();
+        reset_adjudication();
         mBoard = Board();
         mPrevSkip = mDirty = false;
         ++mGameID;
         mGameInProgress = true;
-        mMainWindow.update_board(mBoard, {0, 0});
+        mObserver.update_board(mBoard, {0, 0});
         mBlackSide->request_compute(mGameID);
     }
 
     void GameMan::enter_move(std::pair<int, int> mov, unsigned char gid) {
-        std::unique_lock lk(mQueueMutex);
-        if (gid == mGameID) {
-            mSemaQueue.push(3 + (mov.first << 8) + (mov.second << 16) + ((unsigned)(gid) << 24));
-            lk.unlock();
-            mCondVar.notify_one();
-        }
+        // Moves of old games are refused by the mainloop, which knows the
+        // current game id.
+        if (mov.first)
+            mCommands.push(Command::Place{ mov.first, mov.second, gid });
+        else
+            mCommands.push(Command::Skip{ gid });
     }
 
     void GameMan::pause_game() {
-        std::cout << "Waiting for pause_game...\n";
+        mSolveCancel = true;
+        mCommands.push(Command::Pause{});
+    }
+
+    void GameMan::handle_pause() {
+        mSolveCancel = false;
         std::lock_guard lk(mDataMutex);
-        std::cout << "Pause game lock acquired!\n";
         if (!mGameInProgress)
             return;
         mWhiteSide->request_cancel();
@@ -191,8 +279,12 @@ namespace Reversi {
     }
 
     void GameMan::resume_game() {
+        mCommands.push(Command::Resume{});
+    }
+
+    void GameMan::handle_resume() {
         std::lock_guard lk(mDataMutex);
-        if (mGameInProgress)
+        if (mGameInProgress || !(mWhiteSide && mBlackSide))
             return;
         mGameInProgress = true;
         (mBoard.whos_next() == Player::Black ? mBlackSide : mWhiteSide)
@@ -204,6 +296,11 @@ namespace Reversi {
         return mDirty;
     }
 
+    std::vector<std::pair<int, int>> GameMan::annotation() {
+        std::lock_guard lk(mDataMutex);
+        return mAnnotation;
+    }
+
     nlohmann::json GameMan::to_json() {
         std::lock_guard lk(mDataMutex);
         using nlohmann::json;
@@ -213,12 +310,23 @@ namespace Reversi {
             ans["annotation"].push_back(json::array({ x, y }));
         ans["black"] = mBlackSide->get_name();
         ans["white"] = mWhiteSide->get_name();
+        if (mAdjudicated)
+            ans["adjudicated"] = *mAdjudicated;
+        // The engines keep what they learned alongside the game. The game is
+        // saved even if they can't.
+        for (Engine* e : { mBlackSide.get(), mWhiteSide.get() }) {
+            try {
+                e->save_state();
+            } catch (const ReversiError& ex) {
+                std::cerr << ex.what() << "\n";
+            }
+        }
         // Since we have saved, the game is no longer dirty
         mDirty = false;
         return ans;
     }
 
-    void GameMan::read_annotation(const nlohmann::json& js) {
+    void GameMan::read_annotation(const nlohmann::json& js, Command::Load& cmd) {
         using nlohmann::json;
         using namespace std::string_literals;
         try {
@@ -238,11 +346,8 @@ namespace Reversi {
                 }
             }
             // If we have survivied until now, that means the data is OK.
-            pause_game();
-            // Acquire the lock just to be safe.
-            std::lock_guard lk(mDataMutex);
-            mBoard = std::move(b);
-            mAnnotation = std::move(anno);
+            cmd.board = std::move(b);
+            cmd.annotation = std::move(anno);
         } catch (const json::exception& ex) {
             throw ReversiError("Error parsing JSON: "s + ex.what());
         }
@@ -250,22 +355,35 @@ namespace Reversi {
 
     void GameMan::from_json(const nlohmann::json& js) {
         using namespace std::string_literals;
-        std::unique_ptr<Engine> new_black, new_white;
+        auto cmd = std::make_unique<Command::Load>();
         try {
-            new_black = make_engine_from_description(js.at("black"), mMainWindow);
-            new_white = make_engine_from_description(js.at("white"), mMainWindow);
+            cmd->black = mObserver.make_engine(js.at("black"));
+            cmd->white = mObserver.make_engine(js.at("white"));
         } catch (const nlohmann::json::exception& ex) {
             throw ReversiError("Error parsing JSON: "s + ex.what());
         }
-        read_annotation(js);
-        // The game is now paused and the board and the annotation have been updated.
-        load_black_engine(std::move(new_black));
-        load_white_engine(std::move(new_white));
-        // Let's ignore the possibility of these functions throwing.
-        const auto& last_move = js["annotation"].back();
-        mMainWindow.update_board(mBoard, { last_move[0], last_move[1] });
+        read_annotation(js, *cmd);
+        mSolveCancel = true;
+        mCommands.push(std::move(cmd));
+    }
+
+    void GameMan::handle_load(Command::Load& cmd) {
+        handle_pause();
+        // The game is now paused. Update the board and the annotation.
+        {
+            // Acquire the lock just to be safe.
+            std::lock_guard lk(mDataMutex);
+            mBoard = cmd.board;
+            mAnnotation = std::move(cmd.annotation);
+            // Two skips in a row end the game, so the last game's don't count.
+            mPrevSkip = !mAnnotation.empty() && mAnnotation.back().first == 0;
+            reset_adjudication();
+        }
+        load_black_engine(std::move(cmd.black));
+        load_white_engine(std::move(cmd.white));
+        mObserver.update_board(mBoard, mAnnotation.empty() ? std::pair(0, 0) : mAnnotation.back());
         mWhiteSide->change_position(mBoard);
         mBlackSide->change_position(mBoard);
-        resume_game();
+        handle_resume();
     }
-}
\ No newline at end of file
+}
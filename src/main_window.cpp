@@ -59,7 +59,7 @@ namespace Reversi {
 
     void MainWindow::announce_game_result(MatchResult res) {
         // After announcing the game result, do not allow backtracking
-        input_button_activity(nullptr);
+        input_button_activity(false);
         switch (res) {
         case MatchResult::Draw:
             nana::msgbox(*this, "Game ended in draw").show();
@@ -73,9 +73,28 @@ namespace Reversi {
         }
     }
 
-    void MainWindow::input_button_activity(const UserInputEngine* uie) {
-        mTakebackButton.enabled(uie);
-        mSkipButton.enabled(uie);
+    void MainWindow::input_button_activity(bool user_to_move) {
+        mTakebackButton.enabled(user_to_move);
+        mSkipButton.enabled(user_to_move);
+    }
+
+    void MainWindow::next_to_move(Player, const std::string& engine) {
+        input_button_activity(engine == "UserInput");
+    }
+
+    std::unique_ptr<Engine> make_engine_from_description(
+        const std::string& name, MainWindow& mw
+    ) {
+        const auto desc = EngineDescription::parse(name);
+        if (desc.name == "UserInput") {
+            desc.check_keys({});
+            return std::make_unique<UserInputEngine>(mw.mBoardWidget, mw.mSkipButton);
+        }
+        return make_engine_from_description(name);
+    }
+
+    std::unique_ptr<Engine> MainWindow::make_engine(const std::string& description) {
+        return make_engine_from_description(description, *this);
     }
 
     // Fills in rg and ckbox for one side. For use only in the following function.
@@ -85,6 +104,8 @@ namespace Reversi {
     ) {
         ckbox.emplace_back(new nana::checkbox(fm.handle(), "UserInput"));
         ckbox.emplace_back(new nana::checkbox(fm.handle(), "MCTSe"));
+        ckbox.emplace_back(new nana::checkbox(fm.handle(), "AlphaBeta"));
+        ckbox.emplace_back(new nana::checkbox(fm.handle(), "Solver"));
         ckbox.emplace_back(new nana::checkbox(fm.handle(), "RandomChoice"));
         for (auto& ptr : ckbox)
             rg.add(*ptr);
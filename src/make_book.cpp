@@ -0,0 +1,214 @@
+// Builds an opening book from recorded games, deep searches, or both.
+// Usage: make_book OUT [INPUT...] [--plies=N] [--min-visits=N] [--search=DESC]
+//                      [--threads=N]
+//
+// The moves of the first `plies` plies (default 20) of the games in the
+// inputs, in any format GameReader reads, are counted per canonical position.
+// A move's score is the mean final disc difference of its games for the
+// player who made it, and moves played fewer than `min-visits` times
+// (default 2) are left out. With --search, every move kept is scored again by
+// the engine DESC (e.g. "Solver" or "AlphaBeta:depth=14") instead, on all
+// threads. Without inputs, every position of the first `plies` plies is
+// searched, which is only feasible for a handful of plies.
+#include "book.h"
+#include "command_line.h"
+#include "engi.h"
+#include "record.h"
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Reversi;
+
+struct Options {
+    std::string out;
+    std::vector<std::string> inputs;
+    int plies = 20;
+    int min_visits = 2;
+    std::string search;
+    int threads = std::max(1, int(std::thread::hardware_concurrency()));
+};
+
+// What is known about a move of a canonical position.
+struct MoveStats {
+    long long result_sum = 0;
+    std::uint32_t visits = 0;
+    // The position and the move as first seen, for searching. The book
+    // doesn't remember whose turn it is, but the engines need to know.
+    Board board;
+    int sq = 0;
+    int score = 0;
+};
+
+using MoveMap = std::map<std::pair<BitBoard, int>, MoveStats>;
+
+// The entry of the move sq of `board`, creating it if it is new.
+static MoveStats& entry(MoveMap& moves, const Board& board, int sq) {
+    int sym;
+    const BitBoard key = canonical(BitBoard::from_board(board), &sym);
+    const auto [it, is_new] = moves.try_emplace({ key, transform_square(sq, sym) });
+    if (is_new) {
+        it->second.board = board;
+        it->second.sq = sq;
+    }
+    return it->second;
+}
+
+static void add_games(const Options& opt, MoveMap& moves) {
+    long long games = 0;
+    for (const auto& path : opt.inputs) {
+        GameReader reader(path);
+        GameRecord game;
+        while (reader.next(game)) {
+            ++games;
+            Board board;
+            for (int i = 0; i < int(game.moves.size()) && i < opt.plies; i++) {
+                const int sq = game.moves[i];
+                if (sq == GameRecord::PASS) {
+                    board.skip();
+                    continue;
+                }
+                const auto [x, y] = from_index(sq);
+                if (!board.is_placable(x, y))
+                    throw ReversiError(path + ": illegal move in game " + std::to_string(games));
+                MoveStats& st = entry(moves, board, sq);
+                st.result_sum += board.whos_next() == Player::Black ? game.result : -game.result;
+                ++st.visits;
+                board.place(x, y);
+            }
+        }
+    }
+    std::cout << games << " games, " << moves.size() << " moves\n";
+    std::erase_if(moves, [&](const auto& m) {
+        return m.second.visits < unsigned(opt.min_visits);
+    });
+    for (auto& [key, st] : moves)
+        st.score = int(std::lround(double(st.result_sum) / st.visits));
+}
+
+// Every move of every position in the first `plies` plies.
+static void add_all_moves(const Options& opt, MoveMap& moves) {
+    std::vector<Board> level{ Board() };
+    for (int ply = 0; ply < opt.plies && !level.empty(); ply++) {
+        std::vector<Board> next;
+        for (const auto& board : level) {
+            for (const auto& [x, y] : board.get_placable()) {
+                const std::size_t before = moves.size();
+                entry(moves, board, to_index(x, y));
+                // A symmetric image of a move already seen leads to a
+                // symmetric image of a position already seen.
+                if (moves.size() == before)
+                    continue;
+                Board child = board;
+                child.place(x, y);
+                if (child.is_skip_legal())
+                    child.skip();
+                next.push_back(child);
+            }
+        }
+        level.swap(next);
+    }
+    std::cout << moves.size() << " moves to search\n";
+}
+
+// The score of the move for the player making it, by the engine.
+static int search_move(Engine& engine, const MoveStats& st) {
+    Board board = st.board;
+    const auto [x, y] = from_index(st.sq);
+    board.place(x, y);
+    const BitBoard b = BitBoard::from_board(board);
+    // The engine scores for the side to move, which is normally the opponent.
+    int sign = -1;
+    if (!b.moves()) {
+        if (!b.pass().moves())
+            return -b.final_score();
+        board.skip();
+        sign = 1;
+    }
+    engine.search(board);
+    const auto score = engine.last_score();
+    if (!score)
+        throw ReversiError(engine.get_name() + " doesn't report scores");
+    return sign * *score;
+}
+
+static void search_moves(const Options& opt, MoveMap& moves) {
+    std::vector<MoveStats*> list;
+    for (auto& [key, st] : moves)
+        list.push_back(&st);
+    std::atomic<std::size_t> next = 0;
+    std::mutex mutex;
+    std::size_t done = 0;
+    std::string error;
+    const auto worker = [&] {
+        try {
+            const auto engine = make_engine_from_description(opt.search);
+            for (std::size_t i; (i = next++) < list.size(); ) {
+                list[i]->score = search_move(*engine, *list[i]);
+                std::lock_guard lock(mutex);
+                if (++done % 1000 == 0 || done == list.size())
+                    std::cout << done << " of " << list.size() << " moves searched" << std::endl;
+            }
+        } catch (const ReversiError& e) {
+            next = list.size();
+            std::lock_guard lock(mutex);
+            error = e.what();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int i = 0; i < opt.threads; i++)
+        pool.emplace_back(worker);
+    for (auto& t : pool)
+        t.join();
+    if (!error.empty())
+        throw ReversiError(error);
+}
+
+static Options parse_options(int argc, char** argv) {
+    Options ans;
+    const auto cl = CommandLine::parse(argc, argv);
+    cl.check_keys({ "plies", "min-visits", "search", "threads" });
+    if (!cl.positional.empty()) {
+        ans.out = cl.positional.front();
+        ans.inputs.assign(cl.positional.begin() + 1, cl.positional.end());
+    }
+    ans.plies = cl.get_int("plies", ans.plies);
+    ans.min_visits = cl.get_int("min-visits", ans.min_visits);
+    ans.search = cl.get_string("search", ans.search);
+    ans.threads = cl.get_int("threads", ans.threads);
+    if (ans.out.empty() || (ans.inputs.empty() && ans.search.empty()))
+        throw ReversiError("Usage: make_book OUT [INPUT...] [--plies=N] [--min-visits=N] [--search=DESC]"
+            " [--threads=N]\nWithout inputs, --search is needed.");
+    if (ans.plies <= 0 || ans.min_visits <= 0 || ans.threads <= 0)
+        throw ReversiError("plies, min-visits and threads should be positive");
+    return ans;
+}
+
+int main(int argc, char** argv) {
+    try {
+        const Options opt = parse_options(argc, argv);
+        if (!opt.search.empty())
+            make_engine_from_description(opt.search);
+        MoveMap moves;
+        if (opt.inputs.empty())
+            add_all_moves(opt, moves);
+        else
+            add_games(opt, moves);
+        if (!opt.search.empty())
+            search_moves(opt, moves);
+        std::vector<BookEntry> entries;
+        entries.reserve(moves.size());
+        for (const auto& [key, st] : moves)
+            entries.push_back({ key.first, { key.second, st.score, st.visits } });
+        OpeningBook::write(opt.out, std::move(entries));
+        std::cout << moves.size() << " moves written to " << opt.out << "\n";
+    } catch (const ReversiError& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
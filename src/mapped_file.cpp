@@ -0,0 +1,118 @@
+#include "mapped_file.h"
+#include "game.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Reversi {
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::string& path) {
+        mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (mFile == INVALID_HANDLE_VALUE) {
+            mFile = nullptr;
+            throw ReversiError("Can't open " + path);
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(mFile, &size)) {
+            CloseHandle(mFile);
+            throw ReversiError("Can't get the size of " + path);
+        }
+        mSize = std::size_t(size.QuadPart);
+        if (!mSize)
+            return;
+        mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mMapping)
+            mData = static_cast<const unsigned char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+        if (!mData) {
+            if (mMapping)
+                CloseHandle(mMapping);
+            CloseHandle(mFile);
+            throw ReversiError("Can't map " + path);
+        }
+    }
+
+    MappedFile::~MappedFile() noexcept {
+        if (mData)
+            UnmapViewOfFile(mData);
+        if (mMapping)
+            CloseHandle(mMapping);
+        if (mFile)
+            CloseHandle(mFile);
+    }
+
+    FileLock::FileLock(const std::string& path) {
+        mFile = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (mFile == INVALID_HANDLE_VALUE) {
+            mFile = nullptr;
+            throw ReversiError("Can't open " + path);
+        }
+        OVERLAPPED ov{};
+        if (!LockFileEx(mFile, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &ov)) {
+            CloseHandle(mFile);
+            throw ReversiError("Can't lock " + path);
+        }
+    }
+
+    FileLock::~FileLock() noexcept {
+        // Closing the handle lets go of the lock.
+        CloseHandle(mFile);
+    }
+#else
+    MappedFile::MappedFile(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw ReversiError("Can't open " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw ReversiError("Can't get the size of " + path);
+        }
+        mSize = std::size_t(st.st_size);
+        if (mSize) {
+            void* p = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                throw ReversiError("Can't map " + path);
+            }
+            mData = static_cast<const unsigned char*>(p);
+        }
+        // The mapping keeps the file alive by itself.
+        close(fd);
+    }
+
+    MappedFile::~MappedFile() noexcept {
+        if (mData)
+            munmap(const_cast<unsigned char*>(mData), mSize);
+    }
+
+    FileLock::FileLock(const std::string& path) {
+        mFd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (mFd < 0)
+            throw ReversiError("Can't open " + path);
+        // flock() locks belong to the open file, so that two FileLocks in one
+        // process wait for each other too.
+        while (flock(mFd, LOCK_EX) != 0) {
+            if (errno != EINTR) {
+                close(mFd);
+                throw ReversiError("Can't lock " + path);
+            }
+        }
+    }
+
+    FileLock::~FileLock() noexcept {
+        // Closing the file lets go of the lock.
+        close(mFd);
+    }
+#endif
+}
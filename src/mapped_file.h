@@ -0,0 +1,79 @@
+// Read-only memory mapped files, and locks for replacing them
+#ifndef REVERSI_MAPPED_FILE_H
+#define REVERSI_MAPPED_FILE_H
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace Reversi {
+    // A whole file mapped into memory for reading. The pages are loaded by
+    // the OS as they are touched, so opening even a large file costs nothing
+    // up front, and processes reading the same file share the memory.
+    class MappedFile {
+        const unsigned char* mData = nullptr;
+        std::size_t mSize = 0;
+#ifdef _WIN32
+        // The file and the mapping object, as HANDLEs.
+        void* mFile = nullptr;
+        void* mMapping = nullptr;
+#endif
+
+    public:
+        // Maps the file, throwing ReversiError if it can't. An empty file
+        // maps to no data.
+        explicit MappedFile(const std::string& path);
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator = (const MappedFile&) = delete;
+
+        ~MappedFile() noexcept;
+
+        inline const unsigned char* data() const noexcept {
+            return mData;
+        }
+
+        inline std::size_t size() const noexcept {
+            return mSize;
+        }
+    };
+
+    // An exclusive lock on a file, held until destruction, which other
+    // processes and other FileLocks in this one wait for. The file is created
+    // if it doesn't exist, and left behind: it only exists to be locked, for
+    // files that are replaced instead of written in place.
+    class FileLock {
+#ifdef _WIN32
+        // The file, as a HANDLE.
+        void* mFile = nullptr;
+#else
+        int mFd = -1;
+#endif
+
+    public:
+        // Waits for the lock, throwing ReversiError if the file can't be
+        // opened or locked.
+        explicit FileLock(const std::string& path);
+
+        FileLock(const FileLock&) = delete;
+        FileLock& operator = (const FileLock&) = delete;
+
+        ~FileLock() noexcept;
+    };
+
+    // Little endian integers of n bytes, which mapped file formats are made
+    // of. Compilers turn read_le() into a plain load on little endian machines.
+    inline std::uint64_t read_le(const unsigned char* p, int n) noexcept {
+        std::uint64_t ans = 0;
+        for (int i = n - 1; i >= 0; i--)
+            ans = ans << 8 | p[i];
+        return ans;
+    }
+
+    inline void write_le(std::ostream& out, std::uint64_t x, int n) {
+        for (int i = 0; i < n; i++)
+            out.put(char(x >> (8 * i)));
+    }
+}
+
+#endif
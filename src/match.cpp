@@ -0,0 +1,114 @@
+// Plays engine-vs-engine games without the GUI and writes them as JSON lines.
+// Usage: match OUT [--games=N] [--concurrency=N] [--black=DESC] [--white=DESC]
+//                  [--random=N] [--seed=N] [--openings=FILE] [--solve=N]
+//                  [--resign=N] [--resign-moves=N]
+//
+// The games are played by game managers like the GUI's, reporting to an
+// observer instead of a window, `concurrency` of them at a time (by default
+// one per core). The first `random` plies (default 8) are random legal moves,
+// game i seeded with seed + i, so that a run can be repeated. With --openings
+// game i starts with opening i of the suite instead, going round it if there
+// are more games than openings. Each game is a
+// line of OUT as it ends: the annotation and engines as the GUI saves them,
+// its number as "game" and Black's discs minus White's as "result".
+//
+// --solve and --resign end games early (see Adjudication): once at most
+// `solve` empties (at most 20) are left the position is solved, and once both
+// engines have reported scores beyond `resign` discs for `resign-moves` moves
+// (default 3) the leader wins. Such games have their result as "adjudicated"
+// too.
+#include "arena.h"
+#include "command_line.h"
+#include "engi.h"
+#include "opening_suite.h"
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+
+using namespace Reversi;
+
+struct Options {
+    std::string out, openings;
+    int games = 100;
+    int concurrency = std::max(1, int(std::thread::hardware_concurrency()));
+    std::string black = "AlphaBeta:depth=4", white = "AlphaBeta:depth=4";
+    int random = 8;
+    unsigned seed = 1;
+    Adjudication adjudication;
+};
+
+static Options parse_options(int argc, char** argv) {
+    Options ans;
+    const auto cl = CommandLine::parse(argc, argv);
+    cl.check_keys({ "games", "concurrency", "black", "white", "random", "seed", "openings",
+        "solve", "resign", "resign-moves" });
+    if (cl.positional.size() > 1)
+        throw ReversiError("Only one output file: " + cl.positional[1]);
+    if (!cl.positional.empty())
+        ans.out = cl.positional.front();
+    ans.games = cl.get_int("games", ans.games);
+    ans.concurrency = cl.get_int("concurrency", ans.concurrency);
+    ans.black = cl.get_string("black", ans.black);
+    ans.white = cl.get_string("white", ans.white);
+    ans.random = cl.get_int("random", ans.random);
+    ans.seed = unsigned(cl.get_unsigned("seed", ans.seed));
+    ans.openings = cl.get_string("openings", ans.openings);
+    ans.adjudication.solve_empties = cl.get_int("solve", ans.adjudication.solve_empties);
+    ans.adjudication.resign_score = cl.get_int("resign", ans.adjudication.resign_score);
+    ans.adjudication.resign_moves = cl.get_int("resign-moves", ans.adjudication.resign_moves);
+    if (ans.out.empty())
+        throw ReversiError("Usage: match OUT [--games=N] [--concurrency=N] [--black=DESC] [--white=DESC]"
+            " [--random=N] [--seed=N] [--openings=FILE] [--solve=N] [--resign=N] [--resign-moves=N]");
+    if (ans.games < 0 || ans.concurrency <= 0 || ans.random < 0)
+        throw ReversiError("games and random can't be negative, concurrency should be positive");
+    if (ans.adjudication.solve_empties < 0 || ans.adjudication.resign_score < 0 || ans.adjudication.resign_moves <= 0)
+        throw ReversiError("solve and resign can't be negative, resign-moves should be positive");
+    if (ans.adjudication.solve_empties > Adjudication::MAX_SOLVE_EMPTIES)
+        throw ReversiError("solve should be at most " + std::to_string(Adjudication::MAX_SOLVE_EMPTIES));
+    return ans;
+}
+
+int main(int argc, char** argv) {
+    try {
+        const Options opt = parse_options(argc, argv);
+        std::optional<OpeningSuite> suite;
+        if (!opt.openings.empty()) {
+            suite.emplace(opt.openings);
+            if (!suite->size())
+                throw ReversiError(opt.openings + " has no openings");
+        }
+        std::ofstream out(opt.out);
+        if (!out)
+            throw ReversiError("Can't write " + opt.out);
+        // Black's wins, draws and losses.
+        int wins = 0, draws = 0, losses = 0;
+        const auto start = std::chrono::steady_clock::now();
+        const int played = play_games(opt.games, opt.concurrency, [&](int id) {
+            return ArenaGame{ opt.black, opt.white, suite ? suite->annotation(id % suite->size())
+                : random_opening(opt.seed + unsigned(id), opt.random) };
+        }, [&](int id, const nlohmann::json& game) {
+            nlohmann::json line = game;
+            line["game"] = id;
+            out << line.dump() << "\n";
+            const int result = game["result"];
+            ++(result > 0 ? wins : result < 0 ? losses : draws);
+            const int done = wins + draws + losses;
+            if (done % 100 == 0 || done == opt.games) {
+                const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                std::cout << done << " games, " << std::lround(done * 3600 / sec) << " per hour" << std::endl;
+            }
+            return true;
+        }, opt.adjudication);
+        out.close();
+        if (!out)
+            throw ReversiError("Error writing " + opt.out);
+        std::cout << played << " games. Black +" << wins << " =" << draws << " -" << losses << "\n";
+    } catch (const ReversiError& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
@@ -1,39 +1,337 @@
 #include "mctse.h"
+#include "eval.h"
+#include "solve_cache.h"
 #include <random>
 #include <cassert>
 #include <cmath>
-#include <unordered_set>
 #include <iostream>
-#include <stack>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
 
 namespace Reversi {
-    std::function<int()> MCTS::mRandGen = []{
-        std::mt19937 mt;
+    thread_local std::function<int()> MCTS::mRandGen = []{
+        // Each thread gets its own seed, or their rollouts would be the same.
+        static std::atomic<unsigned> seeds = 0;
+        std::mt19937 mt(std::mt19937::default_seed + seeds++);
         std::uniform_int_distribution dist(0, 256);
         return std::bind(dist, mt);
     }();
 
+    MCTS::Options MCTS::Options::from_description(const EngineDescription& desc) {
+        desc.check_keys({ "rave", "rave_equiv", "solve_empties", "rollout_plies", "nnue", "puct", "root", "ms", "playouts", "threads", "batch", "batch_us", "book", "cache", "tree", "tree_visits" });
+        Options ans;
+        ans.rave = desc.get_bool("rave", ans.rave);
+        ans.rave_equiv = desc.get_double("rave_equiv", ans.rave_equiv);
+        if (ans.rave_equiv <= 0)
+            throw ReversiError("rave_equiv should be positive");
+        ans.solve_empties = desc.get_int("solve_empties", ans.solve_empties);
+        // Every leaf is solved, so deeper solves would stall the search.
+        if (ans.solve_empties < 0 || ans.solve_empties > 24)
+            throw ReversiError("solve_empties should be between 0 and 24");
+        ans.rollout_plies = desc.get_int("rollout_plies", ans.rollout_plies);
+        if (ans.rollout_plies < 0)
+            throw ReversiError("rollout_plies should not be negative");
+        ans.nnue = desc.get_string("nnue", ans.nnue);
+        ans.puct = desc.get_double("puct", ans.puct);
+        if (ans.puct < 0)
+            throw ReversiError("puct should not be negative");
+        const auto root = desc.get_string("root", "ucb");
+        if (root == "ucb")
+            ans.root = RootPolicy::UCB;
+        else if (root == "halving")
+            ans.root = RootPolicy::Halving;
+        else
+            throw ReversiError("root should be ucb or halving, got " + root);
+        ans.ms = desc.get_int("ms", ans.ms);
+        if (ans.ms <= 0)
+            throw ReversiError("ms should be positive");
+        ans.playouts = desc.get_int("playouts", ans.playouts);
+        if (ans.playouts < 0)
+            throw ReversiError("playouts should not be negative");
+        ans.threads = desc.get_int("threads", ans.threads);
+        if (ans.threads <= 0 || ans.threads > 256)
+            throw ReversiError("threads should be between 1 and 256");
+        if (ans.threads > 1 && ans.root != RootPolicy::UCB)
+            throw ReversiError("root=halving only runs on one thread");
+        ans.batch = desc.get_int("batch", ans.batch);
+        // Each thread waits for one leaf at a time, so larger batches never fill.
+        if (ans.batch < 0 || ans.batch > ans.threads)
+            throw ReversiError("batch should be between 0 and threads");
+        if (ans.batch && ans.nnue.empty())
+            throw ReversiError("batch needs a network to evaluate with (nnue)");
+        ans.batch_us = desc.get_int("batch_us", ans.batch_us);
+        if (ans.batch_us <= 0)
+            throw ReversiError("batch_us should be positive");
+        ans.book = desc.get_string("book", ans.book);
+        ans.cache = desc.get_string("cache", ans.cache);
+        if (!ans.cache.empty() && !ans.solve_empties)
+            throw ReversiError("cache needs the solver (solve_empties)");
+        ans.tree = desc.get_string("tree", ans.tree);
+        ans.tree_visits = desc.get_int("tree_visits", ans.tree_visits);
+        if (ans.tree_visits <= 0)
+            throw ReversiError("tree_visits should be positive");
+        return ans;
+    }
+
+    void MCTS::Options::to_description(EngineDescription& desc) const {
+        const Options def;
+        if (rave != def.rave)
+            desc.set_bool("rave", rave);
+        if (rave_equiv != def.rave_equiv)
+            desc.set_double("rave_equiv", rave_equiv);
+        if (solve_empties != def.solve_empties)
+            desc.set_int("solve_empties", solve_empties);
+        if (rollout_plies != def.rollout_plies)
+            desc.set_int("rollout_plies", rollout_plies);
+        if (!nnue.empty())
+            desc.set_string("nnue", nnue);
+        if (puct != def.puct)
+            desc.set_double("puct", puct);
+        if (root != def.root)
+            desc.set_string("root", root == RootPolicy::Halving ? "halving" : "ucb");
+        if (ms != def.ms)
+            desc.set_int("ms", ms);
+        if (playouts != def.playouts)
+            desc.set_int("playouts", playouts);
+        if (threads != def.threads)
+            desc.set_int("threads", threads);
+        if (batch != def.batch)
+            desc.set_int("batch", batch);
+        if (batch_us != def.batch_us)
+            desc.set_int("batch_us", batch_us);
+        if (!book.empty())
+            desc.set_string("book", book);
+        if (!cache.empty())
+            desc.set_string("cache", cache);
+        if (!tree.empty())
+            desc.set_string("tree", tree);
+        if (tree_visits != def.tree_visits)
+            desc.set_int("tree_visits", tree_visits);
+    }
+
+    MCTS::MCTS() : MCTS(Options()) {}
+
+    MCTS::MCTS(Options opt) : mOptions(opt) {
+        if (!opt.nnue.empty())
+            mNnue = std::make_unique<const NnueNetwork>(NnueNetwork::load(opt.nnue));
+        if (opt.batch)
+            mBatch = std::make_unique<BatchEvaluator>(*mNnue, opt.batch, std::chrono::microseconds(opt.batch_us));
+        if (!opt.book.empty())
+            mBook = std::make_unique<const OpeningBook>(opt.book);
+        if (opt.solve_empties)
+            mSolverTable = std::make_shared<TransTable>(4);
+        if (!opt.cache.empty())
+            mSolveCache = SolveCache::open(opt.cache);
+        mSavedTree = map_tree(opt.tree, mSavedCount);
+    }
+
+    MCTS::~MCTS() noexcept {
+        stop_computation();
+        try {
+            save_state();
+        } catch (const ReversiError& e) {
+            std::cerr << e.what() << "\n";
+        }
+    }
+
+    std::string MCTS::get_name() {
+        EngineDescription desc{ "MCTSe", {} };
+        mOptions.to_description(desc);
+        return desc.to_string();
+    }
+
     // We remember that black win == 1
-    int MCTS::rollout(Board b) {
+    static int result_value(MatchResult res) noexcept {
+        switch (res) {
+            case MatchResult::Black: return 1;
+            case MatchResult::White: return -1;
+            default: return 0;
+        }
+    }
+
+    // The result of the game if player p wins.
+    static MatchResult win_for(Player p) noexcept {
+        return p == Player::Black ? MatchResult::Black : MatchResult::White;
+    }
+
+    static MatchResult loss_for(Player p) noexcept {
+        return p == Player::Black ? MatchResult::White : MatchResult::Black;
+    }
+
+    namespace {
+        constexpr char TREE_MAGIC[4] = { 'R', 'V', 'M', 'T' };
+        constexpr std::uint32_t TREE_VERSION = 1;
+
+        // A node as saved, seen from the player to move.
+        struct SavedNode {
+            std::uint32_t sims = 0;
+            float value = 0;
+            std::uint32_t amaf_n = 0;
+            float amaf_value = 0;
+            std::uint8_t proof = 0;
+        };
+    }
+
+    std::unique_ptr<MappedFile> MCTS::map_tree(const std::string& path, std::size_t& count) {
+        count = 0;
+        if (path.empty() || !std::filesystem::exists(path))
+            return nullptr;
+        auto file = std::make_unique<MappedFile>(path);
+        const unsigned char* p = file->data();
+        if (file->size() < SAVED_HEADER_SIZE || !std::equal(TREE_MAGIC, TREE_MAGIC + 4, p))
+            throw ReversiError(path + " is not a saved tree");
+        if (read_le(p + 4, 4) != TREE_VERSION)
+            throw ReversiError(path + " has an unknown tree format version");
+        const std::uint64_t cnt = read_le(p + 8, 8);
+        if (cnt != (file->size() - SAVED_HEADER_SIZE) / SAVED_SIZE || (file->size() - SAVED_HEADER_SIZE) % SAVED_SIZE)
+            throw ReversiError(path + " is truncated");
+        count = std::size_t(cnt);
+        return file;
+    }
+
+    void MCTS::add_node(const Board& b) {
+        const auto [it, is_new] = mNodes.try_emplace(b);
+        if (!is_new || !mSavedTree)
+            return;
+        const BitBoard key = canonical(BitBoard::from_board(b));
+        const unsigned char* base = mSavedTree->data() + SAVED_HEADER_SIZE;
+        const auto pos = [&](std::size_t i) {
+            return BitBoard{ read_le(base + i * SAVED_SIZE, 8), read_le(base + i * SAVED_SIZE + 8, 8) };
+        };
+        std::size_t lo = 0, hi = mSavedCount;
+        while (lo < hi) {
+            const std::size_t mid = lo + (hi - lo) / 2;
+            if (pos(mid) < key)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo == mSavedCount || !(pos(lo) == key))
+            return;
+        const unsigned char* p = base + lo * SAVED_SIZE + 16;
+        // Only the statistics, the node is still a leaf. Expanding it seeds
+        // the children in turn.
+        Node& node = it->second;
+        const double sign = b.whos_next() == Player::Black ? 1 : -1;
+        node.n = (long long)read_le(p, 4) * mRolloutCnt;
+        node.v = sign * std::bit_cast<float>(std::uint32_t(read_le(p + 4, 4))) * node.n;
+        node.amaf_n = (long long)read_le(p + 8, 4);
+        node.amaf_v = sign * std::bit_cast<float>(std::uint32_t(read_le(p + 12, 4))) * node.amaf_n;
+        // Without the solver nothing keeps the proofs consistent up the
+        // tree, so they aren't used at all.
+        if (!mOptions.solve_empties)
+            return;
+        const Player me = b.whos_next();
+        switch (p[16]) {
+            case 1: node.proof = win_for(me); break;
+            case 2: node.proof = loss_for(me); break;
+            case 3: node.proof = MatchResult::Draw; break;
+        }
+    }
+
+    void MCTS::save_state() {
+        if (mOptions.tree.empty())
+            return;
+        std::lock_guard lock(mTreeMutex);
+        std::vector<std::pair<BitBoard, SavedNode>> nodes;
+        for (const auto& [b, node] : mNodes) {
+            if (node.n < (long long)mOptions.tree_visits * mRolloutCnt)
+                continue;
+            const Player me = b.whos_next();
+            const double sign = me == Player::Black ? 1 : -1;
+            SavedNode s;
+            s.sims = std::uint32_t(std::min<long long>(node.n / mRolloutCnt, UINT32_MAX));
+            s.value = float(sign * node.v / node.n);
+            s.amaf_n = std::uint32_t(std::min<long long>(node.amaf_n, UINT32_MAX));
+            s.amaf_value = node.amaf_n ? float(sign * node.amaf_v / node.amaf_n) : 0;
+            s.proof = !node.proof ? 0 : *node.proof == win_for(me) ? 1 : *node.proof == loss_for(me) ? 2 : 3;
+            nodes.emplace_back(canonical(BitBoard::from_board(b)), s);
+        }
+        // Another engine may have replaced the file since this one mapped
+        // it, so the merge is with the file as it is now, and nobody else
+        // replaces it until this engine is done.
+        FileLock file_lock(mOptions.tree + ".lock");
+        std::size_t count;
+        auto current = map_tree(mOptions.tree, count);
+        if (current) {
+            const unsigned char* p = current->data() + SAVED_HEADER_SIZE;
+            for (std::size_t i = 0; i < count; i++, p += SAVED_SIZE) {
+                nodes.emplace_back(BitBoard{ read_le(p, 8), read_le(p + 8, 8) }, SavedNode{
+                    std::uint32_t(read_le(p + 16, 4)), std::bit_cast<float>(std::uint32_t(read_le(p + 20, 4))),
+                    std::uint32_t(read_le(p + 24, 4)), std::bit_cast<float>(std::uint32_t(read_le(p + 28, 4))), p[32] });
+            }
+        }
+        // Each position is one record, the one seen most: of the symmetric
+        // positions, and of this engine's nodes and the saved ones. The saved
+        // nodes this engine has been to have only gained simulations since
+        // they were read, unless another engine has added more meanwhile.
+        const auto by_key = [](const auto& lhs, const auto& rhs) {
+            return lhs.first < rhs.first || (lhs.first == rhs.first && lhs.second.sims > rhs.second.sims);
+        };
+        std::sort(nodes.begin(), nodes.end(), by_key);
+        nodes.erase(std::unique(nodes.begin(), nodes.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first == rhs.first;
+        }), nodes.end());
+        // A name of its own, in case the lock is ignored, as on some network
+        // file systems.
+        const std::string tmp = mOptions.tree + "." + std::to_string(std::random_device()()) + ".tmp";
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(TREE_MAGIC, 4);
+        write_le(out, TREE_VERSION, 4);
+        write_le(out, nodes.size(), 8);
+        for (const auto& [key, s] : nodes) {
+            write_le(out, key.own, 8);
+            write_le(out, key.opp, 8);
+            write_le(out, s.sims, 4);
+            write_le(out, std::bit_cast<std::uint32_t>(s.value), 4);
+            write_le(out, s.amaf_n, 4);
+            write_le(out, std::bit_cast<std::uint32_t>(s.amaf_value), 4);
+            write_le(out, s.proof, 4);
+        }
+        out.close();
+        std::error_code ec;
+        if (!out) {
+            std::filesystem::remove(tmp, ec);
+            throw ReversiError("Error writing " + tmp);
+        }
+        // Windows won't replace a file that is mapped.
+        current.reset();
+        mSavedTree.reset();
+        mSavedCount = 0;
+        std::filesystem::rename(tmp, mOptions.tree, ec);
+        if (ec) {
+            const std::string msg = ec.message();
+            std::filesystem::remove(tmp, ec);
+            throw ReversiError("Can't replace " + mOptions.tree + ": " + msg);
+        }
+        mSavedTree = map_tree(mOptions.tree, mSavedCount);
+    }
+
+    double MCTS::rollout(Board b, int plies, const NnueNetwork* net, PlayedSquares* played) {
         // The placable squares.
         std::vector<std::pair<int, int>> plc;
         plc.reserve(64);
         // If the last move was a skip
         bool prev_skip = false;
-        while (true) {
+        for (int ply = 0; ; ply++) {
+            if (ply == plies && plies) {
+                // Truncated: let the static evaluation guess the outcome.
+                const BitBoard bb = BitBoard::from_board(b);
+                const double p = win_probability(net ? net->eval(bb) : quick_eval(bb));
+                return b.whos_next() == Player::Black ? 2 * p - 1 : 1 - 2 * p;
+            }
             plc = b.get_placable();
             if (plc.size()) {
                 const auto [x, y] = plc[mRandGen() % plc.size()];
+                if (played)
+                    (*played)[static_cast<int>(b.whos_next())] |= std::uint64_t(1) << to_index(x, y);
                 b.place(x, y);
                 prev_skip = false;
             } else {
-                if (prev_skip) {
-                    switch (b.count()) {
-                        case MatchResult::Black: return 1;
-                        case MatchResult::White: return -1;
-                        case MatchResult::Draw: return 0;
-                    }
-                }
+                if (prev_skip)
+                    return result_value(b.count());
                 b.skip();
                 prev_skip = true;
             }
@@ -54,22 +352,131 @@ namespace Reversi {
             Board b2 = b;
             b2.skip();
             // Since Board is now trivially copyable, there's no point moving.
-            mNodes.emplace(b2, Node());
+            add_node(b2);
             return;
         }
+        // The priors are a softmax over the heuristic move scores.
+        if (mOptions.puct > 0) {
+            std::vector<double> priors(plc.size());
+            // The softmax temperature, in move_order_score() units.
+            static constexpr double temperature = 30;
+            const BitBoard bb = BitBoard::from_board(b);
+            double max_score = -std::numeric_limits<double>::infinity();
+            for (std::size_t i = 0; i < plc.size(); i++) {
+                priors[i] = move_order_score(bb, to_index(plc[i].first, plc[i].second)) / temperature;
+                max_score = std::max(max_score, priors[i]);
+            }
+            // Subtract the maximum so that exp() can't overflow.
+            double sum = 0;
+            for (auto& p : priors)
+                sum += (p = std::exp(p - max_score));
+            auto& node_priors = mNodes[b].priors;
+            node_priors.clear();
+            for (const auto p : priors)
+                node_priors.push_back(float(p / sum));
+        }
         // There are valid moves besides the skip
         for (const auto& [x, y] : plc) {
             Board b2 = b;
             b2.place(x, y);
-            mNodes.emplace(b2, Node());
+            add_node(b2);
+        }
+    }
+
+    EndgameSolver& MCTS::solver(Scratch& s) {
+        if (!s.solver) {
+            s.solver = std::make_unique<EndgameSolver>(mSolverTable);
+            s.solver->set_cancel(&mCancel);
+            s.solver->set_cache(mSolveCache);
+        }
+        return *s.solver;
+    }
+
+    bool MCTS::try_solve(const Board& b, Scratch& s, std::unique_lock<std::mutex>& lock) {
+        if (mNodes[b].proof)
+            return true;
+        if (!mOptions.solve_empties)
+            return false;
+        const BitBoard bb = BitBoard::from_board(b);
+        if (bb.empties() > mOptions.solve_empties)
+            return false;
+        using namespace std::chrono;
+        EndgameSolver& sol = solver(s);
+        sol.set_deadline(std::min(mDeadline, steady_clock::now() + milliseconds(mOptions.ms) / LEAF_SOLVE_SHARE));
+        int score;
+        lock.unlock();
+        try {
+            // A null window around zero is all it takes to tell the outcome.
+            score = sol.solve(bb, -1, 1).score;
+        } catch (EndgameSolver::Aborted) {
+            lock.lock();
+            if (mCancel.load(std::memory_order_acquire))
+                throw;
+            // Too deep to solve in time: the leaf is searched on instead,
+            // and its children have fewer empties.
+            return false;
         }
+        lock.lock();
+        const Player p = b.whos_next();
+        mNodes[b].proof = score > 0 ? win_for(p) : score < 0 ? loss_for(p) : MatchResult::Draw;
+        return true;
     }
 
-    Board MCTS::select_child(const Board& b) {
+    void MCTS::update_proof(const Board& b) {
+        Node& node = mNodes[b];
+        if (!mOptions.solve_empties || node.proof || node.is_leaf)
+            return;
+        const auto plc = b.get_placable();
+        if (plc.empty()) {
+            Board b2 = b;
+            b2.skip();
+            node.proof = mNodes[b2].proof;
+            return;
+        }
+        const Player p = b.whos_next();
+        bool all_proven = true, can_draw = false;
+        for (const auto& [x, y] : plc) {
+            Board b2 = b;
+            b2.place(x, y);
+            const auto& proof = mNodes[b2].proof;
+            if (!proof) {
+                all_proven = false;
+            } else if (*proof == win_for(p)) {
+                node.proof = proof;
+                return;
+            } else if (*proof == MatchResult::Draw) {
+                can_draw = true;
+            }
+        }
+        if (all_proven)
+            node.proof = can_draw ? MatchResult::Draw : loss_for(p);
+    }
+
+    void MCTS::update_amaf(const Board& b, const PlayedSquares& played, double result) {
+        const std::uint64_t mine = played[static_cast<int>(b.whos_next())];
+        for (int x = 1; x <= Board::MAX_FILES; x++) {
+            for (int y = 1; y <= Board::MAX_RANK; y++) {
+                // Squares played earlier in the simulation are occupied in b,
+                // so the whole-simulation mask only contains moves made from b on.
+                if (!(mine >> to_index(x, y) & 1) || !b.is_placable(x, y))
+                    continue;
+                Board b2 = b;
+                b2.place(x, y);
+                // The children were created when b was expanded.
+                if (const auto it = mNodes.find(b2); it != mNodes.end()) {
+                    ++it->second.amaf_n;
+                    it->second.amaf_v += result;
+                }
+            }
+        }
+    }
+
+    Board MCTS::select_child(const Board& b, std::pair<int, int>& mov) {
         // Adjust this constant for explore/exploit ratio
         static constexpr double c = 0.5;
         assert(mNodes.contains(b) && !mNodes[b].is_leaf);
-        assert(mNodes[b].n);
+        assert(mNodes[b].n || mNodes[b].virtual_loss);
+        mov = { 0, 0 };
         const auto plc = b.get_placable();
         if (plc.empty()) {
             // Obviously there is only one choice
@@ -77,98 +484,311 @@ namespace Reversi {
             b2.skip();
             return b2;
         }
-        const double log_parent = std::log(mNodes[b].n);
+        const Node& parent = mNodes[b];
+        // Virtual losses count as simulations in flight that all lose.
+        const auto visits = [](const Node& node) {
+            return node.n + mRolloutCnt * node.virtual_loss;
+        };
+        const double log_parent = std::log(visits(parent)), sqrt_parent = std::sqrt(visits(parent));
+        // The value is for black, so white minimizes it.
+        const double sign = b.whos_next() == Player::Black ? 1 : -1;
+        const bool puct = mOptions.puct > 0;
         Board ans = b;
         // The current best result.
         double best = -std::numeric_limits<double>::infinity();
-        // FIXME: I'm not sure if moving the if inside the for loop will cause the program
-        // to run much slower.
-        if (b.whos_next() == Player::Black) {
-            for (const auto& [x, y] : plc) {
-                Board b2 = b;
-                b2.place(x, y);
-                const Node& node = mNodes[b2];
-                // Unexplored nodes are the most important
-                if (node.n == 0)
-                    return b2;
-                const double curr = double(node.v) / node.n + c * std::sqrt(log_parent / node.n);
-                if (curr > best) {
-                    best = curr;
-                    ans = std::move(b2);
-                }
+        for (std::size_t i = 0; i < plc.size(); i++) {
+            const auto [x, y] = plc[i];
+            Board b2 = b;
+            b2.place(x, y);
+            const Node& node = mNodes[b2];
+            // Proven children need no more simulations. At least one of them
+            // is unproven, or else b would be proven too.
+            if (node.proof)
+                continue;
+            // Unexplored nodes are the most important, unless RAVE or the
+            // priors already have an opinion about them.
+            const long long n = visits(node);
+            if (n == 0 && !puct && (!mOptions.rave || node.amaf_n == 0)) {
+                mov = { x, y };
+                return b2;
+            }
+            // Unexplored children start from the parent's value in PUCT mode.
+            double value = n ? (node.v - sign * mRolloutCnt * node.virtual_loss) / n
+                : parent.n ? parent.v / parent.n : 0;
+            if (mOptions.rave && node.amaf_n) {
+                // The "hand-selected" schedule of Gelly & Silver: RAVE dominates
+                // while the node is young, and fades out around rave_equiv visits.
+                const double k = mOptions.rave_equiv;
+                const double beta = std::sqrt(k / (3 * n + k));
+                value = (1 - beta) * value + beta * node.amaf_v / node.amaf_n;
+            }
+            const double curr = sign * value + (puct
+                ? mOptions.puct * parent.priors[i] * sqrt_parent / (1 + n)
+                : c * std::sqrt(log_parent / std::max(n, 1LL)));
+            if (curr > best) {
+                best = curr;
+                ans = std::move(b2);
+                mov = { x, y };
             }
+        }
+        // Had every child been proven, b would be proven and not get here.
+        assert(mov.first);
+        return ans;
+    }
+
+    bool MCTS::simulate(const std::pair<int, int>* first, Scratch& s) {
+        std::unique_lock lock(mTreeMutex);
+        s.visited.clear();
+        s.path.clear();
+        Board curr = mBoard;
+        int step_cnt = 0;
+        // The squares played in the tree part of the simulation.
+        PlayedSquares tree_played{};
+        if (first) {
+            s.path.push_back(curr);
+            s.visited.insert(curr);
+            tree_played[static_cast<int>(curr.whos_next())] |= std::uint64_t(1) << to_index(first->first, first->second);
+            curr.place(first->first, first->second);
+        }
+        while (!mNodes[curr].is_leaf && s.visited.count(curr) == 0) {
+            // Transpositions may have proven all the children since
+            // the last visit.
+            update_proof(curr);
+            if (mNodes[curr].proof)
+                break;
+            s.path.push_back(curr);
+            s.visited.insert(curr);
+            std::pair<int, int> mov;
+            const Player p = curr.whos_next();
+            curr = select_child(curr, mov);
+            if (mov.first)
+                tree_played[static_cast<int>(p)] |= std::uint64_t(1) << to_index(mov.first, mov.second);
+            ++step_cnt;
+            assert(step_cnt <= 128);
+        }
+        // The path for backtracking includes the leaf node, too.
+        s.path.push_back(curr);
+        for (const auto& b : s.path)
+            ++mNodes[b].virtual_loss;
+        double rollout_result = 0;
+        std::array<PlayedSquares, mRolloutCnt> played;
+        std::array<double, mRolloutCnt> results;
+        played.fill(tree_played);
+        bool solved;
+        try {
+            solved = try_solve(curr, s, lock);
+        } catch (EndgameSolver::Aborted) {
+            // The search is over, so the simulation is dropped.
+            for (const auto& b : s.path)
+                --mNodes[b].virtual_loss;
+            return false;
+        }
+        if (solved) {
+            // A proven leaf counts as that many rollouts with a known result.
+            results.fill(result_value(*mNodes[curr].proof));
+            rollout_result = mRolloutCnt * results[0];
         } else {
-            for (const auto& [x, y] : plc) {
-                Board b2 = b;
-                b2.place(x, y);
-                const Node& node = mNodes[b2];
-                // Unexplored nodes are the most important
-                if (node.n == 0)
-                    return b2;
-                const double curr = 1.0 - double(node.v) / node.n + c * std::sqrt(log_parent / node.n);
-                if (curr > best) {
-                    best = curr;
-                    ans = std::move(b2);
+            add_next(curr);
+            // The leaf is scored without the lock, so that the other threads
+            // can go on meanwhile.
+            lock.unlock();
+            if (mBatch) {
+                // The network's estimate also counts as mRolloutCnt rollouts.
+                const double p = win_probability(mBatch->eval(BitBoard::from_board(curr)));
+                results.fill(curr.whos_next() == Player::Black ? 2 * p - 1 : 1 - 2 * p);
+                rollout_result = mRolloutCnt * results[0];
+            } else {
+                for (int i = 0; i < mRolloutCnt; i++) {
+                    results[i] = rollout(curr, mOptions.rollout_plies, mNnue.get(), mOptions.rave ? &played[i] : nullptr);
+                    rollout_result += results[i];
                 }
             }
+            lock.lock();
         }
-        return ans;
+        // The children come after their parents on the path, so proofs
+        // propagate all the way up in one pass.
+        for (auto it = s.path.rbegin(); it != s.path.rend(); ++it) {
+            Node& node = mNodes[*it];
+            --node.virtual_loss;
+            node.n += mRolloutCnt;
+            node.v += rollout_result;
+            if (mOptions.rave) {
+                for (int i = 0; i < mRolloutCnt; i++)
+                    update_amaf(*it, played[i], results[i]);
+            }
+            update_proof(*it);
+        }
+        return mNodes[mBoard].proof.has_value();
+    }
+
+    double MCTS::root_value(const std::pair<int, int>& mov) {
+        Board b2 = mBoard;
+        b2.place(mov.first, mov.second);
+        const Node& node = mNodes[b2];
+        const Player me = mBoard.whos_next();
+        if (node.proof)
+            return node.proof == win_for(me) ? std::numeric_limits<double>::infinity()
+                : node.proof == loss_for(me) ? -std::numeric_limits<double>::infinity() : 0;
+        if (node.n == 0)
+            return -1;
+        return (me == Player::Black ? 1 : -1) * node.v / node.n;
+    }
+
+    void MCTS::report_value(const std::pair<int, int>& mov) {
+        // The value is the expected result, 1 for a win and -1 for a loss.
+        report_score(probability_score((root_value(mov) + 1) / 2));
+    }
+
+    std::pair<int, int> MCTS::search_halving(std::vector<std::pair<int, int>> cand, unsigned& cnt) {
+        using namespace std::chrono;
+        const auto tp_start = steady_clock::now();
+        const auto budget = milliseconds(mOptions.ms);
+        // The lock is only let go for the simulations.
+        std::unique_lock lock(mTreeMutex);
+        // Every move is simulated directly, so the root only needs its children.
+        add_next(mBoard);
+        update_proof(mBoard);
+        const int rounds = std::max(1, int(std::ceil(std::log2(cand.size()))));
+        const auto by_value = [this](const auto& lhs, const auto& rhs) {
+            return root_value(lhs) > root_value(rhs);
+        };
+        for (int r = 0; r < rounds && cand.size() > 1; r++) {
+            // Each round gets an equal share of the budget, spread evenly
+            // over the surviving moves by visiting them in turn.
+            const auto tp_round = tp_start + budget * (r + 1) / rounds;
+            const unsigned cnt_round = mOptions.playouts
+                ? unsigned(mOptions.playouts * (r + 1) / rounds) : std::numeric_limits<unsigned>::max();
+            while (steady_clock::now() < tp_round && cnt < cnt_round
+                && !mCancel.load(std::memory_order_acquire)) {
+                bool all_proven = true;
+                for (const auto& mov : cand) {
+                    Board b2 = mBoard;
+                    b2.place(mov.first, mov.second);
+                    // Proven moves need no more simulations.
+                    if (mNodes[b2].proof)
+                        continue;
+                    all_proven = false;
+                    lock.unlock();
+                    simulate(&mov, mScratch);
+                    lock.lock();
+                    ++cnt;
+                }
+                if (all_proven || mNodes[mBoard].proof)
+                    break;
+            }
+            // Keep the better half.
+            std::stable_sort(cand.begin(), cand.end(), by_value);
+            cand.resize((cand.size() + 1) / 2);
+        }
+        std::stable_sort(cand.begin(), cand.end(), by_value);
+        return cand.front();
     }
 
     std::pair<int, int> MCTS::do_make_move() {
         using namespace std::chrono;
-        time_point tp_end = steady_clock::now() + seconds(1);
+        time_point tp_end = steady_clock::now() + milliseconds(mOptions.ms);
         const auto legal_moves = mBoard.get_placable();
         if (legal_moves.empty())
             return {0, 0};
+        if (mBook) {
+            if (const auto m = mBook->best_move(BitBoard::from_board(mBoard))) {
+                report_score(m->score);
+                std::cerr << "book move, score " << m->score << ", " << m->visits << " games\n";
+                return from_index(m->sq);
+            }
+        }
+        mDeadline = tp_end;
+        if (mOptions.solve_empties) {
+            // Near the end of the game, just play the perfect move, if the
+            // solver finds it in half the time. Otherwise the tree search
+            // gets the rest.
+            const BitBoard bb = BitBoard::from_board(mBoard);
+            if (bb.empties() <= mOptions.solve_empties) {
+                EndgameSolver& sol = solver(mScratch);
+                sol.set_deadline(steady_clock::now() + milliseconds(mOptions.ms) / 2);
+                try {
+                    const auto res = sol.solve(bb);
+                    report_score(res.score);
+                    return from_index(res.move);
+                } catch (EndgameSolver::Aborted) {
+                    if (mCancel.load(std::memory_order_acquire))
+                        throw OperationCanceled();
+                    std::cerr << "no time to solve " << bb.empties() << " empties\n";
+                }
+            }
+        }
         // First we add the initial position to the table. It's the root node
         // of the MCTS tree.
         // If the instance has explored this position in previous games, we just
         // take that and build our computation on top of it.
-        mNodes.emplace(mBoard, Node());
-        // The stack for backtracing
-        std::stack<Board> st;
-        // To avoid the situation mentioned above. Without the vis the 
-        std::unordered_set<Board> vis;
+        // The tree is locked whenever the search threads aren't running, for
+        // save_state().
+        std::unique_lock lock(mTreeMutex);
+        add_node(mBoard);
         unsigned cnt = 0;
-        while (steady_clock::now() < tp_end && !mCancel.load(std::memory_order_acquire)) {
-            ++cnt;
-            vis.clear();
-            Board curr = mBoard;
-            int step_cnt = 0;
-            while (!mNodes[curr].is_leaf && vis.count(curr) == 0) {
-                st.push(curr);
-                vis.insert(curr);
-                curr = select_child(curr);
-                ++step_cnt;
-                assert(step_cnt <= 128);
-            }
-            // The stack for backtracking includes the leaf node, too.
-            st.push(curr);
-            add_next(curr);
-            int rollout_result = 0;
-            for (int i = 0; i < mRolloutCnt; i++)
-                rollout_result += rollout(curr);
-            while (!st.empty()) {
-                Node& node = mNodes[st.top()];
-                node.n += mRolloutCnt;
-                node.v += rollout_result;
-                st.pop();
-            }
+        if (mOptions.root == RootPolicy::Halving) {
+            lock.unlock();
+            const auto ans = search_halving(legal_moves, cnt);
+            lock.lock();
+            std::cerr << cnt << " cycles done, " << mNodes.size() << " nodes in table\n";
+            if (mCancel.load(std::memory_order_acquire))
+                throw OperationCanceled();
+            report_value(ans);
+            return ans;
         }
+        const auto batch_stats = mBatch ? mBatch->stats() : BatchEvaluator::Stats();
+        const auto tp_start = steady_clock::now();
+        std::atomic<unsigned> started = 0;
+        std::atomic_bool proven = mNodes[mBoard].proof.has_value();
+        // The tree may be left from earlier moves.
+        const long long root_visits = mNodes[mBoard].n;
+        lock.unlock();
+        const auto search = [&](Scratch& s) {
+            // Once the root is proven, there is nothing left to search for.
+            while (steady_clock::now() < tp_end && !mCancel.load(std::memory_order_acquire)
+                && !proven.load(std::memory_order_relaxed)
+                && (!mOptions.playouts || started++ < unsigned(mOptions.playouts))) {
+                if (simulate(nullptr, s))
+                    proven.store(true, std::memory_order_relaxed);
+            }
+        };
+        std::vector<Scratch> scratch(mOptions.threads - 1);
+        TaskGroup helpers;
+        for (auto& s : scratch)
+            helpers.run([&search, &s] { search(s); });
+        search(mScratch);
+        helpers.wait();
+        lock.lock();
+        cnt = unsigned((mNodes[mBoard].n - root_visits) / mRolloutCnt);
         std::cerr << cnt << " cycles done, " << mNodes.size() << " nodes in table\n";
+        if (mBatch) {
+            const auto stats = mBatch->stats();
+            const auto batches = stats.batches - batch_stats.batches, positions = stats.positions - batch_stats.positions;
+            std::cerr << "batch " << mOptions.batch << ": " << positions << " positions in " << batches << " batches ("
+                << stats.full - batch_stats.full << " full), "
+                << std::lround(positions / duration<double>(steady_clock::now() - tp_start).count()) << " positions/s\n";
+        }
         if (mCancel.load(std::memory_order_acquire))
             throw OperationCanceled();
+        const Player me = mBoard.whos_next();
         std::pair<int, int> ans;
-        int max_visits = -1;
+        long long max_visits = -2;
         for (const auto& [x, y] : legal_moves) {
             Board b2 = mBoard;
             b2.place(x, y);
-            if (const int curr_visits = mNodes[b2].n; curr_visits > max_visits) {
+            const Node& node = mNodes[b2];
+            if (node.proof == win_for(me)) {
+                ans = { x, y };
+                break;
+            }
+            // Proven losses are only played when every move loses.
+            const long long curr_visits = node.proof == loss_for(me) ? -1 : node.n;
+            if (curr_visits > max_visits) {
                 max_visits = curr_visits;
                 ans = { x, y };
             }
         }
+        report_value(ans);
         return ans;
     }
 }
\ No newline at end of file
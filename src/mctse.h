@@ -2,46 +2,265 @@
 #ifndef REVERSI_MCTSE_H
 #define REVERSI_MCTSE_H
 #include "engi.h"
+#include "endgame.h"
+#include "nnue.h"
+#include "batch_eval.h"
+#include "book.h"
+#include "mapped_file.h"
+#include <optional>
 #include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <array>
+#include <vector>
+#include <cstdint>
 
 namespace Reversi {
     class MCTS : public Engine {
-        // The random generator used by rollout.
-        static std::function<int()> mRandGen;
+    public:
+        // How the simulations are spread over the moves at the root.
+        enum class RootPolicy {
+            // The same UCB/PUCT selection as in the rest of the tree.
+            UCB,
+            // Sequential halving: the budget is split into rounds, each round
+            // spreads its share evenly over the surviving moves and then
+            // drops the worse half. Better at small budgets.
+            Halving
+        };
+
+        // Tunables of the search, settable from the engine description
+        // (e.g. "MCTSe:rave=1").
+        struct Options {
+            // Blends all-moves-as-first statistics into the selection (RAVE).
+            bool rave = false;
+            // The number of visits at which the AMAF and the UCT values get
+            // equal weight in the beta schedule.
+            double rave_equiv = 1000;
+            // Leaves with at most this many empty squares are solved exactly and
+            // the proven results are propagated up the tree (MCTS-Solver),
+            // unless the solve runs out of time (see LEAF_SOLVE_SHARE).
+            // 0 disables the solver, and at most 24 are allowed.
+            int solve_empties = 0;
+            // Rollouts stop after this many moves and score the position with
+            // quick_eval() instead of playing to the end. 0 plays to the end.
+            int rollout_plies = 0;
+            // A network file to score truncated rollouts with, instead of
+            // quick_eval().
+            std::string nnue;
+            // The exploration constant of the PUCT formula, which weighs the
+            // exploration of each child by a prior from move_order_score().
+            // 0 uses plain UCB1 without priors.
+            double puct = 0;
+            // The policy at the root ("root=ucb" or "root=halving").
+            RootPolicy root = RootPolicy::UCB;
+            // The thinking time per move, in milliseconds.
+            int ms = 1000;
+            // The maximum number of simulations per move, 0 for no limit.
+            // Whichever of ms and playouts runs out first ends the search.
+            int playouts = 0;
+            // The number of threads that run simulations on the shared tree.
+            // Virtual losses keep them on different paths.
+            int threads = 1;
+            // If positive, leaves are scored by the network alone instead of
+            // rollouts, `batch` positions at a time: the threads queue their
+            // leaves, and a batch is evaluated once it is full or its oldest
+            // leaf has waited batch_us microseconds. At most `threads`.
+            int batch = 0;
+            int batch_us = 1000;
+            // An opening book to play from while it knows the position.
+            std::string book;
+            // A file to cache the solver's results in across runs (see
+            // SolveCache). Needs solve_empties.
+            std::string cache;
+            // A file to keep the top of the tree in across runs: the nodes
+            // with at least tree_visits simulations are written to it when
+            // the engine is destroyed or save_state() is called, and seed the
+            // statistics of the same positions when the next engine creates
+            // them.
+            std::string tree;
+            int tree_visits = 100;
+
+            // Reads the options, throwing ReversiError on unknown keys or bad values.
+            static Options from_description(const EngineDescription& desc);
+
+            // Writes the options that differ from the defaults into `desc`.
+            void to_description(EngineDescription& desc) const;
+        };
+
+    private:
+        // The random generator used by rollout, one per thread.
+        static thread_local std::function<int()> mRandGen;
 
         static constexpr int mRolloutCnt = 10;
 
         struct Node {
-            // v is the value for black
-            long long v = 0, n = 0;
+            // v is the value for black, the sum of the rollout results in [-1, 1]
+            double v = 0;
+            long long n = 0;
+            // All-moves-as-first statistics of the move leading to this node,
+            // also for black. Only maintained in RAVE mode.
+            double amaf_v = 0;
+            long long amaf_n = 0;
+            // The prior probabilities of the moves from this node, in the order
+            // of get_placable(), set by its expansion. They belong to the
+            // edges, since a position reached by several moves may be worth
+            // more after one of them. Only maintained in PUCT mode.
+            std::vector<float> priors;
+            // The simulations in flight through this node, each of which
+            // counts as a loss for the player choosing it until it is backed up.
+            int virtual_loss = 0;
             bool is_leaf = true;
+            // The game theoretic result, once the solver or the children have
+            // proven it.
+            std::optional<MatchResult> proof;
         };
 
+        // Bit (x - 1) * 8 + (y - 1) is set for each square that a player occupied
+        // during a simulation, indexed by Player.
+        using PlayedSquares = std::array<std::uint64_t, 2>;
+
+        const Options mOptions;
+
         // The list of nodes. This can be retained across searches.
         std::unordered_map<Board, Node> mNodes;
 
-        // Purely random rollout of the position b. Returns the results.
-        static int rollout(Board b);
+        // The hash table of the solvers, shared by the threads in
+        // MCTS-Solver mode, and the solve cache, or null.
+        std::shared_ptr<TransTable> mSolverTable;
+        std::shared_ptr<SolveCache> mSolveCache;
+
+        // Scores truncated rollouts or, with mBatch, the leaves.
+        std::unique_ptr<const NnueNetwork> mNnue;
+        std::unique_ptr<BatchEvaluator> mBatch;
+
+        // The opening book, or null.
+        std::unique_ptr<const OpeningBook> mBook;
+
+        // The tree written by an earlier engine, mapped, or null if there was
+        // none. The file is the magic "RVMT", the format version as a little
+        // endian 32 bit integer and the number of records as a little endian
+        // 64 bit integer, followed by records of SAVED_SIZE bytes sorted by
+        // position:
+        //  - own and opp of the canonical position (see canonical()), little
+        //    endian 64 bit integers,
+        //  - n / mRolloutCnt, the mean value, amaf_n and the mean AMAF value,
+        //    as little endian 32 bit integers and floats, with the values for
+        //    the player to move so that the colors don't matter,
+        //  - the proof as a byte (0 for none, then a win, a loss or a draw
+        //    for the player to move), and three zero bytes. Proofs are only
+        //    read back by engines with the solver.
+        static constexpr std::size_t SAVED_HEADER_SIZE = 16, SAVED_SIZE = 36;
+        std::unique_ptr<MappedFile> mSavedTree;
+        std::size_t mSavedCount = 0;
+
+        // Guards mNodes and mSavedTree while several threads search, and
+        // against save_state().
+        std::mutex mTreeMutex;
+
+        // Scratch space of simulate(), one per thread, kept to save
+        // allocations: the path for backtracking, and the positions on it to
+        // detect cycles.
+        // Each thread also solves with a solver of its own, made the first
+        // time it is needed.
+        struct Scratch {
+            std::vector<Board> path;
+            std::unordered_set<Board> visited;
+            std::unique_ptr<EndgameSolver> solver;
+        };
+
+        // The scratch space of the engine's task.
+        Scratch mScratch;
+
+        // When the current move's thinking time is up. Set before the
+        // search threads start.
+        std::chrono::steady_clock::time_point mDeadline;
+
+        // A leaf solve may take at most this share of the thinking time
+        // (1 / LEAF_SOLVE_SHARE), after which the leaf is rolled out instead.
+        static constexpr int LEAF_SOLVE_SHARE = 8;
+
+        // Purely random rollout of the position b. Returns the result for black:
+        // 1 for a win, -1 for a loss, and the expected value if the rollout is
+        // truncated after `plies` moves (0 for no truncation), scored by `net`
+        // or quick_eval() if it is null.
+        // If `played` is not null, the squares each side plays are or-ed into it.
+        static double rollout(Board b, int plies, const NnueNetwork* net, PlayedSquares* played = nullptr);
+
+        // Credits the result of one simulation to the AMAF statistics of the
+        // children of `b` whose move the player to move at `b` made during it.
+        void update_amaf(const Board& b, const PlayedSquares& played, double result);
+
+        // Maps the tree file at `path` and stores its number of records in
+        // `count`, or returns null if there is no such file.
+        static std::unique_ptr<MappedFile> map_tree(const std::string& path, std::size_t& count);
+
+        // Adds a node for b, unless there is one already. Its statistics come
+        // from the saved tree if b is in it.
+        void add_node(const Board& b);
 
         // Adds all the possible next moves to the mNodes dictionary, then
-        // clears the "is_leaf" flag for b.
+        // clears the "is_leaf" flag for b. In PUCT mode, the priors of all the
+        // moves are computed here in one go.
         // Requires that b is in mNodes.
         void add_next(const Board& b);
 
+        // The solver of the thread with scratch space `s`.
+        EndgameSolver& solver(Scratch& s);
+
+        // Solves b exactly with the solver of `s` if it has at most
+        // solve_empties empties, marking the node as proven. Returns whether
+        // the node is proven afterwards, which it isn't if the solve ran out
+        // of time. `lock` holds mTreeMutex, and is let go during the solve.
+        // Throws EndgameSolver::Aborted, with the lock held, if the search is
+        // canceled meanwhile.
+        bool try_solve(const Board& b, Scratch& s, std::unique_lock<std::mutex>& lock);
+
+        // Proves the non-leaf b from its children if possible: a winning
+        // child proves a win, and so do all children being proven.
+        void update_proof(const Board& b);
+
         // Assuming that the node pointed to by `b` is not a leaf node,
-        // Selects a child node to investigate.
-        Board select_child(const Board& b);
+        // Selects a child node to investigate. Proven children are skipped, so
+        // b itself must not be proven. The move leading to it is stored
+        // in `mov`, (0, 0) for a skip.
+        Board select_child(const Board& b, std::pair<int, int>& mov);
+
+        // Runs one simulation from mBoard and backs up its result. If `first`
+        // isn't null, the move at the root is `*first` instead of being selected.
+        // Returns whether the root is proven. Safe to run on several threads,
+        // each with its own scratch space: the tree is only touched under
+        // mTreeMutex, and the leaf is scored without it.
+        bool simulate(const std::pair<int, int>* first, Scratch& s);
+
+        // The mean value of the root move `mov` for the player to move at the
+        // root. Proven wins and losses are infinite.
+        double root_value(const std::pair<int, int>& mov);
+
+        // Reports root_value() of the move to play as a disc difference, by
+        // the score its chance of winning stands for.
+        void report_value(const std::pair<int, int>& mov);
+
+        // Sequential halving over the candidate moves at the root. Returns the
+        // best move and adds the number of simulations to `cnt`.
+        std::pair<int, int> search_halving(std::vector<std::pair<int, int>> cand, unsigned& cnt);
 
         virtual std::pair<int, int> do_make_move() override;
 
     public:
-        MCTS() = default;
+        MCTS();
+
+        explicit MCTS(Options opt);
+
+        // Saves the tree if the options ask for it.
+        virtual ~MCTS() noexcept;
 
-        virtual ~MCTS() noexcept = default;
+        virtual std::string get_name() override;
 
-        virtual inline std::string get_name() override {
-            return "MCTSe";
-        }
+        // Writes the top of the tree to the tree file, merged with what the
+        // file holds by then. Engines sharing the file take turns through a
+        // lock on FILE.lock, and of two records of a position the one with
+        // more simulations is kept.
+        virtual void save_state() override;
     };
 }
 
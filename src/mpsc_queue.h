@@ -0,0 +1,145 @@
+// A bounded lock-free queue with many producers and one consumer
+#ifndef REVERSI_MPSC_QUEUE_H
+#define REVERSI_MPSC_QUEUE_H
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace Reversi {
+    // Tells the CPU that the thread is spinning.
+    inline void cpu_relax() noexcept {
+#if defined(_MSC_VER)
+        _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    // A ring of slots, each with a sequence number that says whose turn it is
+    // (D. Vyukov's bounded queue, with a single consumer). Producers claim a
+    // slot with a compare and swap on the tail and publish it by bumping its
+    // sequence; nobody ever waits on a mutex. The consumer spins a little when
+    // the queue is empty, then parks on an atomic until a producer wakes it.
+    // Producers finding it full spin, then yield, until there's room.
+    template <class T>
+    class MpscQueue {
+        struct Slot {
+            std::atomic<std::size_t> seq;
+            T value;
+        };
+
+        const std::size_t mMask;
+        std::unique_ptr<Slot[]> mSlots;
+        // On separate cache lines, since the producers write one and the
+        // consumer the other.
+        alignas(64) std::atomic<std::size_t> mTail = 0;
+        alignas(64) std::size_t mHead = 0;
+        // The consumer parks on mWake while mParked is set.
+        std::atomic_bool mParked = false;
+        std::atomic<std::uint32_t> mWake = 0;
+
+    public:
+        // How often an empty queue is polled before the consumer parks.
+        static constexpr int SPIN = 200;
+
+        // Holds `capacity` items, rounded up to a power of two.
+        explicit MpscQueue(std::size_t capacity) :
+            mMask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1),
+            mSlots(new Slot[mMask + 1])
+        {
+            for (std::size_t i = 0; i <= mMask; i++)
+                mSlots[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator = (const MpscQueue&) = delete;
+
+        inline std::size_t capacity() const noexcept {
+            return mMask + 1;
+        }
+
+        // (Any thread) Appends v, or returns false if the queue is full.
+        bool try_push(T& v) {
+            std::size_t pos = mTail.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &mSlots[pos & mMask];
+                const std::size_t seq = slot->seq.load(std::memory_order_acquire);
+                const auto diff = std::ptrdiff_t(seq - pos);
+                if (diff == 0) {
+                    if (mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                } else if (diff < 0) {
+                    // The consumer hasn't taken the item a lap ahead.
+                    return false;
+                } else {
+                    pos = mTail.load(std::memory_order_relaxed);
+                }
+            }
+            slot->value = std::move(v);
+            // Sequentially consistent, like the consumer's parking: either
+            // it sees the item, or this sees it parked.
+            slot->seq.store(pos + 1, std::memory_order_seq_cst);
+            if (mParked.load(std::memory_order_seq_cst)) {
+                mWake.fetch_add(1, std::memory_order_relaxed);
+                mWake.notify_one();
+            }
+            return true;
+        }
+
+        // (Any thread) Appends v, waiting for room if the queue is full.
+        void push(T v) {
+            for (int i = 0; !try_push(v); i++) {
+                if (i < SPIN)
+                    cpu_relax();
+                else
+                    std::this_thread::yield();
+            }
+        }
+
+        // (The consumer) Takes the oldest item, if any.
+        std::optional<T> try_pop() {
+            Slot& slot = mSlots[mHead & mMask];
+            if (slot.seq.load(std::memory_order_seq_cst) != mHead + 1)
+                return std::nullopt;
+            std::optional<T> ans(std::move(slot.value));
+            // The slot is free for the producer one lap on.
+            slot.seq.store(mHead + mMask + 1, std::memory_order_release);
+            ++mHead;
+            return ans;
+        }
+
+        // (The consumer) Takes the oldest item, waiting for one if needed.
+        T pop() {
+            while (true) {
+                for (int i = 0; i < SPIN; i++) {
+                    if (auto v = try_pop())
+                        return std::move(*v);
+                    cpu_relax();
+                }
+                // Read before parking, so that a wake up after it isn't missed.
+                const std::uint32_t wake = mWake.load(std::memory_order_acquire);
+                mParked.store(true, std::memory_order_seq_cst);
+                auto v = try_pop();
+                if (!v)
+                    mWake.wait(wake, std::memory_order_relaxed);
+                mParked.store(false, std::memory_order_relaxed);
+                if (v)
+                    return std::move(*v);
+            }
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,309 @@
+#include "nnue.h"
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <type_traits>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace Reversi {
+    namespace {
+        constexpr char MAGIC[4] = { 'R', 'V', 'N', 'N' };
+        constexpr std::uint32_t VERSION = 1;
+
+        using Accumulator = std::array<std::int16_t, NnueNetwork::HIDDEN>;
+
+        // The int16 arithmetic wraps, which keeps incremental updates exact.
+        // GCC doesn't vectorize these loops at -O2 once they are inlined into
+        // the updates, so AVX2 is spelled out.
+        void add(Accumulator& acc, const std::int16_t* col) noexcept {
+#if defined(__AVX2__)
+            for (int i = 0; i < NnueNetwork::HIDDEN; i += 16) {
+                __m256i* p = reinterpret_cast<__m256i*>(&acc[i]);
+                _mm256_storeu_si256(p, _mm256_add_epi16(_mm256_loadu_si256(p),
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(col + i))));
+            }
+#else
+            for (int i = 0; i < NnueNetwork::HIDDEN; i++)
+                acc[i] = std::int16_t(acc[i] + col[i]);
+#endif
+        }
+
+        void sub(Accumulator& acc, const std::int16_t* col) noexcept {
+#if defined(__AVX2__)
+            for (int i = 0; i < NnueNetwork::HIDDEN; i += 16) {
+                __m256i* p = reinterpret_cast<__m256i*>(&acc[i]);
+                _mm256_storeu_si256(p, _mm256_sub_epi16(_mm256_loadu_si256(p),
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(col + i))));
+            }
+#else
+            for (int i = 0; i < NnueNetwork::HIDDEN; i++)
+                acc[i] = std::int16_t(acc[i] - col[i]);
+#endif
+        }
+
+        // Clips the accumulator to [0, 127] into out[0, HIDDEN).
+        void clip(const Accumulator& acc, std::uint8_t* out) noexcept {
+#if defined(__AVX2__)
+            const __m256i zero = _mm256_setzero_si256();
+            for (int i = 0; i < NnueNetwork::HIDDEN; i += 32) {
+                const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&acc[i]));
+                const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&acc[i + 16]));
+                // packs saturates to [-128, 127] but interleaves the 128 bit
+                // lanes, which the permutation puts back in order.
+                const __m256i packed = _mm256_max_epi8(_mm256_packs_epi16(lo, hi), zero);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+            }
+#else
+            for (int i = 0; i < NnueNetwork::HIDDEN; i++)
+                out[i] = std::uint8_t(std::clamp<int>(acc[i], 0, 127));
+#endif
+        }
+
+        // The dot product of n activations with n weights. n is a multiple of 32.
+        std::int32_t dot(const std::uint8_t* a, const std::int8_t* w, int n) noexcept {
+#if defined(__AVX2__)
+            // maddubs can't saturate: two products of 127 and -128 fit in 16 bits.
+            const __m256i ones = _mm256_set1_epi16(1);
+            __m256i sum = _mm256_setzero_si256();
+            for (int i = 0; i < n; i += 32) {
+                const __m256i prod = _mm256_maddubs_epi16(
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i)));
+                sum = _mm256_add_epi32(sum, _mm256_madd_epi16(prod, ones));
+            }
+            __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+            return _mm_cvtsi128_si32(s);
+#else
+            std::int32_t ans = 0;
+            for (int i = 0; i < n; i++)
+                ans += a[i] * w[i];
+            return ans;
+#endif
+        }
+
+        // The dot products of cnt <= 8 activation vectors with the same n
+        // weights, into out. Each load of the weights serves all of them.
+        void dot_many(const std::uint8_t* const* a, int cnt, const std::int8_t* w, int n, std::int32_t* out) noexcept {
+#if defined(__AVX2__)
+            const __m256i ones = _mm256_set1_epi16(1);
+            __m256i sum[8];
+            for (int k = 0; k < cnt; k++)
+                sum[k] = _mm256_setzero_si256();
+            for (int i = 0; i < n; i += 32) {
+                const __m256i wv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+                for (int k = 0; k < cnt; k++) {
+                    const __m256i prod = _mm256_maddubs_epi16(
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a[k] + i)), wv);
+                    sum[k] = _mm256_add_epi32(sum[k], _mm256_madd_epi16(prod, ones));
+                }
+            }
+            for (int k = 0; k < cnt; k++) {
+                __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum[k]), _mm256_extracti128_si256(sum[k], 1));
+                s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+                s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+                out[k] = _mm_cvtsi128_si32(s);
+            }
+#else
+            for (int k = 0; k < cnt; k++)
+                out[k] = dot(a[k], w, n);
+#endif
+        }
+
+        void write_u32(std::ostream& out, std::uint32_t x) {
+            for (int i = 0; i < 4; i++)
+                out.put(char(x >> (8 * i)));
+        }
+
+        std::uint32_t read_u32(std::istream& in) {
+            std::uint32_t ans = 0;
+            for (int i = 0; i < 4; i++)
+                ans |= std::uint32_t(std::uint8_t(in.get())) << (8 * i);
+            return ans;
+        }
+
+        // Little endian integers of any width.
+        template <typename T>
+        void write_all(std::ostream& out, const T* data, std::size_t cnt) {
+            for (std::size_t i = 0; i < cnt; i++) {
+                const auto x = std::make_unsigned_t<T>(data[i]);
+                for (std::size_t k = 0; k < sizeof(T); k++)
+                    out.put(char(x >> (8 * k)));
+            }
+        }
+
+        template <typename T>
+        void read_all(std::istream& in, T* data, std::size_t cnt) {
+            for (std::size_t i = 0; i < cnt; i++) {
+                std::make_unsigned_t<T> x = 0;
+                for (std::size_t k = 0; k < sizeof(T); k++)
+                    x |= std::make_unsigned_t<T>(std::uint8_t(in.get())) << (8 * k);
+                data[i] = T(x);
+            }
+        }
+    }
+
+    NnueNetwork::NnueNetwork() : mFeatureWeights(INPUTS * HIDDEN), mFeatureBias(HIDDEN),
+        mFlipDelta(64 * HIDDEN), mHiddenWeights(L2 * 2 * HIDDEN), mHiddenBias(L2), mOutputWeights(L2) {}
+
+    void NnueNetwork::update_flip_delta() noexcept {
+        for (int sq = 0; sq < 64; sq++) {
+            for (int i = 0; i < HIDDEN; i++)
+                mFlipDelta[sq * HIDDEN + i] = std::int16_t(mFeatureWeights[input(sq, 0) * HIDDEN + i]
+                    - mFeatureWeights[input(sq, 1) * HIDDEN + i]);
+        }
+    }
+
+    NnueNetwork NnueNetwork::random(unsigned seed) {
+        std::mt19937 mt(seed);
+        const auto uniform = [&](int lo, int hi) {
+            return std::uniform_int_distribution(lo, hi)(mt);
+        };
+        NnueNetwork ans;
+        // About 10 discs are on for each viewer at the start, so these keep
+        // most of the accumulator within the clipping range.
+        for (auto& w : ans.mFeatureWeights)
+            w = std::int16_t(uniform(-12, 16));
+        for (auto& w : ans.mFeatureBias)
+            w = std::int16_t(uniform(-20, 40));
+        for (auto& w : ans.mHiddenWeights)
+            w = std::int8_t(uniform(-64, 64));
+        for (auto& w : ans.mHiddenBias)
+            w = uniform(-2000, 4000);
+        for (auto& w : ans.mOutputWeights)
+            w = std::int8_t(uniform(-128, 127));
+        ans.mOutputBias = uniform(-1000, 1000);
+        ans.update_flip_delta();
+        return ans;
+    }
+
+    NnueNetwork NnueNetwork::load(const std::string& path) {
+        std::ifstream fin(path, std::ios::binary);
+        if (!fin)
+            throw ReversiError("Can't open network file " + path);
+        char magic[4] = {};
+        fin.read(magic, 4);
+        if (!std::equal(magic, magic + 4, MAGIC) || read_u32(fin) != VERSION || read_u32(fin) != INPUTS
+            || read_u32(fin) != HIDDEN || read_u32(fin) != L2)
+            throw ReversiError(path + " is not a network file of this version");
+        NnueNetwork ans;
+        read_all(fin, ans.mFeatureWeights.data(), ans.mFeatureWeights.size());
+        read_all(fin, ans.mFeatureBias.data(), ans.mFeatureBias.size());
+        read_all(fin, ans.mHiddenWeights.data(), ans.mHiddenWeights.size());
+        read_all(fin, ans.mHiddenBias.data(), ans.mHiddenBias.size());
+        read_all(fin, ans.mOutputWeights.data(), ans.mOutputWeights.size());
+        read_all(fin, &ans.mOutputBias, 1);
+        if (!fin)
+            throw ReversiError(path + " is truncated");
+        ans.update_flip_delta();
+        return ans;
+    }
+
+    void NnueNetwork::save(const std::string& path) const {
+        std::ofstream fout(path, std::ios::binary);
+        fout.write(MAGIC, 4);
+        write_u32(fout, VERSION);
+        write_u32(fout, INPUTS);
+        write_u32(fout, HIDDEN);
+        write_u32(fout, L2);
+        write_all(fout, mFeatureWeights.data(), mFeatureWeights.size());
+        write_all(fout, mFeatureBias.data(), mFeatureBias.size());
+        write_all(fout, mHiddenWeights.data(), mHiddenWeights.size());
+        write_all(fout, mHiddenBias.data(), mHiddenBias.size());
+        write_all(fout, mOutputWeights.data(), mOutputWeights.size());
+        write_all(fout, &mOutputBias, 1);
+        if (!fout)
+            throw ReversiError("Can't write network file " + path);
+    }
+
+    int NnueNetwork::eval(const NnueAccumulator& acc) const noexcept {
+        alignas(32) std::uint8_t act[2 * HIDDEN];
+        clip(acc.mAcc[acc.mTurn], act);
+        clip(acc.mAcc[acc.mTurn ^ 1], act + HIDDEN);
+        alignas(32) std::uint8_t hidden[L2];
+        for (int j = 0; j < L2; j++) {
+            const std::int32_t z = dot(act, &mHiddenWeights[j * 2 * HIDDEN], 2 * HIDDEN) + mHiddenBias[j];
+            hidden[j] = std::uint8_t(std::clamp(z >> WEIGHT_SHIFT, 0, 127));
+        }
+        return (dot(hidden, mOutputWeights.data(), L2) + mOutputBias) / OUTPUT_SCALE;
+    }
+
+    int NnueNetwork::eval(const BitBoard& b) const noexcept {
+        return eval(NnueAccumulator(*this, b));
+    }
+
+    void NnueNetwork::eval_batch(const BitBoard* b, int* out, std::size_t cnt) const noexcept {
+        constexpr int CHUNK = 8;
+        alignas(32) std::uint8_t act[CHUNK][2 * HIDDEN], hidden[CHUNK][L2];
+        const std::uint8_t* act_ptr[CHUNK];
+        const std::uint8_t* hidden_ptr[CHUNK];
+        for (int k = 0; k < CHUNK; k++) {
+            act_ptr[k] = act[k];
+            hidden_ptr[k] = hidden[k];
+        }
+        for (std::size_t start = 0; start < cnt; start += CHUNK) {
+            const int n = int(std::min<std::size_t>(CHUNK, cnt - start));
+            for (int k = 0; k < n; k++) {
+                const NnueAccumulator acc(*this, b[start + k]);
+                clip(acc.mAcc[0], act[k]);
+                clip(acc.mAcc[1], act[k] + HIDDEN);
+            }
+            std::int32_t z[CHUNK];
+            for (int j = 0; j < L2; j++) {
+                dot_many(act_ptr, n, &mHiddenWeights[j * 2 * HIDDEN], 2 * HIDDEN, z);
+                for (int k = 0; k < n; k++)
+                    hidden[k][j] = std::uint8_t(std::clamp((z[k] + mHiddenBias[j]) >> WEIGHT_SHIFT, 0, 127));
+            }
+            dot_many(hidden_ptr, n, mOutputWeights.data(), L2, z);
+            for (int k = 0; k < n; k++)
+                out[start + k] = (z[k] + mOutputBias) / OUTPUT_SCALE;
+        }
+    }
+
+    NnueAccumulator::NnueAccumulator(const NnueNetwork& net, const BitBoard& b) noexcept : mNet(&net) {
+        constexpr int H = NnueNetwork::HIDDEN;
+        std::copy_n(net.mFeatureBias.begin(), H, mAcc[0].begin());
+        mAcc[1] = mAcc[0];
+        for (std::uint64_t own = b.own; own; own &= own - 1) {
+            const int sq = std::countr_zero(own);
+            add(mAcc[0], &net.mFeatureWeights[NnueNetwork::input(sq, 0) * H]);
+            add(mAcc[1], &net.mFeatureWeights[NnueNetwork::input(sq, 1) * H]);
+        }
+        for (std::uint64_t opp = b.opp; opp; opp &= opp - 1) {
+            const int sq = std::countr_zero(opp);
+            add(mAcc[0], &net.mFeatureWeights[NnueNetwork::input(sq, 1) * H]);
+            add(mAcc[1], &net.mFeatureWeights[NnueNetwork::input(sq, 0) * H]);
+        }
+    }
+
+    void NnueAccumulator::play(int sq, std::uint64_t flips) noexcept {
+        constexpr int H = NnueNetwork::HIDDEN;
+        auto& mover = mAcc[mTurn];
+        auto& other = mAcc[mTurn ^ 1];
+        add(mover, &mNet->mFeatureWeights[NnueNetwork::input(sq, 0) * H]);
+        add(other, &mNet->mFeatureWeights[NnueNetwork::input(sq, 1) * H]);
+        for (; flips; flips &= flips - 1) {
+            const std::int16_t* delta = &mNet->mFlipDelta[std::countr_zero(flips) * H];
+            add(mover, delta);
+            sub(other, delta);
+        }
+        mTurn ^= 1;
+    }
+
+    void NnueAccumulator::undo(int sq, std::uint64_t flips) noexcept {
+        constexpr int H = NnueNetwork::HIDDEN;
+        mTurn ^= 1;
+        auto& mover = mAcc[mTurn];
+        auto& other = mAcc[mTurn ^ 1];
+        sub(mover, &mNet->mFeatureWeights[NnueNetwork::input(sq, 0) * H]);
+        sub(other, &mNet->mFeatureWeights[NnueNetwork::input(sq, 1) * H]);
+        for (; flips; flips &= flips - 1) {
+            const std::int16_t* delta = &mNet->mFlipDelta[std::countr_zero(flips) * H];
+            sub(mover, delta);
+            add(other, delta);
+        }
+    }
+}
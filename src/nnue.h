@@ -0,0 +1,119 @@
+// A small quantized neural network evaluation (NNUE)
+#ifndef REVERSI_NNUE_H
+#define REVERSI_NNUE_H
+#include "bitboard.h"
+#include <array>
+#include <string>
+#include <vector>
+
+namespace Reversi {
+    class NnueAccumulator;
+
+    // The network has an input for each square and relation (a disc of the
+    // viewer or of its opponent). The first layer sums the columns of the
+    // inputs that are on into an accumulator of HIDDEN int16 values per
+    // viewer, which moves only change a few columns of. Then:
+    //  - the accumulators of the player to move and of the opponent are
+    //    clipped to [0, 127] into 2 * HIDDEN activations,
+    //  - a dense layer of int8 weights gives L2 outputs, shifted right by
+    //    WEIGHT_SHIFT and clipped to [0, 127] again,
+    //  - a final dense layer of int8 weights gives the score.
+    // With activations at 127 for 1.0 and int8 weights at 64 for 1.0, the
+    // score is in 1/OUTPUT_SCALE discs. The dense layers use AVX2 if the
+    // compiler targets it.
+    class NnueNetwork {
+    public:
+        static constexpr int INPUTS = 128, HIDDEN = 128, L2 = 32;
+        static constexpr int WEIGHT_SHIFT = 6;
+        static constexpr int OUTPUT_SCALE = 127 << WEIGHT_SHIFT;
+
+        // The input of square sq, which holds a disc of the viewer (rel = 0)
+        // or of the opponent (rel = 1).
+        static constexpr int input(int sq, int rel) noexcept {
+            return sq * 2 + rel;
+        }
+
+    private:
+        // INPUTS columns of HIDDEN weights, and the bias.
+        std::vector<std::int16_t> mFeatureWeights, mFeatureBias;
+        // For each square, its column as the viewer's disc minus its column
+        // as the opponent's, which is what flipping it adds for the mover.
+        std::vector<std::int16_t> mFlipDelta;
+        // L2 rows of 2 * HIDDEN weights, and the biases.
+        std::vector<std::int8_t> mHiddenWeights;
+        std::vector<std::int32_t> mHiddenBias;
+        std::vector<std::int8_t> mOutputWeights;
+        std::int32_t mOutputBias = 0;
+
+        friend class NnueAccumulator;
+
+        // Derives mFlipDelta from the feature weights.
+        void update_flip_delta() noexcept;
+
+    public:
+        // All weights zero.
+        NnueNetwork();
+
+        // Small random weights, for tests and benchmarks.
+        static NnueNetwork random(unsigned seed);
+
+        // Reads a network written by save(), throwing ReversiError if it
+        // can't be read or doesn't look like one.
+        static NnueNetwork load(const std::string& path);
+
+        // Writes the magic "RVNN", the format version, INPUTS, HIDDEN and L2
+        // as little endian 32 bit integers, then little endian: the feature
+        // weights column by column (int16), the feature bias (int16), the
+        // hidden weights row by row (int8), the hidden biases (int32), the
+        // output weights (int8) and the output bias (int32).
+        void save(const std::string& path) const;
+
+        // The evaluation in discs for the player to move, from the
+        // accumulator of the position.
+        int eval(const NnueAccumulator& acc) const noexcept;
+
+        // The same, computing the accumulator from scratch.
+        int eval(const BitBoard& b) const noexcept;
+
+        // Evaluates cnt positions into out, as eval(b[i]) would. The dense
+        // layers go through several positions at once, so that each load of
+        // the weights serves all of them.
+        void eval_batch(const BitBoard* b, int* out, std::size_t cnt) const noexcept;
+    };
+
+    // The first layer of a network for a position, seen from both sides.
+    // Like PatternState, it follows the moves of a search incrementally.
+    class NnueAccumulator {
+        const NnueNetwork* mNet = nullptr;
+        // mAcc[v] is the accumulator of viewer v. mTurn is the viewer to move.
+        std::array<std::array<std::int16_t, NnueNetwork::HIDDEN>, 2> mAcc;
+        int mTurn = 0;
+
+        friend class NnueNetwork;
+
+    public:
+        // An accumulator that belongs to no network. Assign one before use.
+        NnueAccumulator() = default;
+
+        // The accumulator of b, computed from scratch.
+        NnueAccumulator(const NnueNetwork& net, const BitBoard& b) noexcept;
+
+        // Updates the accumulators for the player to move placing at sq,
+        // which flips `flips`, and hands the turn over.
+        void play(int sq, std::uint64_t flips) noexcept;
+
+        // Takes back play(sq, flips).
+        void undo(int sq, std::uint64_t flips) noexcept;
+
+        // Hands the turn over without playing. Its own undo.
+        inline void pass() noexcept {
+            mTurn ^= 1;
+        }
+
+        friend inline bool operator == (const NnueAccumulator& lhs, const NnueAccumulator& rhs) noexcept {
+            return lhs.mAcc[lhs.mTurn] == rhs.mAcc[rhs.mTurn] && lhs.mAcc[lhs.mTurn ^ 1] == rhs.mAcc[rhs.mTurn ^ 1];
+        }
+    };
+}
+
+#endif
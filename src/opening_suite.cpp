@@ -0,0 +1,173 @@
+#include "opening_suite.h"
+#include "record.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+namespace Reversi {
+    namespace {
+        constexpr char MAGIC[4] = { 'R', 'V', 'O', 'S' };
+        constexpr std::uint32_t VERSION = 1;
+
+        // A line of play, kept inline: with millions of positions a vector's
+        // separate allocation would cost more than the moves.
+        struct Line {
+            std::array<std::uint8_t, OpeningSuite::MAX_ENUMERATE_PLIES> moves{};
+            std::uint8_t size = 0;
+
+            // Lines of the same length compare like their moves.
+            auto operator<=>(const Line&) const noexcept = default;
+        };
+
+        struct PositionHash {
+            std::size_t operator() (const BitBoard& b) const noexcept {
+                return std::size_t(b.hash());
+            }
+        };
+
+        // A position reached from the initial one, as it was played, and the
+        // line that reached it.
+        struct Reached {
+            BitBoard pos;
+            Line line;
+        };
+
+        // A hash map from canonical positions to the least line reaching
+        // them, split in shards with a lock each, so that threads inserting
+        // different positions seldom wait for each other.
+        class ShardedMap {
+            static constexpr int SHARDS = 256;
+
+            struct Shard {
+                std::mutex mutex;
+                std::unordered_map<BitBoard, Reached, PositionHash> map;
+            };
+
+            std::array<Shard, SHARDS> mShards;
+
+        public:
+            // (Any thread)
+            void insert(const BitBoard& pos, const Line& line) {
+                const BitBoard key = canonical(pos);
+                // The map buckets by the low bits of the hash, so the shard
+                // takes the high ones.
+                Shard& shard = mShards[key.hash() >> 56];
+                std::lock_guard lock(shard.mutex);
+                const auto [it, added] = shard.map.try_emplace(key, Reached{ pos, line });
+                if (!added && line < it->second.line)
+                    it->second = Reached{ pos, line };
+            }
+
+            // Empties the map into a list in the order of the canonical
+            // positions.
+            std::vector<Reached> take() {
+                std::vector<std::pair<BitBoard, Reached>> all;
+                for (auto& shard : mShards) {
+                    for (auto& [key, r] : shard.map)
+                        all.emplace_back(key, std::move(r));
+                    shard.map.clear();
+                }
+                std::sort(all.begin(), all.end(), [](const auto& lhs, const auto& rhs) {
+                    return lhs.first < rhs.first;
+                });
+                std::vector<Reached> ans;
+                ans.reserve(all.size());
+                for (auto& [key, r] : all)
+                    ans.push_back(std::move(r));
+                return ans;
+            }
+        };
+    }
+
+    OpeningSuite::OpeningSuite(const std::string& path) : mFile(path) {
+        const unsigned char* p = mFile.data();
+        if (mFile.size() < HEADER_SIZE || !std::equal(MAGIC, MAGIC + 4, p))
+            throw ReversiError(path + " is not an opening suite");
+        if (read_le(p + 4, 4) != VERSION)
+            throw ReversiError(path + " has an unknown suite format version");
+        mPlies = int(read_le(p + 8, 4));
+        const std::uint64_t cnt = read_le(p + 12, 8);
+        if (mPlies <= 0 || mPlies > 60 || cnt != (mFile.size() - HEADER_SIZE) / mPlies
+            || (mFile.size() - HEADER_SIZE) % mPlies)
+            throw ReversiError(path + " is truncated");
+        mSize = std::size_t(cnt);
+    }
+
+    std::vector<std::uint8_t> OpeningSuite::moves(std::size_t i) const {
+        const unsigned char* p = mFile.data() + HEADER_SIZE + i * mPlies;
+        return std::vector<std::uint8_t>(p, p + mPlies);
+    }
+
+    std::vector<std::pair<int, int>> OpeningSuite::annotation(std::size_t i) const {
+        std::vector<std::pair<int, int>> ans;
+        for (const std::uint8_t sq : moves(i))
+            ans.push_back(sq == GameRecord::PASS ? std::pair(0, 0) : from_index(sq));
+        return ans;
+    }
+
+    void OpeningSuite::write(const std::string& path, int plies, const std::vector<std::vector<std::uint8_t>>& openings) {
+        for (const auto& line : openings) {
+            if (int(line.size()) != plies)
+                throw ReversiError("All openings of a suite have the same number of plies");
+        }
+        std::ofstream out(path, std::ios::binary);
+        if (!out)
+            throw ReversiError("Can't create " + path);
+        out.write(MAGIC, 4);
+        write_le(out, VERSION, 4);
+        write_le(out, std::uint32_t(plies), 4);
+        write_le(out, openings.size(), 8);
+        for (const auto& line : openings)
+            out.write(reinterpret_cast<const char*>(line.data()), std::streamsize(line.size()));
+        out.close();
+        if (!out)
+            throw ReversiError("Error writing " + path);
+    }
+
+    std::vector<std::vector<std::uint8_t>> OpeningSuite::enumerate(int plies) {
+        if (plies > MAX_ENUMERATE_PLIES)
+            throw ReversiError("Can't enumerate more than " + std::to_string(MAX_ENUMERATE_PLIES) + " plies");
+        std::vector<Reached> frontier{ { BitBoard::from_board(Board()), {} } };
+        ShardedMap next;
+        for (int ply = 0; ply < plies; ply++) {
+            // A few tasks per worker, so that they even out.
+            const std::size_t chunk = frontier.size() / (4 * ThreadPool::global().size()) + 1;
+            TaskGroup tasks;
+            for (std::size_t begin = 0; begin < frontier.size(); begin += chunk) {
+                tasks.run([&, begin] {
+                    const std::size_t end = std::min(frontier.size(), begin + chunk);
+                    for (std::size_t i = begin; i < end; i++) {
+                        const auto& [pos, line] = frontier[i];
+                        Line child = line;
+                        std::uint8_t& last = child.moves[child.size++];
+                        std::uint64_t moves = pos.moves();
+                        if (!moves) {
+                            // A skip, unless the game is over.
+                            if (pos.pass().moves()) {
+                                last = GameRecord::PASS;
+                                next.insert(pos.pass(), child);
+                            }
+                            continue;
+                        }
+                        for (; moves; moves &= moves - 1) {
+                            const int sq = std::countr_zero(moves);
+                            last = std::uint8_t(sq);
+                            next.insert(pos.play(sq), child);
+                        }
+                    }
+                });
+            }
+            tasks.wait();
+            frontier = next.take();
+        }
+        std::vector<std::vector<std::uint8_t>> ans;
+        ans.reserve(frontier.size());
+        for (const auto& r : frontier)
+            ans.emplace_back(r.line.moves.begin(), r.line.moves.begin() + r.line.size);
+        return ans;
+    }
+}
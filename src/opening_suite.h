@@ -0,0 +1,67 @@
+// Suites of openings for engine matches
+#ifndef REVERSI_OPENING_SUITE_H
+#define REVERSI_OPENING_SUITE_H
+#include "mapped_file.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Reversi {
+    // A suite file, read in place. The file is the magic "RVOS", the format
+    // version and the number of plies n as little endian 32 bit integers and
+    // the number of openings as a little endian 64 bit integer, followed by
+    // the openings of n bytes each: the moves from the initial position as
+    // square indices (see to_index()), or GameRecord::PASS for a skip.
+    class OpeningSuite {
+    public:
+        static constexpr std::size_t HEADER_SIZE = 20;
+        // The most plies enumerate() takes. It keeps every position of a ply
+        // in memory, and there are about seven times as many each ply: three
+        // million positions at 10 plies take half a gigabyte, and 11 would take
+        // several.
+        static constexpr int MAX_ENUMERATE_PLIES = 10;
+
+    private:
+        MappedFile mFile;
+        int mPlies = 0;
+        std::size_t mSize = 0;
+
+    public:
+        // Maps the file, throwing ReversiError if it can't be read or doesn't
+        // look like a suite.
+        explicit OpeningSuite(const std::string& path);
+
+        // The number of openings.
+        inline std::size_t size() const noexcept {
+            return mSize;
+        }
+
+        inline int plies() const noexcept {
+            return mPlies;
+        }
+
+        // The moves of opening i, as square indices or GameRecord::PASS.
+        // They are checked when they are played.
+        std::vector<std::uint8_t> moves(std::size_t i) const;
+
+        // Opening i as an annotation of GameMan, (0, 0) for a skip.
+        std::vector<std::pair<int, int>> annotation(std::size_t i) const;
+
+        // Writes a suite of openings of `plies` moves each. Throws ReversiError
+        // if the file can't be written or an opening has another length.
+        static void write(const std::string& path, int plies, const std::vector<std::vector<std::uint8_t>>& openings);
+
+        // One line of play to each of the positions `plies` plies from the
+        // initial position, with symmetric positions counted once. Lines that
+        // end the game early are left out. The plies are expanded one at a
+        // time on the thread pool, every task putting the positions it reaches
+        // into a hash map split in locked shards. Where several lines reach a
+        // position the least one is kept, so the result doesn't depend on the
+        // timing of the threads. The lines are in the order of their canonical
+        // positions. Throws ReversiError if `plies` is above MAX_ENUMERATE_PLIES.
+        static std::vector<std::vector<std::uint8_t>> enumerate(int plies);
+    };
+}
+
+#endif
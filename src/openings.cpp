@@ -0,0 +1,144 @@
+// Makes an opening suite for match, sprt and selfplay.
+// Usage: openings OUT [--plies=N] [--search=DESC] [--balance=N] [--limit=N]
+//                     [--threads=N] [--seed=N]
+//
+// Every position `plies` plies (default 8) from the start is enumerated on the
+// thread pool, symmetric positions counted once (see OpeningSuite::enumerate).
+// The openings are shuffled with `seed`, so that any prefix of the suite is a
+// fair sample. With --search, each is searched by the engine, which must
+// report scores (AlphaBeta or Solver), and kept only if the score is within
+// `balance` discs (default 4) of even. At most `limit` openings are written,
+// the first ones that pass; the filter stops once it has found enough.
+#include "command_line.h"
+#include "engi.h"
+#include "opening_suite.h"
+#include "record.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Reversi;
+
+struct Options {
+    std::string out;
+    int plies = 8;
+    std::string search;
+    int balance = 4;
+    std::size_t limit = std::size_t(-1);
+    int threads = std::max(1, int(std::thread::hardware_concurrency()));
+    unsigned seed = 1;
+};
+
+static Options parse_options(int argc, char** argv) {
+    Options ans;
+    const auto cl = CommandLine::parse(argc, argv);
+    cl.check_keys({ "plies", "search", "balance", "limit", "threads", "seed" });
+    if (cl.positional.size() > 1)
+        throw ReversiError("Only one output file: " + cl.positional[1]);
+    if (!cl.positional.empty())
+        ans.out = cl.positional.front();
+    ans.plies = cl.get_int("plies", ans.plies);
+    ans.search = cl.get_string("search", ans.search);
+    ans.balance = cl.get_int("balance", ans.balance);
+    ans.limit = std::size_t(cl.get_unsigned("limit", ans.limit));
+    ans.threads = cl.get_int("threads", ans.threads);
+    ans.seed = unsigned(cl.get_unsigned("seed", ans.seed));
+    if (ans.out.empty())
+        throw ReversiError("Usage: openings OUT [--plies=N] [--search=DESC] [--balance=N] [--limit=N]"
+            " [--threads=N] [--seed=N]");
+    if (ans.plies <= 0 || ans.plies > OpeningSuite::MAX_ENUMERATE_PLIES)
+        throw ReversiError("plies should be from 1 to " + std::to_string(OpeningSuite::MAX_ENUMERATE_PLIES));
+    if (ans.balance < 0 || ans.threads <= 0)
+        throw ReversiError("balance can't be negative, threads should be positive");
+    return ans;
+}
+
+// The openings, in order, whose searched score is within the balance, until
+// there are `limit` of them.
+static std::vector<std::vector<std::uint8_t>> filter(const Options& opt,
+    const std::vector<std::vector<std::uint8_t>>& openings)
+{
+    constexpr std::size_t CHUNK = 256;
+    const std::size_t chunks = (openings.size() + CHUNK - 1) / CHUNK;
+    // The openings kept from each chunk. The chunks handed out are always a
+    // prefix, so once they hold enough the first `limit` are final.
+    std::vector<std::vector<std::size_t>> kept(chunks);
+    std::atomic<std::size_t> next = 0, total = 0, searched = 0;
+    std::mutex mutex;
+    std::string error;
+    const auto worker = [&] {
+        try {
+            const auto engine = make_engine_from_description(opt.search);
+            for (std::size_t c; total < opt.limit && (c = next++) < chunks; ) {
+                for (std::size_t i = c * CHUNK; i < std::min(openings.size(), (c + 1) * CHUNK); i++) {
+                    Board b;
+                    for (const std::uint8_t sq : openings[i]) {
+                        if (sq == GameRecord::PASS) {
+                            b.skip();
+                        } else {
+                            const auto [x, y] = from_index(sq);
+                            b.place(x, y);
+                        }
+                    }
+                    engine->search(b);
+                    const auto score = engine->last_score();
+                    if (!score)
+                        throw ReversiError(engine->get_name() + " doesn't report scores");
+                    if (std::abs(*score) <= opt.balance) {
+                        kept[c].push_back(i);
+                        ++total;
+                    }
+                }
+                if ((searched += CHUNK) % (CHUNK * 100) == 0) {
+                    std::lock_guard lock(mutex);
+                    std::cout << searched << " searched, " << total << " kept" << std::endl;
+                }
+            }
+        } catch (const ReversiError& e) {
+            next = chunks;
+            std::lock_guard lock(mutex);
+            error = e.what();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int i = 0; i < opt.threads; i++)
+        pool.emplace_back(worker);
+    for (auto& t : pool)
+        t.join();
+    if (!error.empty())
+        throw ReversiError(error);
+    std::vector<std::vector<std::uint8_t>> ans;
+    for (const auto& chunk : kept) {
+        for (const std::size_t i : chunk) {
+            if (ans.size() < opt.limit)
+                ans.push_back(openings[i]);
+        }
+    }
+    return ans;
+}
+
+int main(int argc, char** argv) {
+    try {
+        const Options opt = parse_options(argc, argv);
+        // Fail on a bad description before the enumeration.
+        if (!opt.search.empty())
+            make_engine_from_description(opt.search);
+        auto openings = OpeningSuite::enumerate(opt.plies);
+        std::cout << openings.size() << " distinct positions after " << opt.plies << " plies" << std::endl;
+        std::shuffle(openings.begin(), openings.end(), std::mt19937(opt.seed));
+        if (!opt.search.empty())
+            openings = filter(opt, openings);
+        else if (openings.size() > opt.limit)
+            openings.resize(opt.limit);
+        OpeningSuite::write(opt.out, opt.plies, openings);
+        std::cout << openings.size() << " openings written" << std::endl;
+    } catch (const ReversiError& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
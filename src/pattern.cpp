@@ -0,0 +1,242 @@
+#include "pattern.h"
+#include <fstream>
+#include <stdexcept>
+
+namespace Reversi {
+    namespace {
+        using Square = std::pair<int, int>;
+
+        // One orientation of each pattern, as (row, column) with the square
+        // index row * 8 + column.
+        std::vector<Square> canonical(Patterns::Id p) {
+            std::vector<Square> ans;
+            switch (p) {
+            case Patterns::Edge2X:
+                for (int c = 0; c < 8; c++)
+                    ans.emplace_back(0, c);
+                ans.emplace_back(1, 1);
+                ans.emplace_back(1, 6);
+                break;
+            case Patterns::Corner3x3:
+                for (int r = 0; r < 3; r++)
+                    for (int c = 0; c < 3; c++)
+                        ans.emplace_back(r, c);
+                break;
+            case Patterns::Corner2x5:
+                for (int r = 0; r < 2; r++)
+                    for (int c = 0; c < 5; c++)
+                        ans.emplace_back(r, c);
+                break;
+            default:
+                // The diagonals, shifted off the main one by `shift` columns.
+                for (int shift = p - Patterns::Diag8, i = 0; i + shift < 8; i++)
+                    ans.emplace_back(i, i + shift);
+            }
+            return ans;
+        }
+
+        // The eight symmetries of the board: bit 0 flips the rows, bit 1 the
+        // columns and bit 2 transposes.
+        Square transform(Square s, int t) {
+            auto [r, c] = s;
+            if (t & 4)
+                std::swap(r, c);
+            if (t & 1)
+                r = 7 - r;
+            if (t & 2)
+                c = 7 - c;
+            return { r, c };
+        }
+
+        struct Instances {
+            std::array<Patterns::Id, Patterns::INSTANCES> pattern;
+            std::array<std::vector<int>, Patterns::INSTANCES> squares;
+        };
+
+        // All the distinct orientations of all the patterns. Orientations
+        // covering the same squares are the same instance.
+        Instances make_instances() {
+            Instances ans;
+            std::vector<std::uint64_t> seen;
+            int cnt = 0;
+            for (int p = 0; p < Patterns::COUNT; p++) {
+                const auto base = canonical(Patterns::Id(p));
+                for (int t = 0; t < 8; t++) {
+                    std::vector<int> squares;
+                    std::uint64_t mask = 0;
+                    for (const auto& s : base) {
+                        const auto [r, c] = transform(s, t);
+                        squares.push_back(r * 8 + c);
+                        mask |= std::uint64_t(1) << (r * 8 + c);
+                    }
+                    if (std::find(seen.begin(), seen.end(), mask) != seen.end())
+                        continue;
+                    seen.push_back(mask);
+                    if (cnt == Patterns::INSTANCES)
+                        throw std::logic_error("Too many pattern instances");
+                    ans.pattern[cnt] = Patterns::Id(p);
+                    ans.squares[cnt++] = std::move(squares);
+                }
+            }
+            if (cnt != Patterns::INSTANCES)
+                throw std::logic_error("Too few pattern instances");
+            return ans;
+        }
+
+        const Instances ALL_INSTANCES = make_instances();
+
+        // The digits a square is part of: the instance and the power of 3 of
+        // the digit.
+        struct Digits {
+            int cnt = 0;
+            std::array<std::uint8_t, 8> instance;
+            std::array<std::uint16_t, 8> power;
+        };
+
+        std::array<Digits, 64> make_digits() {
+            std::array<Digits, 64> ans;
+            for (int i = 0; i < Patterns::INSTANCES; i++) {
+                int power = 1;
+                for (const int sq : ALL_INSTANCES.squares[i]) {
+                    Digits& d = ans[sq];
+                    if (d.cnt == int(d.instance.size()))
+                        throw std::logic_error("Too many patterns on a square");
+                    d.instance[d.cnt] = std::uint8_t(i);
+                    d.power[d.cnt++] = std::uint16_t(power);
+                    power *= 3;
+                }
+            }
+            return ans;
+        }
+
+        const std::array<Digits, 64> DIGITS = make_digits();
+
+        // Where the table of each instance starts within a phase.
+        std::array<int, Patterns::INSTANCES> make_instance_offsets() {
+            std::array<int, Patterns::INSTANCES> ans;
+            for (int i = 0; i < Patterns::INSTANCES; i++)
+                ans[i] = Patterns::OFFSET[ALL_INSTANCES.pattern[i]];
+            return ans;
+        }
+
+        const std::array<int, Patterns::INSTANCES> INSTANCE_OFFSET = make_instance_offsets();
+
+        constexpr char MAGIC[4] = { 'R', 'V', 'P', 'W' };
+        constexpr std::uint32_t VERSION = 1;
+
+        void write_u32(std::ostream& out, std::uint32_t x) {
+            for (int i = 0; i < 4; i++)
+                out.put(char(x >> (8 * i)));
+        }
+
+        std::uint32_t read_u32(std::istream& in) {
+            std::uint32_t ans = 0;
+            for (int i = 0; i < 4; i++)
+                ans |= std::uint32_t(std::uint8_t(in.get())) << (8 * i);
+            return ans;
+        }
+    }
+
+    const std::array<Patterns::Id, Patterns::INSTANCES> Patterns::PATTERN_OF = ALL_INSTANCES.pattern;
+
+    const std::array<std::vector<int>, Patterns::INSTANCES> Patterns::SQUARES_OF = ALL_INSTANCES.squares;
+
+    PatternState::PatternState(const BitBoard& b) noexcept {
+        for (int i = 0; i < Patterns::INSTANCES; i++) {
+            int own = 0, opp = 0;
+            // The first square is the lowest digit.
+            const auto& squares = ALL_INSTANCES.squares[i];
+            for (auto it = squares.rbegin(); it != squares.rend(); ++it) {
+                const int d = (b.own >> *it & 1) ? 1 : (b.opp >> *it & 1) ? 2 : 0;
+                own = own * 3 + d;
+                opp = opp * 3 + (d ? 3 - d : 0);
+            }
+            mIndex[0][i] = std::uint16_t(own);
+            mIndex[1][i] = std::uint16_t(opp);
+        }
+    }
+
+    void PatternState::play(int sq, std::uint64_t flips) noexcept {
+        auto& mover = mIndex[mTurn];
+        auto& other = mIndex[mTurn ^ 1];
+        const Digits& d = DIGITS[sq];
+        for (int k = 0; k < d.cnt; k++) {
+            mover[d.instance[k]] += d.power[k];
+            other[d.instance[k]] += 2 * d.power[k];
+        }
+        for (; flips; flips &= flips - 1) {
+            // A flipped disc turns from 2 to 1 for the mover, and back for the other.
+            const Digits& f = DIGITS[std::countr_zero(flips)];
+            for (int k = 0; k < f.cnt; k++) {
+                mover[f.instance[k]] -= f.power[k];
+                other[f.instance[k]] += f.power[k];
+            }
+        }
+        mTurn ^= 1;
+    }
+
+    void PatternState::undo(int sq, std::uint64_t flips) noexcept {
+        mTurn ^= 1;
+        auto& mover = mIndex[mTurn];
+        auto& other = mIndex[mTurn ^ 1];
+        const Digits& d = DIGITS[sq];
+        for (int k = 0; k < d.cnt; k++) {
+            mover[d.instance[k]] -= d.power[k];
+            other[d.instance[k]] -= 2 * d.power[k];
+        }
+        for (; flips; flips &= flips - 1) {
+            const Digits& f = DIGITS[std::countr_zero(flips)];
+            for (int k = 0; k < f.cnt; k++) {
+                mover[f.instance[k]] += f.power[k];
+                other[f.instance[k]] -= f.power[k];
+            }
+        }
+    }
+
+    PatternWeights::PatternWeights() : mWeights(std::size_t(Patterns::PHASES) * PHASE_SIZE) {}
+
+    PatternWeights PatternWeights::load(const std::string& path) {
+        std::ifstream fin(path, std::ios::binary);
+        if (!fin)
+            throw ReversiError("Can't open weights file " + path);
+        char magic[4] = {};
+        fin.read(magic, 4);
+        if (!std::equal(magic, magic + 4, MAGIC) || read_u32(fin) != VERSION
+            || read_u32(fin) != std::uint32_t(Patterns::PHASES) || read_u32(fin) != std::uint32_t(PHASE_SIZE))
+            throw ReversiError(path + " is not a weights file of this version");
+        PatternWeights ans;
+        std::vector<char> buf(ans.mWeights.size() * 2);
+        if (!fin.read(buf.data(), std::streamsize(buf.size())))
+            throw ReversiError(path + " is truncated");
+        for (std::size_t i = 0; i < ans.mWeights.size(); i++)
+            ans.mWeights[i] = std::int16_t(std::uint8_t(buf[2 * i]) | std::uint8_t(buf[2 * i + 1]) << 8);
+        return ans;
+    }
+
+    void PatternWeights::save(const std::string& path) const {
+        std::ofstream fout(path, std::ios::binary);
+        fout.write(MAGIC, 4);
+        write_u32(fout, VERSION);
+        write_u32(fout, Patterns::PHASES);
+        write_u32(fout, PHASE_SIZE);
+        std::vector<char> buf(mWeights.size() * 2);
+        for (std::size_t i = 0; i < mWeights.size(); i++) {
+            buf[2 * i] = char(std::uint16_t(mWeights[i]));
+            buf[2 * i + 1] = char(std::uint16_t(mWeights[i]) >> 8);
+        }
+        fout.write(buf.data(), std::streamsize(buf.size()));
+        if (!fout)
+            throw ReversiError("Can't write weights file " + path);
+    }
+
+    int PatternWeights::eval(const PatternState& s, const BitBoard& b) const noexcept {
+        const std::int16_t* w = &mWeights[std::size_t(Patterns::phase_of(b.empties())) * PHASE_SIZE];
+        int sum = w[BIAS];
+        for (int i = 0; i < Patterns::INSTANCES; i++)
+            sum += w[INSTANCE_OFFSET[i] + s.index(i)];
+        sum += w[MOBILITY] * (std::popcount(b.moves()) - std::popcount(b.pass().moves()));
+        if (b.empties() & 1)
+            sum += w[PARITY];
+        return sum / SCALE;
+    }
+}
@@ -0,0 +1,141 @@
+// Pattern-based evaluation
+#ifndef REVERSI_PATTERN_H
+#define REVERSI_PATTERN_H
+#include "bitboard.h"
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+namespace Reversi {
+    // The patterns are groups of squares whose contents together are looked
+    // up in a table of weights: the edges with the two X-squares, the 3x3 and
+    // 2x5 corner regions and the diagonals of length 4 to 8. Each pattern
+    // appears on the board once per distinct orientation, and the orientations
+    // share the weights of their pattern.
+    namespace Patterns {
+        enum Id {
+            Edge2X, Corner3x3, Corner2x5, Diag8, Diag7, Diag6, Diag5, Diag4, COUNT
+        };
+
+        // The number of squares of each pattern.
+        constexpr int SIZE[COUNT] = { 10, 9, 10, 8, 7, 6, 5, 4 };
+
+        // The number of placements of all the patterns on the board.
+        constexpr int INSTANCES = 34;
+
+        // 3 ** SIZE[p], the number of configurations of pattern p.
+        constexpr int configurations(int p) noexcept {
+            int ans = 1;
+            for (int i = 0; i < SIZE[p]; i++)
+                ans *= 3;
+            return ans;
+        }
+
+        // Where the weights of pattern p start within a phase. OFFSET[COUNT]
+        // is the total.
+        constexpr std::array<int, COUNT + 1> OFFSET = [] {
+            std::array<int, COUNT + 1> ans{};
+            for (int p = 0; p < COUNT; p++)
+                ans[p + 1] = ans[p] + configurations(p);
+            return ans;
+        }();
+
+        // The pattern of each instance.
+        extern const std::array<Id, INSTANCES> PATTERN_OF;
+
+        // The squares of each instance, in the order of their digits.
+        extern const std::array<std::vector<int>, INSTANCES> SQUARES_OF;
+
+        // Positions are split into phases by the number of empties, each
+        // with weights of its own.
+        constexpr int PHASES = 10;
+
+        constexpr int phase_of(int empties) noexcept {
+            return empties >= 60 ? 0 : std::min((60 - empties) / 6, PHASES - 1);
+        }
+    }
+
+    // The configurations of all the pattern instances for a position, each
+    // seen from both sides: a base 3 number with a digit per square, 0 for
+    // empty, 1 for a disc of the viewer and 2 for an opponent disc.
+    // Moves update the indices through a table of the digits each square
+    // contributes to, which is far cheaper than reading the board again.
+    class PatternState {
+        // mIndex[v][i] is instance i seen by viewer v. mTurn is the viewer to move.
+        std::array<std::array<std::uint16_t, Patterns::INSTANCES>, 2> mIndex;
+        int mTurn = 0;
+
+    public:
+        // The indices of b, computed from scratch.
+        explicit PatternState(const BitBoard& b = {}) noexcept;
+
+        // Updates the indices for the player to move placing at sq, which
+        // flips `flips`, and hands the turn over.
+        void play(int sq, std::uint64_t flips) noexcept;
+
+        // Takes back play(sq, flips).
+        void undo(int sq, std::uint64_t flips) noexcept;
+
+        // Hands the turn over without playing. Its own undo.
+        inline void pass() noexcept {
+            mTurn ^= 1;
+        }
+
+        // The index of instance i seen by the player to move.
+        inline int index(int i) const noexcept {
+            return mIndex[mTurn][i];
+        }
+
+        friend inline bool operator == (const PatternState& lhs, const PatternState& rhs) noexcept {
+            for (int i = 0; i < Patterns::INSTANCES; i++) {
+                if (lhs.index(i) != rhs.index(i))
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    // The weights of the pattern evaluation, per phase. Scores are in 1/SCALE
+    // discs of final disc difference, for the player to move.
+    class PatternWeights {
+    public:
+        static constexpr int SCALE = 64;
+
+        // The weights of a phase are the pattern tables at Patterns::OFFSET,
+        // then a weight for the mobility difference, one for odd parity and
+        // a constant.
+        static constexpr int MOBILITY = Patterns::OFFSET[Patterns::COUNT];
+        static constexpr int PARITY = MOBILITY + 1, BIAS = MOBILITY + 2, PHASE_SIZE = MOBILITY + 3;
+
+    private:
+        // PHASES * PHASE_SIZE weights.
+        std::vector<std::int16_t> mWeights;
+
+    public:
+        // All weights zero.
+        PatternWeights();
+
+        // Reads a weights file written by save(), throwing ReversiError if it
+        // can't be read or doesn't look like one.
+        static PatternWeights load(const std::string& path);
+
+        // Writes the weights: the magic "RVPW", the format version, PHASES and
+        // PHASE_SIZE as little endian 32 bit integers, then the weights as
+        // little endian 16 bit integers.
+        void save(const std::string& path) const;
+
+        inline std::int16_t& at(int phase, int idx) noexcept {
+            return mWeights[phase * PHASE_SIZE + idx];
+        }
+
+        inline std::int16_t at(int phase, int idx) const noexcept {
+            return mWeights[phase * PHASE_SIZE + idx];
+        }
+
+        // The evaluation of b, whose pattern indices are in `s`, in discs.
+        int eval(const PatternState& s, const BitBoard& b) const noexcept;
+    };
+}
+
+#endif
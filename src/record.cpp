@@ -0,0 +1,146 @@
+#include "record.h"
+
+namespace Reversi {
+    namespace {
+        constexpr char MAGIC[4] = { 'R', 'V', 'G', 'M' };
+        constexpr std::uint32_t VERSION = 2;
+
+        bool ends_with(const std::string& s, const std::string& suffix) {
+            return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+        }
+    }
+
+    GameRecord GameRecord::from_json(const nlohmann::json& js) {
+        using namespace std::string_literals;
+        GameRecord ans;
+        try {
+            for (const auto& move : js.at("annotation")) {
+                const int x = move.at(0), y = move.at(1);
+                if (x == 0 && y == 0)
+                    ans.moves.push_back(PASS);
+                else if (1 <= x && x <= Board::MAX_FILES && 1 <= y && y <= Board::MAX_RANK)
+                    ans.moves.push_back(std::uint8_t(to_index(x, y)));
+                else
+                    throw ReversiError("Invalid place in annotation");
+            }
+        } catch (const nlohmann::json::exception& ex) {
+            throw ReversiError("Error parsing JSON: "s + ex.what());
+        }
+        const auto pos = ans.positions();
+        // The player to move at the end is Black after an even number of moves.
+        ans.result = pos.size() % 2 ? pos.back().final_score() : -pos.back().final_score();
+        // A game ended early by GameMan has the result it was given.
+        if (const auto adj = js.find("adjudicated"); adj != js.end() && adj->is_number_integer())
+            ans.result = *adj;
+        return ans;
+    }
+
+    std::vector<BitBoard> GameRecord::positions() const {
+        std::vector<BitBoard> ans{ BitBoard::from_board(Board()) };
+        ans.reserve(moves.size() + 1);
+        for (const auto sq : moves) {
+            const BitBoard& b = ans.back();
+            if (sq == PASS) {
+                if (b.moves())
+                    throw ReversiError("Invalid skip in annotation!");
+                ans.push_back(b.pass());
+            } else {
+                if (sq >= 64 || !(b.moves() >> sq & 1))
+                    throw ReversiError("Invalid place in annotation");
+                ans.push_back(b.play(sq));
+            }
+        }
+        return ans;
+    }
+
+    GameWriter::GameWriter(const std::string& path) : mOut(path, std::ios::binary) {
+        if (!mOut)
+            throw ReversiError("Can't create " + path);
+        mOut.write(MAGIC, 4);
+        for (int i = 0; i < 4; i++)
+            mOut.put(char(VERSION >> (8 * i)));
+    }
+
+    void GameWriter::write(const GameRecord& game) {
+        if (game.moves.size() > 255)
+            throw ReversiError("Game too long for the binary format");
+        if (!game.values.empty() && game.values.size() != game.moves.size())
+            throw ReversiError("The game needs a value per move or none");
+        mOut.put(char(game.moves.size()));
+        mOut.write(reinterpret_cast<const char*>(game.moves.data()), std::streamsize(game.moves.size()));
+        mOut.put(char(game.result));
+        mOut.put(char(!game.values.empty()));
+        mOut.write(reinterpret_cast<const char*>(game.values.data()), std::streamsize(game.values.size()));
+    }
+
+    void GameWriter::close() {
+        mOut.close();
+        if (!mOut)
+            throw ReversiError("Error writing games");
+    }
+
+    GameReader::GameReader(const std::string& path) : mPath(path) {
+        mFormat = ends_with(path, ".json") ? Format::Json
+            : ends_with(path, ".jsonl") ? Format::JsonLines : Format::Binary;
+        mIn.open(path, mFormat == Format::Binary ? std::ios::binary : std::ios::in);
+        if (!mIn)
+            throw ReversiError("Can't open " + path);
+        if (mFormat == Format::Binary) {
+            char magic[8] = {};
+            mIn.read(magic, 8);
+            std::uint32_t version = 0;
+            for (int i = 0; i < 4; i++)
+                version |= std::uint32_t(std::uint8_t(magic[4 + i])) << (8 * i);
+            if (!mIn || !std::equal(magic, magic + 4, MAGIC) || version != VERSION)
+                throw ReversiError(path + " is not a game file of this version");
+        }
+    }
+
+    bool GameReader::next(GameRecord& game) {
+        if (mDone)
+            return false;
+        switch (mFormat) {
+        case Format::Json:
+            mDone = true;
+            try {
+                game = GameRecord::from_json(nlohmann::json::parse(mIn));
+            } catch (const nlohmann::json::exception& ex) {
+                throw ReversiError(mPath + ": " + ex.what());
+            }
+            return true;
+        case Format::JsonLines: {
+            std::string line;
+            while (std::getline(mIn, line)) {
+                if (line.find_first_not_of(" \t\r") == std::string::npos)
+                    continue;
+                try {
+                    game = GameRecord::from_json(nlohmann::json::parse(line));
+                } catch (const nlohmann::json::exception& ex) {
+                    throw ReversiError(mPath + ": " + ex.what());
+                }
+                return true;
+            }
+            mDone = true;
+            return false;
+        }
+        default: {
+            const int cnt = mIn.get();
+            if (cnt == std::char_traits<char>::eof()) {
+                mDone = true;
+                return false;
+            }
+            game.moves.resize(cnt);
+            mIn.read(reinterpret_cast<char*>(game.moves.data()), cnt);
+            game.result = std::int8_t(mIn.get());
+            const int has_values = mIn.get();
+            game.values.resize(has_values == 1 ? cnt : 0);
+            mIn.read(reinterpret_cast<char*>(game.values.data()), std::streamsize(game.values.size()));
+            if (!mIn)
+                throw ReversiError(mPath + " is truncated");
+            if (has_values > 1)
+                throw ReversiError(mPath + " is corrupt");
+            return true;
+        }
+        }
+    }
+}
@@ -0,0 +1,82 @@
+// Game records for tools: reading saved games and a compact binary format
+#ifndef REVERSI_RECORD_H
+#define REVERSI_RECORD_H
+#include "bitboard.h"
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace Reversi {
+    // The moves of a game from the initial position.
+    struct GameRecord {
+        // A pass in `moves`.
+        static constexpr std::uint8_t PASS = 64;
+
+        // A missing entry in `values`.
+        static constexpr std::int8_t NO_VALUE = -128;
+
+        // The moves as square indices (see to_index()), or PASS.
+        std::vector<std::uint8_t> moves;
+
+        // Black's discs minus White's at the end of the game.
+        int result = 0;
+
+        // Either empty, or for each move the value of the position before it
+        // in discs for the player to move, as reported by the engine that
+        // played it. NO_VALUE where there was none.
+        std::vector<std::int8_t> values;
+
+        // Reads the annotation of a game saved by GameMan::to_json() and
+        // replays it for the result, which for an unfinished game is as if
+        // it ended there, unless it was adjudicated. Throws ReversiError if the JSON or a move
+        // is invalid.
+        static GameRecord from_json(const nlohmann::json& js);
+
+        // The positions before each move and the one after the last move,
+        // seen from the player to move. Throws ReversiError on an illegal move.
+        std::vector<BitBoard> positions() const;
+    };
+
+    // The binary game format: the magic "RVGM" and the format version as a
+    // little endian 32 bit integer, then for each game
+    //  - the number of moves n as a byte, and the moves, a byte each,
+    //  - the result as a signed byte,
+    //  - a byte that is 1 if the values follow, a signed byte per move, or 0.
+    // Games hold at most 255 moves, far more than a game can take.
+    class GameWriter {
+        std::ofstream mOut;
+
+    public:
+        // Creates or truncates the file. Throws ReversiError if it can't.
+        explicit GameWriter(const std::string& path);
+
+        // Appends a game. Throws ReversiError if it doesn't fit the format.
+        void write(const GameRecord& game);
+
+        // Flushes the file, throwing ReversiError if anything couldn't be written.
+        void close();
+    };
+
+    // Reads files in any of the formats games are kept in, one game at a time:
+    // the binary format of GameWriter, ".json" files saved by GameMan holding
+    // one game, and ".jsonl" files with one such game per line.
+    class GameReader {
+        enum class Format {
+            Binary, Json, JsonLines
+        } mFormat;
+
+        std::ifstream mIn;
+        std::string mPath;
+        bool mDone = false;
+
+    public:
+        // Opens the file, throwing ReversiError if it can't be read.
+        explicit GameReader(const std::string& path);
+
+        // Reads the next game into `game`. Returns false at the end of the
+        // file, and throws ReversiError if the file is corrupt.
+        bool next(GameRecord& game);
+    };
+}
+
+#endif
@@ -89,13 +89,9 @@ namespace Reversi {
         mDrawing(*this)
     {
         events().click([this](const nana::arg_click& arg) {
-            try {
-                std::lock_guard lk(mPromMutex);
-                mUIProm.set_value(to_board_coord(arg.mouse_args));
-            } catch (const std::future_error&) {
-                // This means that there is no active request waiting for the click.
-                // Just ignore it.
-            }
+            // If there is no active request waiting for the click, it is
+            // just ignored.
+            mClick.set(to_board_coord(arg.mouse_args));
         });
         mDrawing.draw([this](nana::paint::graphics& dest_graphic) {
             mGraphics.paste(dest_graphic, 0, 0);
@@ -109,11 +105,6 @@ namespace Reversi {
         update(Board(), 0, 0);
     }
 
-    void BoardWidget::listen_click(std::promise<std::pair<int, int>> prom) {
-        std::lock_guard lk(mPromMutex);
-        mUIProm = std::move(prom);
-    }
-
     void BoardWidget::set_draw_hint(bool enabled) noexcept {
         mDrawHint = enabled;
     }
@@ -121,10 +112,7 @@ namespace Reversi {
     SkipButton::SkipButton(nana::window handle) : nana::button(handle) {
         caption("Skip");
         events().click([this]{
-            try {
-                std::lock_guard lk(mPromMutex);
-                mUIProm.set_value();
-            } catch (const std::future_error&) {
+            if (!mClick.set({})) {
                 // The UIE isn't loaded or it's not waiting for a skip. Inform the user.
                 (nana::msgbox("Not now") << "You can't skip now!")
                     .icon(nana::msgbox::icon_information)
@@ -133,22 +121,20 @@ namespace Reversi {
         });
     }
 
-    void SkipButton::listen_click(std::promise<void> prom) {
-        std::lock_guard lk(mPromMutex);
-        mUIProm = std::move(prom);
-    }
-
     UserInputEngine::UserInputEngine(BoardWidget& bw, SkipButton& skb) :
         mBoardWidget(bw), mSkipButton(skb)
     {}
 
-    std::pair<int, int> UserInputEngine::do_make_move() {
-        using namespace std::chrono_literals;
-        // We can safely access mBoard since it's protected by the mutex
+    UserInputEngine::~UserInputEngine() noexcept {
+        stop_computation();
+    }
+
+    MoveTask UserInputEngine::make_move_async() {
+        // We can safely access mBoard since no one else does while we compute
         if (!mBoard.is_skip_legal()) {
             mSkipButton.enabled(false);
-            // Hand off the promise to the board. Since the board might return
-            // invalid data, we need to get a loop.
+            // Wait on the board. Since the board might return invalid data,
+            // we need to get a loop.
             // is_placable[i][j] is true if we can put a piece on (i, j)
             bool is_placable[9][9];
             for (int i = 1; i <= 8; i++) {
@@ -156,39 +142,23 @@ namespace Reversi {
                     is_placable[i][j] = mBoard.is_placable(i, j);
             }
             while (true) {
-                std::promise<std::pair<int, int>> prom;
-                auto fut = prom.get_future();
-                mBoardWidget.listen_click(std::move(prom));
-                // Check for cancel requests every 100ms
-                while (fut.wait_for(100ms) == std::future_status::timeout) {
-                    if (mCancel.load(std::memory_order_acquire))
-                        throw OperationCanceled();
-                }
-                // Now the future is "ready".
-                // The manager is destroyed before the widgets, so the engine
-                // is destroyed before the widgets, so this doesn't throw
-                // abandoned_promise.
-                auto result = fut.get();
+                // Nothing means the computation was canceled.
+                const auto result = co_await mBoardWidget.click();
+                if (!result)
+                    throw OperationCanceled();
                 // Check if this is a legal move
-                if (is_placable[result.first][result.second])
-                    return result;
-                // This move is not legal. We tell the board widget to keep on listening.
+                if (is_placable[result->first][result->second])
+                    co_return *result;
+                // This move is not legal. We keep on listening to the board.
             }
         } else {
             if (mSkipButton.get_auto_skip())
-                return {0, 0};
+                co_return std::pair(0, 0);
             mSkipButton.enabled(true);
-            // Hand off the promise to the skip button.
-            std::promise<void> prom;
-            auto fut = prom.get_future();
-            mSkipButton.listen_click(std::move(prom));
-            while (fut.wait_for(100ms) == std::future_status::timeout) {
-                // Check for explicit cancel requests every 100ms
-                if (mCancel.load(std::memory_order_acquire))
-                    throw OperationCanceled();
-            }
-            // Now the future is ready, which means the user has clicked the button
-            return { 0, 0 };
+            if (!co_await mSkipButton.click())
+                throw OperationCanceled();
+            // The user has clicked the button
+            co_return std::pair(0, 0);
         }
     }
 
@@ -6,7 +6,8 @@
 #include <nana/gui/widgets/menubar.hpp>
 #include "game.h"
 #include "engi.h"
-#include <future>
+#include "coro.h"
+#include <variant>
 
 namespace Reversi {
     // This widget is responsible for showing the board info.
@@ -32,13 +33,9 @@ namespace Reversi {
         // If this is true, the redraw() will draw crosses on available squares.
         bool mDrawHint = false;
 
-        // Used to push data to the user input engine. Reuses are detected by
-        // the exception thrown by set_value.
-        std::promise<std::pair<int, int>> mUIProm;
-
-        // As the name implies, the mutex protects only mUIProm and synchronizes
-        // the engine thread and the GUI thread.
-        std::mutex mPromMutex;
+        // Hands the clicks to the user input engine waiting for one. Clicks
+        // while it isn't waiting are dropped.
+        Signal<std::pair<int, int>> mClick;
 
         // Helper function to convert the pixel language to board language.
         std::pair<int, int> to_board_coord(const nana::arg_mouse* arg);
@@ -67,8 +64,10 @@ namespace Reversi {
         // Redraws the GUI widget according to data stored in the class.
         void redraw();
 
-        // Sends in a promise for the click.
-        void listen_click(std::promise<std::pair<int, int>> prom);
+        // Waits for the next click, in the board's coordinates.
+        inline Signal<std::pair<int, int>>::Awaiter click() noexcept {
+            return mClick.wait();
+        }
 
         // Sets the hint drawing function.
         void set_draw_hint(bool enabled) noexcept;
@@ -80,10 +79,7 @@ namespace Reversi {
         std::atomic_bool mAutoSkip = true;
 
         // To communicate with the user input engine
-        std::promise<void> mUIProm;
-
-        // Protects mUIProm
-        std::mutex mPromMutex;
+        Signal<std::monostate> mClick;
     public:
         SkipButton(nana::window handle);
 
@@ -97,8 +93,10 @@ namespace Reversi {
             return mAutoSkip.load(std::memory_order_acquire);
         }
 
-        // Sets the promise.
-        void listen_click(std::promise<void> prom);
+        // Waits for the next click.
+        inline Signal<std::monostate>::Awaiter click() noexcept {
+            return mClick.wait();
+        }
     };
 
     // The user input engine that combines the skip button and the board.
@@ -107,18 +105,19 @@ namespace Reversi {
         BoardWidget& mBoardWidget;
         SkipButton& mSkipButton;
 
-        virtual std::pair<int, int> do_make_move() override;
+        // Waits for the clicks without holding a thread.
+        virtual MoveTask make_move_async() override;
 
     public:
         UserInputEngine(BoardWidget& bw, SkipButton& skb);
 
-        virtual ~UserInputEngine() noexcept = default;
+        virtual ~UserInputEngine() noexcept;
 
         virtual std::string get_name() override;
     };
 
     // The main window of our application
-    struct MainWindow : public nana::form {
+    struct MainWindow : public nana::form, public GameObserver {
         // The components of the application
         SkipButton mSkipButton;
         BoardWidget mBoardWidget;
@@ -138,11 +137,16 @@ namespace Reversi {
         MainWindow(const std::string& board_img);
 
         // Broadcasts the result.
-        void announce_game_result(MatchResult res);
+        void announce_game_result(MatchResult res) override;
 
-        // If the passed in UIE pointer isn't nullptr (i.e., the next player to
-        // play is the user), enables the two buttons.
-        void input_button_activity(const UserInputEngine* uie);
+        // Enables the two buttons if the next player to play is the user.
+        void input_button_activity(bool user_to_move);
+
+        // Enables the buttons for the user's turns.
+        void next_to_move(Player side, const std::string& engine) override;
+
+        // Makes the engines of a loaded game, including the user's.
+        std::unique_ptr<Engine> make_engine(const std::string& description) override;
 
         // Creates a popup window asking the user to select two sides of the
         // new game. The results are stored in the two out params.
@@ -164,7 +168,7 @@ namespace Reversi {
 
         // Updates the GUI according to the board b. The last move was
         // given to draw the cross.
-        void update_board(const Board& b, std::pair<int, int> last_move);
+        void update_board(const Board& b, std::pair<int, int> last_move) override;
 
         // If the associated game manager's annotation is dirty, asks the user
         // whether to save it.
@@ -174,6 +178,11 @@ namespace Reversi {
         // Saves the game in a file the user selects.
         void save_game();
     };
+
+    // Like the overload in engi.h, but also makes UserInput engines, which
+    // take their moves from the widgets of `mw`.
+    std::unique_ptr<Engine> make_engine_from_description(
+        const std::string& name, MainWindow& mw);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,167 @@
+// Plays engine-vs-engine games on all cores and streams them to a game file.
+// Usage: selfplay OUT [--games=N] [--threads=N] [--black=DESC] [--white=DESC]
+//                     [--random=N] [--seed=N] [--values] [--openings=FILE]
+//
+// Each thread owns a pair of engines, made from the descriptions like the GUI
+// does, and plays whole games through Engine::search(). The first `random`
+// plies (default 8) are random legal moves, so that the games differ; game i
+// is seeded with seed + i, so a run can be repeated. With --openings game i
+// starts with opening i of the suite, going round it if needed, and random
+// moves only follow if `random` is more than its plies. The games are written in
+// the binary format of GameWriter as they finish, with the values the engines
+// report if --values is given.
+#include "command_line.h"
+#include "engi.h"
+#include "opening_suite.h"
+#include "record.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Reversi;
+
+struct Options {
+    std::string out, openings;
+    int games = 1000;
+    int threads = std::max(1, int(std::thread::hardware_concurrency()));
+    std::string black = "AlphaBeta:depth=4", white = "AlphaBeta:depth=4";
+    int random = 8;
+    unsigned seed = 1;
+    bool values = false;
+};
+
+// Plays game number `id` between the two engines, from the opening of the
+// suite if there is one.
+static GameRecord play_game(const Options& opt, int id, Engine& black, Engine& white, const OpeningSuite* suite) {
+    std::mt19937 rng(opt.seed + unsigned(id));
+    GameRecord game;
+    Board board;
+    BitBoard b = BitBoard::from_board(board);
+    const std::vector<std::uint8_t> opening = suite ? suite->moves(id % suite->size()) : std::vector<std::uint8_t>();
+    while (b.moves() || b.pass().moves()) {
+        const std::uint64_t moves = b.moves();
+        int sq = GameRecord::PASS;
+        std::int8_t value = GameRecord::NO_VALUE;
+        if (game.moves.size() < opening.size()) {
+            sq = opening[game.moves.size()];
+            if (sq == GameRecord::PASS ? moves != 0 : !(moves >> sq & 1))
+                throw ReversiError("Illegal move in " + opt.openings);
+        } else if (moves && int(game.moves.size()) < opt.random) {
+            std::uint64_t m = moves;
+            for (int k = int(rng() % std::popcount(moves)); k; k--)
+                m &= m - 1;
+            sq = std::countr_zero(m);
+        } else if (moves) {
+            Engine& side = game.moves.size() % 2 ? white : black;
+            const auto [x, y] = side.search(board);
+            sq = to_index(x, y);
+            if (!(moves >> sq & 1))
+                throw ReversiError(side.get_name() + " played an illegal move");
+            if (const auto score = side.last_score())
+                value = std::int8_t(std::clamp(*score, -64, 64));
+        }
+        game.moves.push_back(std::uint8_t(sq));
+        game.values.push_back(value);
+        if (sq == GameRecord::PASS) {
+            board.skip();
+            b = b.pass();
+        } else {
+            const auto [x, y] = from_index(sq);
+            board.place(x, y);
+            b = b.play(sq);
+        }
+    }
+    // Black is to move after an even number of moves.
+    game.result = game.moves.size() % 2 ? -b.final_score() : b.final_score();
+    if (!opt.values)
+        game.values.clear();
+    return game;
+}
+
+static Options parse_options(int argc, char** argv) {
+    Options ans;
+    const auto cl = CommandLine::parse(argc, argv, { "values" });
+    cl.check_keys({ "games", "threads", "black", "white", "random", "seed", "values", "openings" });
+    if (cl.positional.size() > 1)
+        throw ReversiError("Only one output file: " + cl.positional[1]);
+    if (!cl.positional.empty())
+        ans.out = cl.positional.front();
+    ans.games = cl.get_int("games", ans.games);
+    ans.threads = cl.get_int("threads", ans.threads);
+    ans.black = cl.get_string("black", ans.black);
+    ans.white = cl.get_string("white", ans.white);
+    ans.random = cl.get_int("random", ans.random);
+    ans.seed = unsigned(cl.get_unsigned("seed", ans.seed));
+    ans.values = cl.has("values");
+    ans.openings = cl.get_string("openings", ans.openings);
+    if (ans.out.empty())
+        throw ReversiError("Usage: selfplay OUT [--games=N] [--threads=N] [--black=DESC] [--white=DESC]"
+            " [--random=N] [--seed=N] [--values] [--openings=FILE]");
+    if (ans.games < 0 || ans.threads <= 0 || ans.random < 0)
+        throw ReversiError("games and random can't be negative, threads should be positive");
+    return ans;
+}
+
+int main(int argc, char** argv) {
+    try {
+        const Options opt = parse_options(argc, argv);
+        std::optional<OpeningSuite> suite;
+        if (!opt.openings.empty()) {
+            suite.emplace(opt.openings);
+            if (!suite->size())
+                throw ReversiError(opt.openings + " has no openings");
+        }
+        // Fail on bad descriptions before any thread starts.
+        make_engine_from_description(opt.black);
+        make_engine_from_description(opt.white);
+        GameWriter writer(opt.out);
+        std::mutex mutex;
+        // Games finished, and Black's wins, draws and losses.
+        int done = 0, wins = 0, draws = 0, losses = 0;
+        std::atomic<int> next = 0;
+        std::string error;
+        const auto start = std::chrono::steady_clock::now();
+        const auto worker = [&] {
+            try {
+                for (int id; (id = next++) < opt.games; ) {
+                    // Fresh engines for every game: a reused MCTS tree keeps
+                    // growing, and a game shouldn't depend on which games
+                    // its thread happened to play before.
+                    const auto black = make_engine_from_description(opt.black);
+                    const auto white = make_engine_from_description(opt.white);
+                    const GameRecord game = play_game(opt, id, *black, *white, suite ? &*suite : nullptr);
+                    std::lock_guard lock(mutex);
+                    writer.write(game);
+                    ++(game.result > 0 ? wins : game.result < 0 ? losses : draws);
+                    if (++done % 100 == 0 || done == opt.games) {
+                        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                        std::cout << done << " games, " << std::lround(done * 3600 / sec) << " per hour" << std::endl;
+                    }
+                }
+            } catch (const ReversiError& e) {
+                // Stop the others too.
+                next = opt.games;
+                std::lock_guard lock(mutex);
+                error = e.what();
+            }
+        };
+        std::vector<std::thread> pool;
+        for (int i = 0; i < opt.threads; i++)
+            pool.emplace_back(worker);
+        for (auto& t : pool)
+            t.join();
+        writer.close();
+        if (!error.empty())
+            throw ReversiError(error);
+        std::cout << "Black +" << wins << " =" << draws << " -" << losses << "\n";
+    } catch (const ReversiError& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
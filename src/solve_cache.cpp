@@ -0,0 +1,239 @@
+#include "solve_cache.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <map>
+
+namespace Reversi {
+    namespace {
+        constexpr char MAGIC[4] = { 'R', 'V', 'S', 'C' };
+        constexpr std::uint32_t VERSION = 1;
+
+        // The caches open in the process, by path.
+        std::mutex open_mutex;
+        std::map<std::string, std::weak_ptr<SolveCache>> open_caches;
+    }
+
+    SolveCache::SolveCache(const std::string& path) : mPath(path) {
+        namespace fs = std::filesystem;
+        if (!fs::exists(path)) {
+            std::ofstream out(path, std::ios::binary);
+            out.write(MAGIC, 4);
+            write_le(out, VERSION, 4);
+            out.close();
+            if (!out)
+                throw ReversiError("Can't create " + path);
+        }
+        mFile = std::make_unique<MappedFile>(path);
+        const unsigned char* p = mFile->data();
+        const std::size_t size = mFile->size();
+        if (size < HEADER_SIZE || !std::equal(MAGIC, MAGIC + 4, p))
+            throw ReversiError(path + " is not a solve cache");
+        if (read_le(p + 4, 4) != VERSION)
+            throw ReversiError(path + " has an unknown cache format version");
+        std::size_t offset = HEADER_SIZE;
+        while (offset + 8 <= size) {
+            const std::uint64_t cnt = read_le(p + offset, 8);
+            if (cnt > (size - offset - 8) / RECORD_SIZE)
+                break;
+            mRuns.push_back({ offset + 8, std::size_t(cnt) });
+            offset += 8 + std::size_t(cnt) * RECORD_SIZE;
+        }
+        if (offset != size) {
+            // The last run was being written when the program died.
+            mFile.reset();
+            std::error_code ec;
+            fs::resize_file(path, offset, ec);
+            if (ec)
+                throw ReversiError("Can't repair " + path + ": " + ec.message());
+            mFile = std::make_unique<MappedFile>(path);
+        }
+        mOut.open(path, std::ios::binary | std::ios::app);
+        if (!mOut)
+            throw ReversiError("Can't write " + path);
+        mWriter = std::thread(&SolveCache::writer_loop, this);
+    }
+
+    SolveCache::~SolveCache() noexcept {
+        {
+            std::lock_guard lock(mMutex);
+            mStop = true;
+        }
+        mWake.notify_all();
+        mWriter.join();
+        try {
+            if (mRuns.size() + mRunsWritten > MAX_RUNS)
+                compact();
+        } catch (const ReversiError& e) {
+            std::cerr << e.what() << "\n";
+        }
+        const Stats& s = mStats;
+        std::cerr << "Solve cache " << mPath << ": " << s.hits << " hits in " << s.lookups << " lookups ("
+            << (s.lookups ? 100.0 * s.hits / s.lookups : 0.0) << "%), saved " << s.saved_seconds
+            << " s of solving, " << s.stored << " results stored\n";
+    }
+
+    std::shared_ptr<SolveCache> SolveCache::open(const std::string& path) {
+        std::lock_guard lock(open_mutex);
+        auto& slot = open_caches[std::filesystem::absolute(path).string()];
+        auto ans = slot.lock();
+        if (!ans) {
+            ans = std::make_shared<SolveCache>(path);
+            slot = ans;
+        }
+        return ans;
+    }
+
+    BitBoard SolveCache::position(const Run& run, std::size_t i) const noexcept {
+        const unsigned char* p = mFile->data() + run.offset + i * RECORD_SIZE;
+        return { read_le(p, 8), read_le(p + 8, 8) };
+    }
+
+    SolveCache::Record SolveCache::record(const Run& run, std::size_t i) const noexcept {
+        const unsigned char* p = mFile->data() + run.offset + i * RECORD_SIZE;
+        return { std::int8_t(p[16]), TransTable::Bound(p[17]), std::int8_t(p[18] == 255 ? -1 : p[18]),
+            std::uint32_t(read_le(p + 20, 4)) };
+    }
+
+    std::optional<EndgameSolver::Result> SolveCache::lookup(const BitBoard& b, int alpha, int beta) {
+        int sym;
+        const BitBoard key = canonical(b, &sym);
+        const auto usable = [&](const Record& r) {
+            return r.bound == TransTable::Bound::Exact || (r.bound == TransTable::Bound::Lower && r.score >= beta)
+                || (r.bound == TransTable::Bound::Upper && r.score <= alpha);
+        };
+        std::optional<Record> found;
+        std::unique_lock lock(mMutex);
+        ++mStats.lookups;
+        if (const auto it = mRecent.find(key); it != mRecent.end() && usable(it->second))
+            found = it->second;
+        lock.unlock();
+        // The file was mapped before any of mRecent was written, so newer
+        // results are always in mRecent.
+        for (auto run = mRuns.rbegin(); run != mRuns.rend() && !found; ++run) {
+            std::size_t lo = 0, hi = run->count;
+            while (lo < hi) {
+                const std::size_t mid = lo + (hi - lo) / 2;
+                if (position(*run, mid) < key)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if (lo < run->count && position(*run, lo) == key && usable(record(*run, lo)))
+                found = record(*run, lo);
+        }
+        if (!found)
+            return std::nullopt;
+        lock.lock();
+        ++mStats.hits;
+        mStats.saved_seconds += found->micros * 1e-6;
+        return EndgameSolver::Result{ found->score,
+            found->move < 0 ? -1 : transform_square(found->move, inverse_symmetry(sym)) };
+    }
+
+    void SolveCache::store(const BitBoard& b, const EndgameSolver::Result& res, int alpha, int beta, double seconds) {
+        int sym;
+        const BitBoard key = canonical(b, &sym);
+        Record r;
+        r.score = std::int8_t(std::clamp(res.score, -64, 64));
+        r.bound = res.score <= alpha ? TransTable::Bound::Upper
+            : res.score >= beta ? TransTable::Bound::Lower : TransTable::Bound::Exact;
+        r.move = std::int8_t(res.move < 0 ? -1 : transform_square(res.move, sym));
+        r.micros = std::uint32_t(std::min(seconds * 1e6, 4e9));
+        std::unique_lock lock(mMutex);
+        auto [it, is_new] = mRecent.try_emplace(key, r);
+        if (!is_new) {
+            // A bound is never worth more than an exact score.
+            if (it->second.bound == TransTable::Bound::Exact)
+                return;
+            it->second = r;
+        }
+        mPending.emplace_back(key, r);
+        ++mStats.stored;
+        if (mPending.size() >= BATCH_SIZE)
+            mWake.notify_one();
+    }
+
+    SolveCache::Stats SolveCache::stats() {
+        std::lock_guard lock(mMutex);
+        return mStats;
+    }
+
+    void SolveCache::write_run(std::vector<std::pair<BitBoard, Record>> batch) {
+        // The later of two results for a position replaced the earlier.
+        std::stable_sort(batch.begin(), batch.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first < rhs.first;
+        });
+        std::vector<std::pair<BitBoard, Record>> run;
+        for (const auto& r : batch) {
+            if (!run.empty() && run.back().first == r.first)
+                run.back() = r;
+            else
+                run.push_back(r);
+        }
+        write_le(mOut, run.size(), 8);
+        for (const auto& [pos, r] : run) {
+            write_le(mOut, pos.own, 8);
+            write_le(mOut, pos.opp, 8);
+            mOut.put(char(r.score));
+            mOut.put(char(r.bound));
+            mOut.put(char(r.move < 0 ? 255 : r.move));
+            mOut.put(0);
+            write_le(mOut, r.micros, 4);
+        }
+        // A whole run at a time, so that a crash loses at most the last one.
+        mOut.flush();
+        ++mRunsWritten;
+    }
+
+    void SolveCache::writer_loop() {
+        std::unique_lock lock(mMutex);
+        while (true) {
+            mWake.wait_for(lock, FLUSH_INTERVAL, [this] {
+                return mStop || mPending.size() >= BATCH_SIZE;
+            });
+            if (!mPending.empty()) {
+                auto batch = std::move(mPending);
+                mPending.clear();
+                lock.unlock();
+                write_run(std::move(batch));
+                lock.lock();
+            }
+            if (mStop && mPending.empty())
+                return;
+        }
+    }
+
+    void SolveCache::compact() {
+        // The best record of each position: exact scores first, then the
+        // newest, which is how lookup() would have found them.
+        std::map<BitBoard, Record> all;
+        const auto merge = [&](const BitBoard& pos, const Record& r) {
+            auto [it, is_new] = all.try_emplace(pos, r);
+            if (!is_new && (r.bound == TransTable::Bound::Exact || it->second.bound != TransTable::Bound::Exact))
+                it->second = r;
+        };
+        for (const auto& run : mRuns) {
+            for (std::size_t i = 0; i < run.count; i++)
+                merge(position(run, i), record(run, i));
+        }
+        for (const auto& [pos, r] : mRecent)
+            merge(pos, r);
+        mOut.close();
+        const std::string tmp = mPath + ".tmp";
+        mOut.open(tmp, std::ios::binary);
+        mOut.write(MAGIC, 4);
+        write_le(mOut, VERSION, 4);
+        write_run(std::vector<std::pair<BitBoard, Record>>(all.begin(), all.end()));
+        mOut.close();
+        if (!mOut)
+            throw ReversiError("Error writing " + tmp);
+        // Windows won't replace a file that is mapped.
+        mFile.reset();
+        mRuns.clear();
+        std::error_code ec;
+        std::filesystem::rename(tmp, mPath, ec);
+        if (ec)
+            throw ReversiError("Can't replace " + mPath + ": " + ec.message());
+    }
+}
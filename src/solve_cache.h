@@ -0,0 +1,137 @@
+// A persistent cache of endgame solver results
+#ifndef REVERSI_SOLVE_CACHE_H
+#define REVERSI_SOLVE_CACHE_H
+#include "bitboard.h"
+#include "endgame.h"
+#include "mapped_file.h"
+#include "ttable.h"
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Reversi {
+    // Solver results kept on disk across runs. Positions are keyed by their
+    // canonical image (see canonical()), and each result is the score with
+    // its bound, as searched with some window, and the best move.
+    //
+    // The file is the magic "RVSC" and the format version as a little endian
+    // 32 bit integer, followed by runs: the number of records as a little
+    // endian 64 bit integer, and the records of RECORD_SIZE bytes sorted by
+    // position:
+    //  - own and opp of the canonical position, little endian 64 bit integers,
+    //  - the score as a signed byte, the bound as a byte (TransTable::Bound)
+    //    and the best move in the frame of the canonical position as a byte
+    //    (255 for a pass), then a zero byte,
+    //  - the microseconds the solve took, a little endian 32 bit integer.
+    // The runs written before are mapped into memory when the cache is opened
+    // and looked up by binary search, newest first. New results are kept in
+    // memory and appended as a new run by a background thread every
+    // BATCH_SIZE results or FLUSH_INTERVAL. At the end the runs are merged
+    // into one if there are more than MAX_RUNS, and the statistics go to
+    // stderr. Only one process should write a cache file at a time.
+    class SolveCache {
+    public:
+        static constexpr std::size_t HEADER_SIZE = 8, RECORD_SIZE = 24;
+        static constexpr std::size_t BATCH_SIZE = 256, MAX_RUNS = 16;
+        static constexpr std::chrono::seconds FLUSH_INTERVAL{ 5 };
+
+        // Positions with fewer empties solve faster than they are looked up.
+        static constexpr int MIN_EMPTIES = 10;
+
+        struct Stats {
+            std::uint64_t lookups = 0, hits = 0;
+            // The solving time of the results found, which was saved.
+            double saved_seconds = 0;
+            // The results stored in this run.
+            std::uint64_t stored = 0;
+        };
+
+    private:
+        struct Record {
+            std::int8_t score = 0;
+            TransTable::Bound bound = TransTable::Bound::None;
+            // In the frame of the canonical position, -1 for a pass.
+            std::int8_t move = -1;
+            std::uint32_t micros = 0;
+        };
+
+        struct Hasher {
+            std::size_t operator () (const BitBoard& b) const noexcept {
+                return std::size_t(b.hash());
+            }
+        };
+
+        struct Run {
+            std::size_t offset, count;
+        };
+
+        const std::string mPath;
+
+        // The runs in the file when it was opened, oldest first.
+        std::unique_ptr<MappedFile> mFile;
+        std::vector<Run> mRuns;
+
+        // Guards everything below.
+        std::mutex mMutex;
+        // All the results of this run, and the ones not yet written.
+        std::unordered_map<BitBoard, Record, Hasher> mRecent;
+        std::vector<std::pair<BitBoard, Record>> mPending;
+        Stats mStats;
+        bool mStop = false;
+        std::condition_variable mWake;
+
+        // Appends to the file. Only the writer touches it, and the
+        // destructor after the writer is done.
+        std::ofstream mOut;
+        std::size_t mRunsWritten = 0;
+        std::thread mWriter;
+
+        // The position of entry i of the run, and the rest of it.
+        BitBoard position(const Run& run, std::size_t i) const noexcept;
+        Record record(const Run& run, std::size_t i) const noexcept;
+
+        // Appends the records as a run, sorted and without duplicates.
+        void write_run(std::vector<std::pair<BitBoard, Record>> batch);
+
+        // Rewrites the file with a single run holding the best record of each
+        // position.
+        void compact();
+
+        void writer_loop();
+
+    public:
+        // Opens or creates the cache file, throwing ReversiError if it can't
+        // or it isn't a cache. A run cut short by a crash is dropped.
+        explicit SolveCache(const std::string& path);
+
+        SolveCache(const SolveCache&) = delete;
+        SolveCache& operator = (const SolveCache&) = delete;
+
+        // Writes what is left, and reports the statistics.
+        ~SolveCache() noexcept;
+
+        // The cache of the file, shared by everything in the process that
+        // opens the same path, so that they don't write it over each other.
+        static std::shared_ptr<SolveCache> open(const std::string& path);
+
+        // (Any thread) A result for b that answers a search with the window
+        // (alpha, beta): an exact score, or a bound that falls outside the
+        // window. Nothing if there isn't one.
+        std::optional<EndgameSolver::Result> lookup(const BitBoard& b, int alpha, int beta);
+
+        // (Any thread) Stores the result of searching b with the window
+        // (alpha, beta), which took `seconds`.
+        void store(const BitBoard& b, const EndgameSolver::Result& res, int alpha, int beta, double seconds);
+
+        Stats stats();
+    };
+}
+
+#endif
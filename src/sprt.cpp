@@ -0,0 +1,151 @@
+// Tells whether an engine is stronger than another with as few games as it
+// takes, by a sequential probability ratio test.
+// Usage: sprt --test=DESC --base=DESC [--elo0=X] [--elo1=X] [--alpha=X]
+//             [--beta=X] [--max-pairs=N] [--concurrency=N] [--random=N]
+//             [--seed=N] [--out=FILE] [--openings=FILE] [--solve=N]
+//             [--resign=N] [--resign-moves=N]
+//
+// Games are played in pairs: each random opening (`random` plies, default 8,
+// pair i seeded with seed + i) once with the engine tested as Black and once
+// as White. With --openings pair i plays opening i of the suite instead,
+// going round it if needed. The pairs are played `concurrency` games at a time through
+// play_games(), and fed to the test as both of their games end. The test
+// stops as soon as it accepts that the engine tested is elo0 (default 0) or
+// elo1 (default 10) Elo stronger than the base, with error rates alpha and
+// beta (default 0.05 each), or after max-pairs pairs. With --out the games
+// are written as JSON lines like the match tool does, which also adjudicates
+// games the same way with --solve and --resign.
+#include "arena.h"
+#include "command_line.h"
+#include "elo.h"
+#include "engi.h"
+#include "opening_suite.h"
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <thread>
+
+using namespace Reversi;
+
+struct Options {
+    std::string test, base, out, openings;
+    double elo0 = 0, elo1 = 10, alpha = 0.05, beta = 0.05;
+    int max_pairs = 20000;
+    int concurrency = std::max(1, int(std::thread::hardware_concurrency()));
+    int random = 8;
+    unsigned seed = 1;
+    Adjudication adjudication;
+};
+
+static Options parse_options(int argc, char** argv) {
+    Options ans;
+    const auto cl = CommandLine::parse(argc, argv);
+    if (!cl.positional.empty())
+        throw ReversiError("Expected --key=value: " + cl.positional.front());
+    cl.check_keys({ "test", "base", "out", "openings", "solve", "resign", "resign-moves",
+        "elo0", "elo1", "alpha", "beta", "max-pairs", "concurrency", "random", "seed" });
+    ans.test = cl.get_string("test", ans.test);
+    ans.base = cl.get_string("base", ans.base);
+    ans.out = cl.get_string("out", ans.out);
+    ans.openings = cl.get_string("openings", ans.openings);
+    ans.adjudication.solve_empties = cl.get_int("solve", ans.adjudication.solve_empties);
+    ans.adjudication.resign_score = cl.get_int("resign", ans.adjudication.resign_score);
+    ans.adjudication.resign_moves = cl.get_int("resign-moves", ans.adjudication.resign_moves);
+    ans.elo0 = cl.get_double("elo0", ans.elo0);
+    ans.elo1 = cl.get_double("elo1", ans.elo1);
+    ans.alpha = cl.get_double("alpha", ans.alpha);
+    ans.beta = cl.get_double("beta", ans.beta);
+    ans.max_pairs = cl.get_int("max-pairs", ans.max_pairs);
+    ans.concurrency = cl.get_int("concurrency", ans.concurrency);
+    ans.random = cl.get_int("random", ans.random);
+    ans.seed = unsigned(cl.get_unsigned("seed", ans.seed));
+    if (ans.test.empty() || ans.base.empty())
+        throw ReversiError("Usage: sprt --test=DESC --base=DESC [--elo0=X] [--elo1=X] [--alpha=X] [--beta=X]"
+            " [--max-pairs=N] [--concurrency=N] [--random=N] [--seed=N] [--out=FILE] [--openings=FILE]"
+            " [--solve=N] [--resign=N] [--resign-moves=N]");
+    if (ans.max_pairs < 0 || ans.concurrency <= 0 || ans.random < 0)
+        throw ReversiError("max-pairs and random can't be negative, concurrency should be positive");
+    if (ans.adjudication.solve_empties < 0 || ans.adjudication.resign_score < 0 || ans.adjudication.resign_moves <= 0)
+        throw ReversiError("solve and resign can't be negative, resign-moves should be positive");
+    if (ans.adjudication.solve_empties > Adjudication::MAX_SOLVE_EMPTIES)
+        throw ReversiError("solve should be at most " + std::to_string(Adjudication::MAX_SOLVE_EMPTIES));
+    return ans;
+}
+
+static void report(const Sprt& sprt) {
+    const auto [elo, error] = sprt.elo();
+    std::cout << sprt.pairs() << " pairs, Elo " << elo << " +- " << error << ", LLR " << sprt.llr()
+        << " (" << sprt.lower_bound() << ", " << sprt.upper_bound() << ")" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    try {
+        const Options opt = parse_options(argc, argv);
+        Sprt sprt(opt.elo0, opt.elo1, opt.alpha, opt.beta);
+        std::optional<OpeningSuite> suite;
+        if (!opt.openings.empty()) {
+            suite.emplace(opt.openings);
+            if (!suite->size())
+                throw ReversiError(opt.openings + " has no openings");
+        }
+        std::ofstream out;
+        if (!opt.out.empty()) {
+            out.open(opt.out);
+            if (!out)
+                throw ReversiError("Can't write " + opt.out);
+        }
+        // The score of the engine tested in the first game of a pair to end,
+        // until the other one does.
+        std::map<int, double> halves;
+        // Game 2i is pair i with the engine tested as Black, 2i + 1 as White.
+        play_games(2 * opt.max_pairs, opt.concurrency, [&](int id) {
+            const auto opening = suite ? suite->annotation(id / 2 % suite->size())
+                : random_opening(opt.seed + unsigned(id / 2), opt.random);
+            if (id % 2 == 0)
+                return ArenaGame{ opt.test, opt.base, opening };
+            return ArenaGame{ opt.base, opt.test, opening };
+        }, [&](int id, const nlohmann::json& game) {
+            if (out.is_open()) {
+                nlohmann::json line = game;
+                line["game"] = id;
+                out << line.dump() << "\n";
+            }
+            int result = game["result"];
+            if (id % 2)
+                result = -result;
+            const double score = result > 0 ? 1 : result < 0 ? 0 : 0.5;
+            const auto other = halves.find(id / 2);
+            if (other == halves.end()) {
+                halves.emplace(id / 2, score);
+                return true;
+            }
+            sprt.add_pair(other->second, score);
+            halves.erase(other);
+            if (sprt.pairs() % 20 == 0)
+                report(sprt);
+            return sprt.verdict() == Sprt::Verdict::Continue;
+        }, opt.adjudication);
+        report(sprt);
+        switch (sprt.verdict()) {
+        case Sprt::Verdict::AcceptH0:
+            std::cout << "H0 accepted: " << opt.test << " is not " << opt.elo1 << " Elo stronger than " << opt.base << "\n";
+            break;
+        case Sprt::Verdict::AcceptH1:
+            std::cout << "H1 accepted: " << opt.test << " is more than " << opt.elo0 << " Elo stronger than " << opt.base << "\n";
+            break;
+        case Sprt::Verdict::Continue:
+            std::cout << "Inconclusive after " << opt.max_pairs << " pairs\n";
+            break;
+        }
+        if (out.is_open()) {
+            out.close();
+            if (!out)
+                throw ReversiError("Error writing " + opt.out);
+        }
+    } catch (const ReversiError& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
@@ -1,4 +1,6 @@
 #include "game.h"
+#include "record.h"
+#include <cstdio>
 #include <doctest.h>
 
 namespace Reversi {
@@ -84,4 +86,49 @@ namespace Reversi {
         Board b;
         CHECK_THROWS_AS(b.place(0, -1), std::out_of_range);
     }
-}
\ No newline at end of file
+
+    TEST_CASE("game records") {
+        // A whole game, playing the lowest legal square each time.
+        GameRecord game;
+        BitBoard b = BitBoard::from_board(Board());
+        while (b.moves() || b.pass().moves()) {
+            if (b.moves()) {
+                game.moves.push_back(std::uint8_t(std::countr_zero(b.moves())));
+                b = b.play(game.moves.back());
+            } else {
+                game.moves.push_back(GameRecord::PASS);
+                b = b.pass();
+            }
+        }
+        const auto pos = game.positions();
+        REQUIRE(pos.size() == game.moves.size() + 1);
+        CHECK(pos.back() == b);
+        game.result = pos.size() % 2 ? b.final_score() : -b.final_score();
+        game.values.assign(game.moves.size(), GameRecord::NO_VALUE);
+        game.values[0] = -3;
+
+        const std::string path = "test_records.bin";
+        {
+            GameWriter out(path);
+            out.write(game);
+            out.write(GameRecord());
+            out.close();
+        }
+        GameReader in(path);
+        GameRecord read;
+        REQUIRE(in.next(read));
+        CHECK(read.moves == game.moves);
+        CHECK(read.result == game.result);
+        CHECK(read.values == game.values);
+        REQUIRE(in.next(read));
+        CHECK(read.moves.empty());
+        CHECK(read.values.empty());
+        CHECK(!in.next(read));
+        std::remove(path.c_str());
+
+        // The first move in the annotation of GameMan, and an illegal pass.
+        CHECK(GameRecord::from_json(nlohmann::json::parse(R"({"annotation": [[3, 5]]})")).moves
+            == std::vector<std::uint8_t>{ std::uint8_t(to_index(3, 5)) });
+        CHECK_THROWS_AS(GameRecord::from_json(nlohmann::json::parse(R"({"annotation": [[0, 0]]})")).positions(), ReversiError);
+    }
+}
@@ -0,0 +1,195 @@
+#include "pattern.h"
+#include "nnue.h"
+#include "batch_eval.h"
+#include <doctest.h>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <thread>
+#include <tuple>
+
+namespace Reversi {
+    TEST_CASE("pattern instances") {
+        std::uint64_t covered = 0;
+        for (int i = 0; i < Patterns::INSTANCES; i++) {
+            const auto& squares = Patterns::SQUARES_OF[i];
+            REQUIRE(int(squares.size()) == Patterns::SIZE[Patterns::PATTERN_OF[i]]);
+            for (const int sq : squares)
+                covered |= std::uint64_t(1) << sq;
+        }
+        CHECK(covered == ~std::uint64_t(0));
+    }
+
+    TEST_CASE("pattern indices are updated incrementally") {
+        std::mt19937 mt(1357);
+        for (int game = 0; game < 20; game++) {
+            BitBoard b = BitBoard::from_board(Board());
+            PatternState s(b);
+            struct Move {
+                BitBoard before;
+                int sq;
+                std::uint64_t flips;
+            };
+            std::vector<Move> history;
+            for (int passes = 0; passes < 2; ) {
+                std::uint64_t moves = b.moves();
+                if (!moves) {
+                    b = b.pass();
+                    s.pass();
+                    history.push_back({ b.pass(), -1, 0 });
+                    ++passes;
+                    continue;
+                }
+                passes = 0;
+                for (int k = mt() % std::popcount(moves); k > 0; k--)
+                    moves &= moves - 1;
+                const int sq = std::countr_zero(moves);
+                const std::uint64_t flips = b.flips(sq);
+                history.push_back({ b, sq, flips });
+                s.play(sq, flips);
+                b = b.play(sq);
+                REQUIRE(s == PatternState(b));
+            }
+            while (!history.empty()) {
+                const Move m = history.back();
+                history.pop_back();
+                if (m.sq < 0)
+                    s.pass();
+                else
+                    s.undo(m.sq, m.flips);
+                REQUIRE(s == PatternState(m.before));
+            }
+        }
+    }
+
+    TEST_CASE("pattern weights are saved and loaded") {
+        std::mt19937 mt(2468);
+        PatternWeights w;
+        for (int phase = 0; phase < Patterns::PHASES; phase++) {
+            for (int i = 0; i < PatternWeights::PHASE_SIZE; i++)
+                w.at(phase, i) = std::int16_t(mt());
+        }
+        const std::string path = "test_weights.bin";
+        w.save(path);
+        const PatternWeights w2 = PatternWeights::load(path);
+        std::remove(path.c_str());
+        bool same = true;
+        for (int phase = 0; phase < Patterns::PHASES; phase++) {
+            for (int i = 0; i < PatternWeights::PHASE_SIZE; i++)
+                same = same && w.at(phase, i) == w2.at(phase, i);
+        }
+        CHECK(same);
+        CHECK_THROWS_AS(PatternWeights::load("no_such_weights.bin"), ReversiError);
+    }
+
+    TEST_CASE("pattern evaluation reads the weights of the side to move") {
+        PatternWeights w;
+        const int phase = Patterns::phase_of(60);
+        // Own corners are worth 2 discs each, opponent corners -2.
+        const int corner = Patterns::OFFSET[Patterns::Corner3x3];
+        w.at(phase, corner + 1) = 2 * PatternWeights::SCALE;
+        w.at(phase, corner + 2) = -2 * PatternWeights::SCALE;
+        BitBoard b = BitBoard::from_board(Board());
+        b.own |= 1;
+        CHECK(w.eval(PatternState(b), b) == 2);
+        CHECK(w.eval(PatternState(b.pass()), b.pass()) == -2);
+    }
+
+    TEST_CASE("network accumulators are updated incrementally") {
+        const NnueNetwork net = NnueNetwork::random(97);
+        std::mt19937 mt(8642);
+        for (int game = 0; game < 10; game++) {
+            BitBoard b = BitBoard::from_board(Board());
+            NnueAccumulator acc(net, b);
+            std::vector<std::tuple<BitBoard, int, std::uint64_t>> history;
+            while (b.moves() || b.pass().moves()) {
+                std::uint64_t moves = b.moves();
+                if (!moves) {
+                    history.emplace_back(b, -1, 0);
+                    acc.pass();
+                    b = b.pass();
+                    continue;
+                }
+                for (int k = mt() % std::popcount(moves); k > 0; k--)
+                    moves &= moves - 1;
+                const int sq = std::countr_zero(moves);
+                const std::uint64_t flips = b.flips(sq);
+                history.emplace_back(b, sq, flips);
+                acc.play(sq, flips);
+                b = b.play(sq);
+                REQUIRE(acc == NnueAccumulator(net, b));
+                REQUIRE(net.eval(acc) == net.eval(b));
+            }
+            while (!history.empty()) {
+                const auto [before, sq, flips] = history.back();
+                history.pop_back();
+                if (sq < 0)
+                    acc.pass();
+                else
+                    acc.undo(sq, flips);
+                REQUIRE(acc == NnueAccumulator(net, before));
+            }
+        }
+    }
+
+    TEST_CASE("networks are saved and loaded") {
+        const NnueNetwork net = NnueNetwork::random(531);
+        const std::string path = "test_network.bin";
+        net.save(path);
+        const NnueNetwork net2 = NnueNetwork::load(path);
+        std::remove(path.c_str());
+        // The evaluations differ, so they tell networks apart.
+        BitBoard b = BitBoard::from_board(Board());
+        std::set<int> scores;
+        bool same = true;
+        for (int i = 0; i < 30 && b.moves(); i++) {
+            scores.insert(net.eval(b));
+            same = same && net.eval(b) == net2.eval(b);
+            b = b.play(std::countr_zero(b.moves()));
+        }
+        CHECK(same);
+        CHECK(scores.size() > 3);
+        CHECK_THROWS_AS(NnueNetwork::load("no_such_network.bin"), ReversiError);
+    }
+
+    TEST_CASE("networks evaluate batches like single positions") {
+        const NnueNetwork net = NnueNetwork::random(77);
+        std::mt19937 mt(99);
+        std::vector<BitBoard> pos;
+        BitBoard b = BitBoard::from_board(Board());
+        while (pos.size() < 21) {
+            std::uint64_t moves = b.moves();
+            if (!moves) {
+                b = BitBoard::from_board(Board());
+                continue;
+            }
+            pos.push_back(b);
+            for (int k = mt() % std::popcount(moves); k > 0; k--)
+                moves &= moves - 1;
+            b = b.play(std::countr_zero(moves));
+        }
+        std::vector<int> scores(pos.size());
+        net.eval_batch(pos.data(), scores.data(), pos.size());
+        bool same = true;
+        for (std::size_t i = 0; i < pos.size(); i++)
+            same = same && scores[i] == net.eval(pos[i]);
+        CHECK(same);
+
+        // Three threads share batches of two, so some batches time out.
+        BatchEvaluator batch(net, 2, std::chrono::microseconds(200));
+        std::vector<int> batched(pos.size());
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 3; t++) {
+            threads.emplace_back([&, t] {
+                for (std::size_t i = t; i < pos.size(); i += 3)
+                    batched[i] = batch.eval(pos[i]);
+            });
+        }
+        for (auto& t : threads)
+            t.join();
+        CHECK(batched == scores);
+        const auto stats = batch.stats();
+        CHECK(stats.positions == pos.size());
+        CHECK(stats.batches >= (pos.size() + 1) / 2);
+    }
+}
@@ -0,0 +1,883 @@
+#include "bitboard.h"
+#include "endgame.h"
+#include "eval.h"
+#include "alphabeta.h"
+#include "book.h"
+#include "solve_cache.h"
+#include "mctse.h"
+#include "thread_pool.h"
+#include "coro.h"
+#include "mpsc_queue.h"
+#include "arena.h"
+#include "elo.h"
+#include "opening_suite.h"
+#include "record.h"
+#include "command_line.h"
+#include <filesystem>
+#include <map>
+#include <doctest.h>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <thread>
+
+namespace Reversi {
+    // Plays random moves from the initial position until `empties` squares are left,
+    // or the game ends.
+    static Board random_position(std::mt19937& mt, int empties) {
+        Board b;
+        bool prev_skip = false;
+        for (int left = 60; left > empties; ) {
+            const auto plc = b.get_placable();
+            if (plc.empty()) {
+                if (prev_skip)
+                    break;
+                b.skip();
+                prev_skip = true;
+                continue;
+            }
+            const auto [x, y] = plc[mt() % plc.size()];
+            b.place(x, y);
+            prev_skip = false;
+            --left;
+        }
+        return b;
+    }
+
+    // Plain minimax over Board, as the reference for the solver.
+    static int reference_score(const Board& b, bool passed) {
+        const auto plc = b.get_placable();
+        if (plc.empty()) {
+            if (passed)
+                return BitBoard::from_board(b).final_score();
+            Board b2 = b;
+            b2.skip();
+            return -reference_score(b2, true);
+        }
+        int best = -65;
+        for (const auto& [x, y] : plc) {
+            Board b2 = b;
+            b2.place(x, y);
+            best = std::max(best, -reference_score(b2, false));
+        }
+        return best;
+    }
+
+    // A record of a saved MCTS tree, seen from the player to move.
+    struct SavedRecord {
+        std::uint32_t sims;
+        float value;
+        std::uint32_t amaf_n;
+        float amaf_value;
+    };
+
+    // The records of the tree file at `path`, by position.
+    static std::map<BitBoard, SavedRecord> read_tree(const std::string& path) {
+        std::map<BitBoard, SavedRecord> ans;
+        const MappedFile file(path);
+        for (std::size_t i = 16; i < file.size(); i += 36) {
+            const unsigned char* p = file.data() + i;
+            ans[BitBoard{ read_le(p, 8), read_le(p + 8, 8) }] = {
+                std::uint32_t(read_le(p + 16, 4)), std::bit_cast<float>(std::uint32_t(read_le(p + 20, 4))),
+                std::uint32_t(read_le(p + 24, 4)), std::bit_cast<float>(std::uint32_t(read_le(p + 28, 4))) };
+        }
+        return ans;
+    }
+
+    TEST_CASE("bitboard agrees with board") {
+        std::mt19937 mt(12345);
+        for (int i = 0; i < 200; i++) {
+            Board b = random_position(mt, mt() % 60);
+            const BitBoard bb = BitBoard::from_board(b);
+            std::uint64_t expected = 0;
+            for (const auto& [x, y] : b.get_placable())
+                expected |= std::uint64_t(1) << to_index(x, y);
+            REQUIRE(bb.moves() == expected);
+            for (const auto& [x, y] : b.get_placable()) {
+                Board b2 = b;
+                b2.place(x, y);
+                CHECK(bb.play(to_index(x, y)) == BitBoard::from_board(b2));
+            }
+        }
+    }
+
+    TEST_CASE("index conversion") {
+        CHECK(to_index(1, 1) == 0);
+        CHECK(to_index(8, 8) == 63);
+        CHECK(from_index(to_index(3, 7)) == std::pair(3, 7));
+    }
+
+    TEST_CASE("board symmetries") {
+        std::mt19937 mt(777);
+        for (int t = 0; t < SYMMETRIES; t++) {
+            for (int sq = 0; sq < 64; sq++) {
+                CHECK(transform_squares(std::uint64_t(1) << sq, t) == std::uint64_t(1) << transform_square(sq, t));
+                CHECK(transform_square(transform_square(sq, t), inverse_symmetry(t)) == sq);
+            }
+        }
+        for (int i = 0; i < 50; i++) {
+            const BitBoard b = BitBoard::from_board(random_position(mt, mt() % 60));
+            int sym;
+            const BitBoard key = canonical(b, &sym);
+            CHECK(transform(b, sym) == key);
+            for (int t = 0; t < SYMMETRIES; t++) {
+                const BitBoard img = transform(b, t);
+                CHECK(canonical(img) == key);
+                // The moves are symmetric too.
+                CHECK(img.moves() == transform_squares(b.moves(), t));
+            }
+        }
+    }
+
+    TEST_CASE("opening book lookup") {
+        // The four first moves are symmetric, so one entry covers them all.
+        const BitBoard start = BitBoard::from_board(Board());
+        const int first = to_index(3, 5);
+        int sym;
+        const BitBoard key = canonical(start, &sym);
+        const BitBoard after = start.play(first);
+        int after_sym;
+        const BitBoard after_key = canonical(after, &after_sym);
+        const int reply = std::countr_zero(after.moves());
+        const std::string path = "test_book.bin";
+        OpeningBook::write(path, {
+            { after_key, { transform_square(reply, after_sym), -2, 7 } },
+            { key, { transform_square(first, sym), 1, 10 } },
+            { after_key, { transform_square(std::countr_zero(after.moves() & (after.moves() - 1)), after_sym), 3, 1 } },
+        });
+        {
+            const OpeningBook book(path);
+            CHECK(book.size() == 3);
+            for (int t = 0; t < SYMMETRIES; t++) {
+                const auto m = book.best_move(transform(start, t));
+                REQUIRE(m);
+                // The start is symmetric itself, so any of the images of the
+                // move will do.
+                CHECK(canonical(transform(start, t).play(m->sq)) == after_key);
+                CHECK(m->score == 1);
+                CHECK(m->visits == 10);
+                CHECK(book.lookup(transform(after, t)).size() == 2);
+            }
+            CHECK(book.best_move(after)->score == 3);
+            CHECK(!book.best_move(after.play(reply)));
+        }
+        std::remove(path.c_str());
+        CHECK_THROWS_AS(OpeningBook("no_such_book.bin"), ReversiError);
+    }
+
+    TEST_CASE("endgame solver is exact") {
+        std::mt19937 mt(4321);
+        // Covers each of the special routines for the last empties.
+        for (int i = 0; i < 40; i++) {
+            const Board b = random_position(mt, 1 + i % 8);
+            const BitBoard bb = BitBoard::from_board(b);
+            const int expected = reference_score(b, false);
+            EndgameSolver solver;
+            const auto res = solver.solve(bb);
+            CHECK(res.score == expected);
+            // The null window only needs to get the sign right.
+            const int wld = solver.solve(bb, -1, 1).score;
+            CHECK((wld > 0) == (expected > 0));
+            CHECK((wld < 0) == (expected < 0));
+            // The best move has to achieve the score.
+            if (res.move >= 0) {
+                const auto [x, y] = from_index(res.move);
+                Board b2 = b;
+                b2.place(x, y);
+                CHECK(-reference_score(b2, false) == expected);
+            }
+        }
+    }
+
+    TEST_CASE("endgame solver agrees with itself through the hash table") {
+        std::mt19937 mt(8642);
+        for (int i = 0; i < 4; i++) {
+            const BitBoard bb = BitBoard::from_board(random_position(mt, 12));
+            EndgameSolver solver;
+            const int score = solver.solve(bb).score;
+            // Again with the table filled in.
+            CHECK(solver.solve(bb).score == score);
+            // Windows that miss the score give bounds on the right side.
+            CHECK(EndgameSolver().solve(bb, score, score + 10).score <= score);
+            CHECK(EndgameSolver().solve(bb, score - 10, score).score >= score);
+            CHECK(EndgameSolver().solve(bb, score - 1, score + 1).score == score);
+            std::uint64_t moves = bb.moves();
+            if (!moves)
+                continue;
+            int best = -65;
+            for (; moves; moves &= moves - 1)
+                best = std::max(best, -EndgameSolver().solve(bb.play(std::countr_zero(moves))).score);
+            CHECK(best == score);
+        }
+    }
+
+    TEST_CASE("parallel endgame solver agrees with the sequential one") {
+        std::mt19937 mt(9753);
+        // Splitting this close to the end makes plenty of split points.
+        EndgameSolver seq, par(4, 4, 8);
+        for (int i = 0; i < 6; i++) {
+            const BitBoard bb = BitBoard::from_board(random_position(mt, 14));
+            CHECK(par.solve(bb).score == seq.solve(bb).score);
+            const int wld = seq.solve(bb, -1, 1).score;
+            CHECK((par.solve(bb, -1, 1).score > 0) == (wld > 0));
+        }
+        std::uint64_t splits = 0;
+        for (const auto& s : par.split_stats())
+            splits += s.splits;
+        CHECK(splits > 0);
+    }
+
+    TEST_CASE("thread pool runs nested tasks and passes exceptions on") {
+        ThreadPool pool(3, false);
+        std::atomic<int> sum = 0;
+        {
+            TaskGroup outer(pool);
+            for (int i = 0; i < 8; i++) {
+                outer.run([&pool, &sum, i] {
+                    // Waiting inside a task runs the inner ones if the
+                    // workers are all busy.
+                    TaskGroup inner(pool);
+                    for (int j = 0; j < 8; j++)
+                        inner.run([&sum, i, j] { sum += i * 8 + j; });
+                    inner.wait();
+                });
+            }
+            outer.wait();
+        }
+        CHECK(sum == 64 * 63 / 2);
+        TaskGroup group(pool);
+        group.run([] { throw ReversiError("task failed"); });
+        group.run([&sum] { ++sum; });
+        CHECK_THROWS_AS(group.wait(), ReversiError);
+        CHECK(sum == 64 * 63 / 2 + 1);
+        // The error is reported once.
+        group.wait();
+    }
+
+    TEST_CASE("command queue keeps each producer's order") {
+        // Small, so that the producers often find it full.
+        MpscQueue<std::pair<int, int>> queue(8);
+        CHECK(queue.capacity() == 8);
+        CHECK(!queue.try_pop());
+        constexpr int PRODUCERS = 4, ITEMS = 5000;
+        std::vector<std::thread> producers;
+        for (int p = 0; p < PRODUCERS; p++) {
+            producers.emplace_back([&queue, p] {
+                for (int i = 0; i < ITEMS; i++)
+                    queue.push({ p, i });
+            });
+        }
+        std::array<int, PRODUCERS> next{};
+        bool in_order = true;
+        for (int n = 0; n < PRODUCERS * ITEMS; n++) {
+            const auto [p, i] = queue.pop();
+            in_order &= i == next[p]++;
+        }
+        for (auto& t : producers)
+            t.join();
+        CHECK(in_order);
+        CHECK(!queue.try_pop());
+    }
+
+    TEST_CASE("games are played to the end without the GUI") {
+        const std::vector<std::pair<int, int>> opening{ { 3, 5 }, { 3, 6 } };
+        std::vector<int> seen;
+        const int played = play_games(3, 2, [&](int) {
+            return ArenaGame{ "AlphaBeta:depth=1", "AlphaBeta:depth=2", opening };
+        }, [&](int id, const nlohmann::json& js) {
+            seen.push_back(id);
+            CHECK(js["white"] == "AlphaBeta:depth=2");
+            CHECK(js["annotation"][1] == nlohmann::json::array({ 3, 6 }));
+            const GameRecord game = GameRecord::from_json(js);
+            CHECK(game.result == js["result"]);
+            // Played out: nobody can move at the end.
+            const BitBoard end = game.positions().back();
+            CHECK(!end.moves());
+            CHECK(!end.pass().moves());
+            return true;
+        });
+        CHECK(played == 3);
+        std::sort(seen.begin(), seen.end());
+        CHECK(seen == std::vector{ 0, 1, 2 });
+        // Stopping leaves the games in progress.
+        CHECK(play_games(5, 2, [](int) {
+            return ArenaGame{ "AlphaBeta:depth=1", "AlphaBeta:depth=1", {} };
+        }, [](int, const nlohmann::json&) {
+            return false;
+        }) == 1);
+        CHECK_THROWS_AS(play_games(1, 1, [](int) {
+            return ArenaGame{ "Nobody", "AlphaBeta", {} };
+        }, [](int, const nlohmann::json&) {
+            return true;
+        }), ReversiError);
+    }
+
+    TEST_CASE("decided games are adjudicated") {
+        Adjudication solve;
+        solve.solve_empties = 12;
+        play_games(2, 2, [](int id) {
+            return ArenaGame{ "AlphaBeta:depth=1", "AlphaBeta:depth=2", random_opening(unsigned(id), 4) };
+        }, [](int, const nlohmann::json& js) {
+            REQUIRE(js.contains("adjudicated"));
+            CHECK(js["result"] == js["adjudicated"]);
+            // Solved right after the move that left 12 empties.
+            const GameRecord game = GameRecord::from_json(js);
+            const BitBoard end = game.positions().back();
+            CHECK(end.empties() == 12);
+            EndgameSolver solver;
+            const int score = solver.solve(end).score;
+            CHECK(game.result == (game.moves.size() % 2 ? -score : score));
+            return true;
+        }, solve);
+        Adjudication resign;
+        resign.resign_score = 1;
+        resign.resign_moves = 2;
+        play_games(1, 1, [](int) {
+            return ArenaGame{ "AlphaBeta:depth=1", "AlphaBeta:depth=3", {} };
+        }, [](int, const nlohmann::json& js) {
+            REQUIRE(js.contains("adjudicated"));
+            CHECK(js["annotation"].size() < 60);
+            CHECK(std::abs(int(js["adjudicated"])) >= 1);
+            return true;
+        }, resign);
+    }
+
+    TEST_CASE("game managers stop adjudicating when destroyed") {
+        struct Quiet : GameObserver {
+            void update_board(const Board&, std::pair<int, int>) override {}
+            void announce_game_result(MatchResult) override {}
+        } obs;
+        const auto start = std::chrono::steady_clock::now();
+        {
+            const auto man = GameMan::create(obs);
+            // Far more empties than a solve could finish with.
+            Adjudication adj;
+            adj.solve_empties = 40;
+            man->set_adjudication(adj);
+            man->load_black_engine(make_engine_from_description("AlphaBeta:depth=1"));
+            man->load_white_engine(make_engine_from_description("AlphaBeta:depth=1"));
+            man->start_new();
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+    }
+
+    TEST_CASE("SPRT accepts the better hypothesis") {
+        CHECK(elo_to_score(0) == doctest::Approx(0.5));
+        CHECK(score_to_elo(elo_to_score(120)) == doctest::Approx(120));
+        CHECK(score_to_elo(1) > 1e9);
+        CHECK_THROWS_AS(Sprt(5, 5, 0.05, 0.05), ReversiError);
+        CHECK_THROWS_AS(Sprt(0, 5, 0, 0.05), ReversiError);
+        // Scores 60%, about 70 Elo.
+        Sprt stronger(0, 10, 0.05, 0.05);
+        CHECK(stronger.verdict() == Sprt::Verdict::Continue);
+        for (int i = 0; stronger.verdict() == Sprt::Verdict::Continue && i < 10000; i++)
+            stronger.add_pair(i % 5 ? 0.5 : 1, i % 5 < 3 ? 1 : 0);
+        CHECK(stronger.verdict() == Sprt::Verdict::AcceptH1);
+        CHECK(stronger.pairs() < 1000);
+        const auto [elo, error] = stronger.elo();
+        CHECK(error > 0);
+        CHECK(std::abs(elo - 70) < 2 * error);
+        // Even, so it isn't 10 Elo stronger.
+        Sprt even(0, 10, 0.05, 0.05);
+        for (int i = 0; even.verdict() == Sprt::Verdict::Continue && i < 100000; i++)
+            even.add_pair(i % 2, i % 3 ? 0.5 : 1 - i % 2);
+        CHECK(even.verdict() == Sprt::Verdict::AcceptH0);
+        // Pairs that are all alike still conclude: an engine against itself
+        // isn't stronger, and one that wins every game is.
+        Sprt same(0, 10, 0.05, 0.05);
+        for (int i = 0; same.verdict() == Sprt::Verdict::Continue && i < 10000; i++)
+            same.add_pair(1, 0);
+        CHECK(same.verdict() == Sprt::Verdict::AcceptH0);
+        CHECK(same.pairs() < 1000);
+        CHECK(same.elo().first == doctest::Approx(0));
+        Sprt sweep(0, 10, 0.05, 0.05);
+        for (int i = 0; sweep.verdict() == Sprt::Verdict::Continue && i < 10000; i++)
+            sweep.add_pair(1, 1);
+        CHECK(sweep.verdict() == Sprt::Verdict::AcceptH1);
+        CHECK(sweep.pairs() < 100);
+    }
+
+    TEST_CASE("opening suites hold each position once") {
+        CHECK(OpeningSuite::enumerate(1).size() == 1);
+        // The diagonal, perpendicular and parallel openings.
+        CHECK(OpeningSuite::enumerate(2).size() == 3);
+        const auto lines = OpeningSuite::enumerate(6);
+        // The same positions, one ply at a time on this thread.
+        std::set<BitBoard> level{ canonical(BitBoard::from_board(Board())) };
+        for (int ply = 0; ply < 6; ply++) {
+            std::set<BitBoard> next;
+            for (const BitBoard& b : level) {
+                for (std::uint64_t m = b.moves(); m; m &= m - 1)
+                    next.insert(canonical(b.play(std::countr_zero(m))));
+            }
+            level = std::move(next);
+        }
+        REQUIRE(lines.size() == level.size());
+        std::set<BitBoard> reached;
+        for (const auto& line : lines) {
+            BitBoard b = BitBoard::from_board(Board());
+            for (const std::uint8_t sq : line) {
+                REQUIRE((b.moves() >> sq & 1));
+                b = b.play(sq);
+            }
+            reached.insert(canonical(b));
+        }
+        CHECK(reached == level);
+        CHECK(OpeningSuite::enumerate(6) == lines);
+        CHECK_THROWS_AS(OpeningSuite::enumerate(OpeningSuite::MAX_ENUMERATE_PLIES + 1), ReversiError);
+
+        const std::string path = "test_suite.bin";
+        OpeningSuite::write(path, 6, lines);
+        {
+            const OpeningSuite suite(path);
+            CHECK(suite.plies() == 6);
+            REQUIRE(suite.size() == lines.size());
+            CHECK(suite.moves(7) == lines[7]);
+            const auto anno = suite.annotation(7);
+            REQUIRE(anno.size() == 6);
+            CHECK(anno[0] == from_index(lines[7][0]));
+        }
+        CHECK_THROWS_AS(OpeningSuite::write(path, 5, lines), ReversiError);
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << "RVOS garbage";
+        }
+        CHECK_THROWS_AS(OpeningSuite{ path }, ReversiError);
+        std::remove(path.c_str());
+    }
+
+    // Moves to (v, v) once the signal gives v.
+    static MoveTask wait_for(Signal<int>& signal) {
+        const auto v = co_await signal.wait();
+        if (!v)
+            throw ReversiError("canceled");
+        co_return std::pair(*v, *v);
+    }
+
+    TEST_CASE("waiting coroutines hold no threads") {
+        struct Outcome {
+            std::mutex mutex;
+            int sum = 0, errors = 0;
+        } outcome;
+        const auto done = [](void* ctx, std::pair<int, int> move, std::exception_ptr error) {
+            auto& out = *static_cast<Outcome*>(ctx);
+            std::lock_guard lock(out.mutex);
+            if (error)
+                ++out.errors;
+            else
+                out.sum += move.first;
+        };
+        // Far more waiting computations than workers.
+        ThreadPool pool(1, false);
+        std::vector<Signal<int>> signals(100);
+        std::vector<Cancellation> cancels(100);
+        {
+            TaskGroup group(pool);
+            for (int i = 0; i < 100; i++)
+                wait_for(signals[i]).start(group, cancels[i], done, &outcome);
+            for (auto& s : signals)
+                CHECK(s.waiting());
+            for (int i = 1; i < 100; i++)
+                CHECK(signals[i].set(i));
+            cancels[0].cancel();
+            group.wait();
+        }
+        CHECK(outcome.sum == 100 * 99 / 2);
+        CHECK(outcome.errors == 1);
+        CHECK(!signals[0].set(0));
+        // Canceled before waiting, it doesn't wait at all.
+        CHECK_THROWS_AS(wait_for(signals[0]).run(cancels[0]), ReversiError);
+        // An engine that waits with a timer, run to the end.
+        const auto engine = make_engine_from_description("RandomChoice");
+        const auto [x, y] = engine->search(Board());
+        CHECK(Board().is_placable(x, y));
+    }
+
+    TEST_CASE("engines destroyed mid-search stop first") {
+        std::mt19937 mt(97531);
+        const Board b = random_position(mt, 26);
+        for (const char* desc : { "AlphaBeta:ms=60000,threads=2", "Solver:max_empties=30,threads=2",
+                "MCTSe:ms=60000,threads=2", "MCTSe:ms=60000,threads=2,solve_empties=24" }) {
+            const auto start = std::chrono::steady_clock::now();
+            {
+                // No game manager takes the move, and none is ever made.
+                const auto engine = make_engine_from_description(desc);
+                engine->change_position(b);
+                engine->request_compute(1);
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+        }
+    }
+
+    TEST_CASE("solve cache keeps results across runs") {
+        std::mt19937 mt(1357);
+        std::vector<BitBoard> pos;
+        while (pos.size() < 8) {
+            const BitBoard b = BitBoard::from_board(random_position(mt, 12));
+            if (b.empties() == 12 && b.moves())
+                pos.push_back(b);
+        }
+        std::vector<EndgameSolver::Result> exact;
+        const std::string path = "test_cache.bin";
+        std::remove(path.c_str());
+        {
+            EndgameSolver solver;
+            solver.set_cache(SolveCache::open(path));
+            for (const auto& b : pos) {
+                exact.push_back(solver.solve(b));
+                // Win/loss/draw searches only leave bounds.
+                solver.solve(b.pass(), -1, 1);
+            }
+        }
+        {
+            const auto cache = SolveCache::open(path);
+            CHECK(SolveCache::open(path) == cache);
+            for (std::size_t i = 0; i < pos.size(); i++) {
+                // Any symmetric image of the position will do.
+                const int t = int(i % SYMMETRIES);
+                const auto res = cache->lookup(transform(pos[i], t), -64, 64);
+                REQUIRE(res);
+                CHECK(res->score == exact[i].score);
+                REQUIRE(res->move >= 0);
+                CHECK(canonical(transform(pos[i], t).play(res->move)) == canonical(pos[i].play(exact[i].move)));
+                const auto wld = cache->lookup(pos[i].pass(), -1, 1);
+                if (const auto full = EndgameSolver().solve(pos[i].pass()); full.score == 0) {
+                    CHECK((wld && wld->score == 0));
+                } else {
+                    REQUIRE(wld);
+                    CHECK((wld->score > 0) == (full.score > 0));
+                    CHECK(!cache->lookup(pos[i].pass(), -64, 64));
+                }
+            }
+            CHECK(cache->stats().hits >= pos.size());
+            CHECK(cache->stats().stored == 0);
+        }
+        std::remove(path.c_str());
+    }
+
+    TEST_CASE("MCTS trees are saved and mapped back") {
+        const std::string path = "test_tree.bin";
+        std::remove(path.c_str());
+        const auto make = [&](const std::string& extra) {
+            return MCTS(MCTS::Options::from_description(EngineDescription::parse(
+                "MCTSe:ms=60000,tree=" + path + extra)));
+        };
+        {
+            auto engine = make(",playouts=300,tree_visits=10");
+            engine.search(Board());
+        }
+        REQUIRE(std::filesystem::exists(path));
+        const auto size = std::filesystem::file_size(path);
+        // The root, and at least one of each of the symmetric first moves.
+        CHECK(size >= 16 + 2 * 36);
+        CHECK((size - 16) % 36 == 0);
+        {
+            // Nothing new is worth saving, but the old nodes are kept.
+            auto engine = make(",playouts=300,tree_visits=1000000");
+            Board b;
+            b.place(3, 5);
+            engine.search(b);
+            engine.save_state();
+            CHECK(std::filesystem::file_size(path) == size);
+        }
+        const BitBoard start = canonical(BitBoard::from_board(Board()));
+        const SavedRecord root = read_tree(path).at(start);
+        {
+            // The root starts from the saved statistics, and adds one simulation.
+            auto engine = make(",playouts=1,tree_visits=1");
+            engine.search(Board());
+            engine.save_state();
+            const SavedRecord now = read_tree(path).at(start);
+            CHECK(now.sims == root.sims + 1);
+            CHECK(std::abs(now.value - root.value) <= 2.0 / (root.sims + 1) + 1e-6);
+        }
+        {
+            // Engines sharing the file add to each other's saves, even when
+            // they were made before either saved.
+            auto first = make(",playouts=100,tree_visits=10"), second = make(",playouts=100,tree_visits=10");
+            Board b1;
+            b1.place(3, 5);
+            Board b2 = b1;
+            b1.place(b1.get_placable().front().first, b1.get_placable().front().second);
+            for (const auto& [x, y] : b2.get_placable()) {
+                Board next = b2;
+                next.place(x, y);
+                if (canonical(BitBoard::from_board(next)) != canonical(BitBoard::from_board(b1))) {
+                    b2 = next;
+                    break;
+                }
+            }
+            const auto before = read_tree(path);
+            first.search(b1);
+            second.search(b2);
+            first.save_state();
+            second.save_state();
+            // Each root has gained the simulations of its own search.
+            const auto saved = read_tree(path);
+            CHECK(saved.contains(start));
+            for (const Board& b : { b1, b2 }) {
+                const BitBoard key = canonical(BitBoard::from_board(b));
+                CHECK(saved.at(key).sims >= (before.contains(key) ? before.at(key).sims : 0) + 100);
+            }
+        }
+        for (const auto& entry : std::filesystem::directory_iterator("."))
+            CHECK(entry.path().extension() != ".tmp");
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << "garbage";
+        }
+        CHECK_THROWS_AS(make(""), ReversiError);
+        std::remove(path.c_str());
+        std::remove((path + ".lock").c_str());
+    }
+
+    TEST_CASE("MCTS-Solver proofs reach the root") {
+        CHECK_THROWS_AS(MCTS::Options::from_description(EngineDescription::parse("MCTSe:solve_empties=25")), ReversiError);
+        std::mt19937 mt(8642);
+        for (int i = 0; i < 3; i++) {
+            const Board b = random_position(mt, 16);
+            if (b.get_placable().empty())
+                continue;
+            // Without a playout limit, only a proven root ends the search in time.
+            MCTS engine(MCTS::Options::from_description(EngineDescription::parse("MCTSe:ms=60000,solve_empties=10,threads=2")));
+            const auto start = std::chrono::steady_clock::now();
+            const auto [x, y] = engine.search(b);
+            CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(30));
+            Board b2 = b;
+            b2.place(x, y);
+            // The move keeps the outcome, if not the margin.
+            EndgameSolver solver;
+            const int score = solver.solve(BitBoard::from_board(b)).score;
+            const int after = -solver.solve(BitBoard::from_board(b2)).score;
+            CHECK((score > 0) == (after > 0));
+            CHECK((score < 0) == (after < 0));
+        }
+        // Solves too deep for the thinking time give up at the deadline.
+        const Board deep = random_position(mt, 24);
+        MCTS engine(MCTS::Options::from_description(EngineDescription::parse("MCTSe:ms=200,solve_empties=24,threads=2")));
+        const auto start = std::chrono::steady_clock::now();
+        const auto [x, y] = engine.search(deep);
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(2));
+        CHECK(deep.is_placable(x, y));
+    }
+
+    TEST_CASE("PUCT priors steer the search") {
+        std::mt19937 mt(1122);
+        int tested = 0;
+        while (tested < 5) {
+            const Board b = random_position(mt, 40);
+            const BitBoard bb = BitBoard::from_board(b);
+            const auto plc = b.get_placable();
+            // A clear favorite of move_order_score() that plain UCB, trying
+            // the moves in order, wouldn't start with.
+            int best = 0, second = -1000000;
+            for (std::size_t i = 1; i < plc.size(); i++) {
+                const int score = move_order_score(bb, to_index(plc[i].first, plc[i].second));
+                if (score > move_order_score(bb, to_index(plc[best].first, plc[best].second))) {
+                    second = std::max(second, move_order_score(bb, to_index(plc[best].first, plc[best].second)));
+                    best = int(i);
+                } else {
+                    second = std::max(second, score);
+                }
+            }
+            if (!best || move_order_score(bb, to_index(plc[best].first, plc[best].second)) - second < 30)
+                continue;
+            ++tested;
+            // The first simulation expands the root, and the second goes
+            // where the prior points.
+            MCTS engine(MCTS::Options::from_description(EngineDescription::parse("MCTSe:ms=60000,playouts=2,puct=1")));
+            CHECK(engine.search(b) == plc[best]);
+        }
+    }
+
+    TEST_CASE("MCTS trees saved with proofs load without the solver") {
+        const std::string path = "test_proof_tree.bin";
+        std::mt19937 mt(3579);
+        const Board b = random_position(mt, 30);
+        // Every move of b proven to win, but not b itself, as a transposition
+        // may leave it.
+        std::set<BitBoard> children;
+        for (const auto& [x, y] : b.get_placable()) {
+            Board b2 = b;
+            b2.place(x, y);
+            children.insert(canonical(BitBoard::from_board(b2)));
+        }
+        {
+            std::ofstream out(path, std::ios::binary);
+            out.write("RVMT", 4);
+            write_le(out, 1, 4);
+            write_le(out, children.size(), 8);
+            for (const BitBoard& c : children) {
+                write_le(out, c.own, 8);
+                write_le(out, c.opp, 8);
+                write_le(out, 100, 4);
+                write_le(out, std::bit_cast<std::uint32_t>(-1.0f), 4);
+                write_le(out, 0, 8);
+                // A loss for the player to move at the child.
+                write_le(out, 2, 4);
+            }
+        }
+        for (const char* solve : { "", ",solve_empties=10" }) {
+            // Without the solver the proofs are dropped, and with it they
+            // prove b.
+            MCTS engine(MCTS::Options::from_description(EngineDescription::parse(
+                std::string("MCTSe:ms=60000,playouts=100,tree_visits=1000000,tree=") + path + solve)));
+            const auto [x, y] = engine.search(b);
+            CHECK(b.is_placable(x, y));
+        }
+        std::remove(path.c_str());
+        std::remove((path + ".lock").c_str());
+    }
+
+    TEST_CASE("RAVE backs up every move as if played first") {
+        const std::string path = "test_rave_tree.bin";
+        for (const bool rave : { false, true }) {
+            std::remove(path.c_str());
+            {
+                MCTS engine(MCTS::Options::from_description(EngineDescription::parse(
+                    "MCTSe:ms=60000,playouts=300,tree_visits=1,tree=" + path + (rave ? ",rave=1" : ""))));
+                engine.search(Board());
+            }
+            const BitBoard start = canonical(BitBoard::from_board(Board()));
+            bool later_moves = false;
+            for (const auto& [pos, r] : read_tree(path)) {
+                if (!rave) {
+                    CHECK(r.amaf_n == 0);
+                    continue;
+                }
+                CHECK(r.amaf_value >= -1);
+                CHECK(r.amaf_value <= 1);
+                // Nothing leads to the root. Every rollout through a node
+                // played its move first, and rollouts that played it later
+                // count too.
+                if (pos == start) {
+                    CHECK(r.amaf_n == 0);
+                } else {
+                    CHECK(r.amaf_n >= 10 * r.sims);
+                    later_moves |= r.amaf_n > 10 * r.sims;
+                }
+            }
+            CHECK(later_moves == rave);
+        }
+        std::remove(path.c_str());
+        std::remove((path + ".lock").c_str());
+    }
+
+    TEST_CASE("MCTS reports disc differences") {
+        CHECK(probability_score(win_probability(20)) == 20);
+        CHECK(probability_score(win_probability(-7)) == -7);
+        CHECK(probability_score(0.5) == 0);
+        CHECK(probability_score(1) == 64);
+        CHECK(probability_score(0) == -64);
+        std::mt19937 mt(8642);
+        Board b = random_position(mt, 12);
+        while (b.get_placable().empty())
+            b = random_position(mt, 12);
+        // Without a report, --resign never ends MCTS games.
+        for (const char* desc : { "MCTSe:playouts=200", "MCTSe:playouts=200,root=halving" }) {
+            const auto engine = make_engine_from_description(desc);
+            engine->search(b);
+            REQUIRE(engine->last_score());
+            CHECK(std::abs(*engine->last_score()) <= 64);
+        }
+        // A solved position reports its exact score.
+        const auto engine = make_engine_from_description("MCTSe:ms=5000,solve_empties=12");
+        engine->search(b);
+        EndgameSolver solver;
+        CHECK(engine->last_score() == solver.solve(BitBoard::from_board(b)).score);
+    }
+
+    TEST_CASE("engine descriptions round-trip") {
+        const auto desc = EngineDescription::parse("MCTSe:rave=1,ms=500");
+        CHECK(desc.name == "MCTSe");
+        CHECK(desc.get_bool("rave", false));
+        CHECK(desc.get_int("ms", 1000) == 500);
+        CHECK(desc.get_int("threads", 3) == 3);
+        // The keys come out sorted, whatever the order they went in.
+        CHECK(desc.to_string() == "MCTSe:ms=500,rave=1");
+        CHECK(EngineDescription::parse(desc.to_string()).options == desc.options);
+        CHECK(EngineDescription::parse("AlphaBeta").to_string() == "AlphaBeta");
+        CHECK_THROWS_AS(EngineDescription::parse("MCTSe:rave"), ReversiError);
+        CHECK_THROWS_AS(EngineDescription::parse("MCTSe:=1"), ReversiError);
+        EngineDescription set{ "Solver", {} };
+        set.set_double("x", 1.5);
+        set.set_int("n", -3);
+        set.set_bool("b", true);
+        CHECK(set.to_string() == "Solver:b=1,n=-3,x=1.5");
+        // Doubles read back exactly, however many digits they need.
+        for (const double x : { 1234567.0, 0.1, 1.0 / 3, 1e-9, -2.5e300 }) {
+            set.set_double("x", x);
+            CHECK(EngineDescription::parse(set.to_string()).get_double("x", 0) == x);
+        }
+        set.set_double("rave_equiv", 1234567);
+        CHECK(set.get_string("rave_equiv", "") == "1234567");
+        CHECK_THROWS_AS(set.set_string("s", "a,b"), ReversiError);
+        // Paths like C:\books\b.bin are fine: only the first ':' ends the name.
+        const auto path = EngineDescription::parse("MCTSe:book=C:\\books\\b=1.bin");
+        CHECK(path.get_string("book", "") == "C:\\books\\b=1.bin");
+        EngineDescription copy{ "MCTSe", {} };
+        copy.set_string("book", path.get_string("book", ""));
+        CHECK(copy.to_string() == "MCTSe:book=C:\\books\\b=1.bin");
+        {
+            const char* name = "Solver:cache=test_cache:a=b.bin";
+            CHECK(make_engine_from_description(name)->get_name() == name);
+        }
+        std::filesystem::remove("test_cache:a=b.bin");
+        // Each engine names itself by the options that differ from the defaults.
+        for (const char* name : { "MCTSe:puct=1.5,rave=1,rave_equiv=500", "AlphaBeta:depth=3,ms=300",
+                "Solver:max_empties=20,threads=2", "RandomChoice" }) {
+            CHECK(make_engine_from_description(name)->get_name() == name);
+            CHECK(make_engine_from_description(EngineDescription::parse(name).to_string())->get_name() == name);
+        }
+        CHECK(make_engine_from_description("AlphaBeta:ms=1000")->get_name() == "AlphaBeta");
+        // Bad keys and bad values.
+        for (const char* bad : { "MCTSe:speed=1", "AlphaBeta:rave=1", "RandomChoice:ms=1", "MCTSe:rave=maybe",
+                "MCTSe:puct=1x", "AlphaBeta:ms=fast", "AlphaBeta:ms=0", "Solver:threads=1.5", "Nobody" })
+            CHECK_THROWS_AS(make_engine_from_description(bad), ReversiError);
+    }
+
+    TEST_CASE("command lines are checked") {
+        const auto parse = [](std::vector<std::string> args) {
+            std::vector<char*> argv{ nullptr };
+            for (auto& arg : args)
+                argv.push_back(arg.data());
+            return CommandLine::parse(int(argv.size()), argv.data(), { "values" });
+        };
+        const auto cl = parse({ "out.txt", "--games=12", "--values", "--rate=0.5", "--black=MCTSe:ms=5" });
+        CHECK(cl.positional == std::vector<std::string>{ "out.txt" });
+        CHECK(cl.get_int("games", 1) == 12);
+        CHECK(cl.get_int("threads", 3) == 3);
+        CHECK(cl.has("values"));
+        CHECK(cl.get_double("rate", 1) == 0.5);
+        CHECK(cl.get_string("black", "") == "MCTSe:ms=5");
+        CHECK_NOTHROW(cl.check_keys({ "games", "values", "rate", "black" }));
+        CHECK_THROWS_AS(cl.check_keys({ "games", "values", "rate" }), ReversiError);
+        CHECK_THROWS_AS(parse({ "--games" }), ReversiError);
+        CHECK_THROWS_AS(parse({ "--=3" }), ReversiError);
+        // Only whole numbers that fit count.
+        for (const char* bad : { "abc", "12x", "", "99999999999" })
+            CHECK_THROWS_AS(parse({ std::string("--games=") + bad }).get_int("games", 1), ReversiError);
+        CHECK_THROWS_AS(parse({ "--seed=-1" }).get_unsigned("seed", 1), ReversiError);
+        CHECK(parse({ "--seed=7" }).get_unsigned("seed", 1) == 7);
+        CHECK_THROWS_AS(parse({ "--rate=fast" }).get_double("rate", 1), ReversiError);
+    }
+
+    TEST_CASE("alpha-beta plays perfectly near the end") {
+        std::mt19937 mt(2468);
+        AlphaBeta engine(AlphaBeta::Options::from_description(EngineDescription::parse("AlphaBeta:ms=60000")));
+        for (int i = 0; i < 5; i++) {
+            const Board b = random_position(mt, 10);
+            const auto [x, y] = engine.search(b);
+            Board b2 = b;
+            if (x)
+                b2.place(x, y);
+            else
+                b2.skip();
+            EndgameSolver solver;
+            CHECK(-solver.solve(BitBoard::from_board(b2)).score == solver.solve(BitBoard::from_board(b)).score);
+        }
+    }
+}
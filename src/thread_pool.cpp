@@ -0,0 +1,201 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Reversi {
+    namespace {
+        // The pool and the index of the worker running on this thread, if any.
+        thread_local ThreadPool* current_pool = nullptr;
+        thread_local int current_worker = -1;
+
+        void pin_to_cpu(int cpu) {
+#ifdef _WIN32
+            SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (cpu % (8 * sizeof(DWORD_PTR))));
+#elif defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu % CPU_SETSIZE, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+            // Left to the OS.
+            (void)cpu;
+#endif
+        }
+
+        // The value of an environment variable as a positive integer, or def.
+        int env_int(const char* name, int def) {
+            const char* value = std::getenv(name);
+            if (!value)
+                return def;
+            try {
+                return std::max(std::stoi(value), 1);
+            } catch (const std::logic_error&) {
+                return def;
+            }
+        }
+    }
+
+    ThreadPool::ThreadPool(int workers, bool pin) {
+        workers = std::max(workers, 1);
+        for (int i = 0; i < workers; i++)
+            mQueues.push_back(std::make_unique<Queue>());
+        for (int i = 0; i < workers; i++)
+            mWorkers.emplace_back(&ThreadPool::worker_loop, this, i, pin);
+    }
+
+    ThreadPool::~ThreadPool() noexcept {
+        {
+            std::lock_guard lock(mSleepMutex);
+            mStop = true;
+        }
+        mWake.notify_all();
+        for (auto& t : mWorkers)
+            t.join();
+    }
+
+    ThreadPool& ThreadPool::global() {
+        static ThreadPool pool(env_int("REVERSI_POOL_THREADS", int(std::thread::hardware_concurrency())),
+            env_int("REVERSI_POOL_PIN", 0) == 1);
+        return pool;
+    }
+
+    void ThreadPool::push(std::shared_ptr<Job> job) {
+        Queue& q = current_pool == this ? *mQueues[current_worker] : mInjected;
+        {
+            std::lock_guard lock(q.mutex);
+            q.jobs.push_back(std::move(job));
+        }
+        {
+            std::lock_guard lock(mSleepMutex);
+            ++mWork;
+        }
+        mWake.notify_one();
+    }
+
+    std::shared_ptr<ThreadPool::Job> ThreadPool::take(int self) {
+        std::shared_ptr<Job> ans;
+        const auto pop = [&ans](Queue& q, bool back) {
+            std::lock_guard lock(q.mutex);
+            if (q.jobs.empty())
+                return false;
+            if (back) {
+                ans = std::move(q.jobs.back());
+                q.jobs.pop_back();
+            } else {
+                ans = std::move(q.jobs.front());
+                q.jobs.pop_front();
+            }
+            return true;
+        };
+        if (pop(*mQueues[self], true) || pop(mInjected, false))
+            return ans;
+        const int n = int(mQueues.size());
+        for (int i = 1; i < n; i++) {
+            if (pop(*mQueues[(self + i) % n], false))
+                return ans;
+        }
+        return nullptr;
+    }
+
+    void ThreadPool::run(Job& job) {
+        if (job.claimed.exchange(true, std::memory_order_acq_rel))
+            return;
+        std::exception_ptr error;
+        try {
+            // Moved out, so that whatever the task holds is let go before the
+            // group hears that it is done.
+            auto fn = std::move(job.fn);
+            fn();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        job.group->finish(error);
+    }
+
+    void ThreadPool::worker_loop(int self, bool pin) {
+        current_pool = this;
+        current_worker = self;
+        if (pin)
+            pin_to_cpu(self % std::max(1u, std::thread::hardware_concurrency()));
+        while (true) {
+            std::uint64_t seen;
+            {
+                std::lock_guard lock(mSleepMutex);
+                seen = mWork;
+            }
+            if (const auto job = take(self)) {
+                run(*job);
+                continue;
+            }
+            // Sleep unless something was submitted since the queues were empty.
+            std::unique_lock lock(mSleepMutex);
+            if (mStop && mWork == seen)
+                return;
+            mWake.wait(lock, [&] {
+                return mStop || mWork != seen;
+            });
+        }
+    }
+
+    TaskGroup::~TaskGroup() noexcept {
+        try {
+            wait();
+        } catch (...) {}
+    }
+
+    void TaskGroup::run(std::function<void()> fn) {
+        auto job = std::make_shared<ThreadPool::Job>();
+        job->fn = std::move(fn);
+        job->group = this;
+        {
+            std::lock_guard lock(mMutex);
+            // A long lived group, like an engine's, only needs the ones that
+            // wait() might still have to run.
+            std::erase_if(mJobs, [](const auto& j) {
+                return j->claimed.load(std::memory_order_relaxed);
+            });
+            mJobs.push_back(job);
+            ++mPending;
+        }
+        mPool.push(std::move(job));
+    }
+
+    void TaskGroup::finish(std::exception_ptr error) noexcept {
+        std::lock_guard lock(mMutex);
+        if (error && !mError)
+            mError = error;
+        --mPending;
+        // Under the lock, since the group may go away as soon as wait() sees
+        // the count drop to zero.
+        mDone.notify_all();
+    }
+
+    void TaskGroup::wait() {
+        std::vector<std::shared_ptr<ThreadPool::Job>> jobs;
+        {
+            std::lock_guard lock(mMutex);
+            jobs.swap(mJobs);
+        }
+        // The ones nobody has claimed are run here. The workers skip them
+        // when they get to them.
+        for (const auto& job : jobs)
+            ThreadPool::run(*job);
+        std::unique_lock lock(mMutex);
+        mDone.wait(lock, [this] {
+            return mPending == 0;
+        });
+        if (mError)
+            std::rethrow_exception(std::exchange(mError, nullptr));
+    }
+}
@@ -0,0 +1,128 @@
+// The threads that all the engines run their work on
+#ifndef REVERSI_THREAD_POOL_H
+#define REVERSI_THREAD_POOL_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Reversi {
+    class TaskGroup;
+
+    // A fixed set of worker threads that run tasks, shared by everything in
+    // the process through global(), so that several engines searching in
+    // parallel don't start more threads than the machine has cores.
+    //
+    // Each worker has a deque of tasks. Tasks submitted by a worker go to the
+    // back of its own deque and it takes them back from there, newest first,
+    // which keeps the caches warm; idle workers steal the oldest tasks from
+    // the front of the others' deques, or take the tasks submitted from
+    // outside the pool. Tasks are submitted through a TaskGroup.
+    class ThreadPool {
+        // A task, which runs at most once: whoever claims it first runs it,
+        // a worker or the TaskGroup waiting for it.
+        struct Job {
+            std::function<void()> fn;
+            TaskGroup* group;
+            std::atomic_bool claimed = false;
+        };
+
+        struct Queue {
+            std::mutex mutex;
+            std::deque<std::shared_ptr<Job>> jobs;
+        };
+
+        std::vector<std::unique_ptr<Queue>> mQueues;
+        // The tasks submitted from outside the pool.
+        Queue mInjected;
+        std::vector<std::thread> mWorkers;
+
+        // Idle workers sleep on mWake. mWork counts the submitted tasks, so
+        // that a worker can tell whether any came in while it was looking.
+        std::mutex mSleepMutex;
+        std::condition_variable mWake;
+        std::uint64_t mWork = 0;
+        bool mStop = false;
+
+        friend class TaskGroup;
+
+        void push(std::shared_ptr<Job> job);
+
+        // Takes a task for worker `self`: its own newest, then the oldest
+        // injected one, then one stolen from the others. Null if there's none.
+        std::shared_ptr<Job> take(int self);
+
+        // Runs the job unless somebody claimed it already.
+        static void run(Job& job);
+
+        void worker_loop(int self, bool pin);
+
+    public:
+        // Starts `workers` threads (at least one). With `pin`, worker i only
+        // runs on CPU i, where the OS supports it.
+        ThreadPool(int workers, bool pin);
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator = (const ThreadPool&) = delete;
+
+        // Finishes the tasks in the queues and joins the workers.
+        ~ThreadPool() noexcept;
+
+        inline int size() const noexcept {
+            return int(mWorkers.size());
+        }
+
+        // The pool of the process, started on first use. It has as many
+        // workers as the machine has hardware threads, unless the environment
+        // variable REVERSI_POOL_THREADS says otherwise. REVERSI_POOL_PIN=1
+        // pins them to the CPUs.
+        static ThreadPool& global();
+    };
+
+    // Tasks run on a pool that can be waited for together. Waiting runs the
+    // tasks of the group that no worker has started yet on the waiting thread,
+    // so a task may wait for tasks it submitted without tying up the pool.
+    class TaskGroup {
+        ThreadPool& mPool;
+
+        // Guards everything below.
+        std::mutex mMutex;
+        std::condition_variable mDone;
+        // The tasks submitted since the last wait() that may not have been
+        // claimed yet.
+        std::vector<std::shared_ptr<ThreadPool::Job>> mJobs;
+        // The tasks that haven't finished.
+        int mPending = 0;
+        // The first exception a task threw.
+        std::exception_ptr mError;
+
+        friend class ThreadPool;
+
+        // Called by the thread that ran a task when it is done.
+        void finish(std::exception_ptr error) noexcept;
+
+    public:
+        explicit TaskGroup(ThreadPool& pool = ThreadPool::global()) : mPool(pool) {}
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator = (const TaskGroup&) = delete;
+
+        // Waits for the tasks, dropping any exception.
+        ~TaskGroup() noexcept;
+
+        // Submits a task.
+        void run(std::function<void()> fn);
+
+        // Returns once all the tasks submitted so far are done, rethrowing
+        // the first exception any of them threw.
+        void wait();
+    };
+}
+
+#endif
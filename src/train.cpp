@@ -0,0 +1,333 @@
+// Fits the weights of the pattern evaluation to the positions of recorded games.
+// Usage: train OUT INPUT... [--threads=N] [--epochs=N] [--exact=N] [--rate=X]
+//
+// The inputs are game files in any format GameReader knows. Training runs in
+// two passes, so that the data never has to fit in memory:
+//  1. The games are replayed by a pool of threads. Each position gets the
+//     exact score if it has at most `exact` empties (default 14), and
+//     otherwise the exact score of the first such position later in its game,
+//     that is the result of the game as played from there with perfect play
+//     at the end, not a search of the position itself. Games that stop
+//     before `exact` empties, unfinished or adjudicated, have no such
+//     position and are skipped. The scored positions are streamed to
+//     OUT.samples.
+//  2. Each epoch streams the samples in blocks. The threads compute the
+//     gradient of the squared error of a block each in their own buffer, and
+//     then sum the buffers slice by slice to update the weights. Every weight
+//     moves by `rate` (default 1) times its gradient divided by the sum of the
+//     squares of its inputs in the block, so rare patterns learn as fast as
+//     common ones, and by the number of weights each position uses, since
+//     they all move at once.
+// The weights are written to OUT in the format of PatternWeights::save().
+#include "command_line.h"
+#include "endgame.h"
+#include "pattern.h"
+#include "record.h"
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Reversi;
+
+struct Options {
+    std::string out;
+    std::vector<std::string> inputs;
+    int threads = std::max(1, int(std::thread::hardware_concurrency()));
+    int epochs = 20;
+    int exact = 14;
+    double rate = 1;
+};
+
+// A scored position, as stored in the samples file: own and opp as little
+// endian 64 bit integers, then the score as a signed byte.
+struct Sample {
+    BitBoard b;
+    int score;
+
+    static constexpr int BYTES = 17;
+
+    void write(char* out) const {
+        for (int i = 0; i < 8; i++) {
+            out[i] = char(b.own >> (8 * i));
+            out[8 + i] = char(b.opp >> (8 * i));
+        }
+        out[16] = char(score);
+    }
+
+    static Sample read(const char* in) {
+        Sample ans{ {}, std::int8_t(in[16]) };
+        for (int i = 0; i < 8; i++) {
+            ans.b.own |= std::uint64_t(std::uint8_t(in[i])) << (8 * i);
+            ans.b.opp |= std::uint64_t(std::uint8_t(in[8 + i])) << (8 * i);
+        }
+        return ans;
+    }
+};
+
+// Scores the positions of one game and appends them to `out`. Returns false,
+// adding nothing, if the game stops before any position is cheap to solve.
+static bool score_game(EndgameSolver& solver, const GameRecord& game, int exact, std::vector<char>& out) {
+    const auto pos = game.positions();
+    // The first position that is solved. Every earlier one inherits its score.
+    std::size_t first = 0;
+    while (first + 1 < pos.size() && pos[first].empties() > exact)
+        ++first;
+    // Only a finished game can end with more empties.
+    const BitBoard& last = pos[first];
+    if (last.empties() > exact && (last.moves() || last.pass().moves()))
+        return false;
+    std::vector<int> scores(pos.size());
+    for (std::size_t i = first; i < pos.size(); i++)
+        scores[i] = solver.solve(pos[i], -64, 64).score;
+    for (std::size_t i = 0; i < first; i++)
+        // Every move or pass hands the turn over.
+        scores[i] = (first - i) % 2 ? -scores[first] : scores[first];
+    for (std::size_t i = 0; i < pos.size(); i++) {
+        // Positions without moves are never evaluated.
+        if (!pos[i].moves())
+            continue;
+        out.resize(out.size() + Sample::BYTES);
+        Sample{ pos[i], scores[i] }.write(&out[out.size() - Sample::BYTES]);
+    }
+    return true;
+}
+
+// Pass 1: replays and scores all the games into `path`. Returns the number
+// of samples.
+static std::uint64_t make_samples(const Options& opt, const std::string& path) {
+    std::ofstream fout(path, std::ios::binary);
+    if (!fout)
+        throw ReversiError("Can't create " + path);
+    // The reader hands out batches of games through a bounded queue, so that
+    // only a few batches are in memory at once.
+    constexpr std::size_t BATCH = 256;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::queue<std::vector<GameRecord>> batches;
+    bool done = false;
+    std::uint64_t samples = 0, bad_games = 0, short_games = 0;
+    std::mutex out_mutex;
+    const auto worker = [&] {
+        EndgameSolver solver(16);
+        std::vector<char> out;
+        while (true) {
+            std::vector<GameRecord> batch;
+            {
+                std::unique_lock lock(mutex);
+                cv.wait(lock, [&] { return done || !batches.empty(); });
+                if (batches.empty())
+                    return;
+                batch = std::move(batches.front());
+                batches.pop();
+            }
+            cv.notify_all();
+            out.clear();
+            std::uint64_t bad = 0, unscored = 0;
+            for (const auto& game : batch) {
+                try {
+                    if (!score_game(solver, game, opt.exact, out))
+                        ++unscored;
+                } catch (const ReversiError&) {
+                    ++bad;
+                }
+            }
+            std::lock_guard lock(out_mutex);
+            fout.write(out.data(), std::streamsize(out.size()));
+            samples += out.size() / Sample::BYTES;
+            bad_games += bad;
+            short_games += unscored;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int i = 0; i < opt.threads; i++)
+        workers.emplace_back(worker);
+    std::uint64_t games = 0;
+    const auto push = [&](std::vector<GameRecord>&& batch) {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [&] { return batches.size() < std::size_t(2 * opt.threads); });
+        batches.push(std::move(batch));
+        cv.notify_all();
+    };
+    try {
+        std::vector<GameRecord> batch;
+        for (const auto& input : opt.inputs) {
+            GameReader reader(input);
+            GameRecord game;
+            while (reader.next(game)) {
+                batch.push_back(std::move(game));
+                if (batch.size() == BATCH) {
+                    games += batch.size();
+                    push(std::move(batch));
+                    batch.clear();
+                }
+            }
+        }
+        games += batch.size();
+        push(std::move(batch));
+    } catch (...) {
+        {
+            std::lock_guard lock(mutex);
+            done = true;
+        }
+        cv.notify_all();
+        for (auto& t : workers)
+            t.join();
+        throw;
+    }
+    {
+        std::lock_guard lock(mutex);
+        done = true;
+    }
+    cv.notify_all();
+    for (auto& t : workers)
+        t.join();
+    if (!fout.flush())
+        throw ReversiError("Error writing " + path);
+    std::cout << games << " games, " << bad_games << " with illegal moves skipped, "
+        << short_games << " ending before " << opt.exact << " empties skipped, " << samples << " positions" << std::endl;
+    return samples;
+}
+
+// The gradient of one thread over part of a block.
+struct Gradient {
+    // The pattern instances, mobility, parity and the constant.
+    static constexpr int WEIGHTS_USED = Patterns::INSTANCES + 3;
+
+    std::vector<double> grad, norm;
+    double sse = 0;
+
+    Gradient() : grad(std::size_t(Patterns::PHASES) * PatternWeights::PHASE_SIZE),
+        norm(grad.size()) {}
+
+    void add(const std::vector<float>& w, const Sample& s) {
+        const PatternState ps(s.b);
+        const std::size_t base = std::size_t(Patterns::phase_of(s.b.empties())) * PatternWeights::PHASE_SIZE;
+        const int mobility = std::popcount(s.b.moves()) - std::popcount(s.b.pass().moves());
+        const int parity = s.b.empties() & 1;
+        double pred = w[base + PatternWeights::BIAS] + mobility * w[base + PatternWeights::MOBILITY]
+            + parity * w[base + PatternWeights::PARITY];
+        std::array<std::size_t, Patterns::INSTANCES> idx;
+        for (int i = 0; i < Patterns::INSTANCES; i++) {
+            idx[i] = base + Patterns::OFFSET[Patterns::PATTERN_OF[i]] + ps.index(i);
+            pred += w[idx[i]];
+        }
+        const double err = pred - s.score;
+        sse += err * err;
+        for (const auto j : idx) {
+            grad[j] += err;
+            norm[j] += 1;
+        }
+        grad[base + PatternWeights::BIAS] += err;
+        norm[base + PatternWeights::BIAS] += 1;
+        grad[base + PatternWeights::MOBILITY] += err * mobility;
+        norm[base + PatternWeights::MOBILITY] += mobility * mobility;
+        grad[base + PatternWeights::PARITY] += err * parity;
+        norm[base + PatternWeights::PARITY] += parity;
+    }
+};
+
+// Pass 2: one epoch over the samples. Returns the root mean square error
+// before the updates.
+static double train_epoch(const Options& opt, const std::string& path, std::vector<float>& w,
+    std::vector<Gradient>& grads)
+{
+    constexpr std::size_t BLOCK = 1 << 16;
+    std::ifstream fin(path, std::ios::binary);
+    std::vector<char> raw(BLOCK * Sample::BYTES);
+    std::vector<Sample> block;
+    double sse = 0;
+    std::uint64_t cnt = 0;
+    const int threads = int(grads.size());
+    while (true) {
+        fin.read(raw.data(), std::streamsize(raw.size()));
+        const std::size_t n = std::size_t(fin.gcount()) / Sample::BYTES;
+        if (!n)
+            break;
+        block.clear();
+        for (std::size_t i = 0; i < n; i++)
+            block.push_back(Sample::read(&raw[i * Sample::BYTES]));
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; t++) {
+            pool.emplace_back([&, t] {
+                for (std::size_t i = n * t / threads; i < n * (t + 1) / threads; i++)
+                    grads[t].add(w, block[i]);
+            });
+        }
+        for (auto& th : pool)
+            th.join();
+        pool.clear();
+        // Each thread sums one slice of all the buffers and clears them.
+        for (int t = 0; t < threads; t++) {
+            pool.emplace_back([&, t] {
+                for (std::size_t j = w.size() * t / threads; j < w.size() * (t + 1) / threads; j++) {
+                    double g = 0, norm = 0;
+                    for (auto& gr : grads) {
+                        g += gr.grad[j];
+                        norm += gr.norm[j];
+                        gr.grad[j] = gr.norm[j] = 0;
+                    }
+                    if (norm > 0)
+                        w[j] -= float(opt.rate * g / (norm * Gradient::WEIGHTS_USED));
+                }
+            });
+        }
+        for (auto& th : pool)
+            th.join();
+        for (auto& gr : grads) {
+            sse += gr.sse;
+            gr.sse = 0;
+        }
+        cnt += n;
+    }
+    return cnt ? std::sqrt(sse / cnt) : 0;
+}
+
+static Options parse_options(int argc, char** argv) {
+    Options ans;
+    const auto cl = CommandLine::parse(argc, argv);
+    cl.check_keys({ "threads", "epochs", "exact", "rate" });
+    if (!cl.positional.empty()) {
+        ans.out = cl.positional.front();
+        ans.inputs.assign(cl.positional.begin() + 1, cl.positional.end());
+    }
+    ans.threads = cl.get_int("threads", ans.threads);
+    ans.epochs = cl.get_int("epochs", ans.epochs);
+    ans.exact = cl.get_int("exact", ans.exact);
+    ans.rate = cl.get_double("rate", ans.rate);
+    if (ans.inputs.empty())
+        throw ReversiError("Usage: train OUT INPUT... [--threads=N] [--epochs=N] [--exact=N] [--rate=X]");
+    if (ans.threads <= 0 || ans.exact < 0 || ans.exact > 24)
+        throw ReversiError("threads should be positive and exact between 0 and 24");
+    return ans;
+}
+
+int main(int argc, char** argv) {
+    try {
+        const Options opt = parse_options(argc, argv);
+        const std::string samples = opt.out + ".samples";
+        make_samples(opt, samples);
+        std::vector<float> w(std::size_t(Patterns::PHASES) * PatternWeights::PHASE_SIZE);
+        std::vector<Gradient> grads(opt.threads);
+        for (int epoch = 1; epoch <= opt.epochs; epoch++)
+            std::cout << "epoch " << epoch << ": rms error " << train_epoch(opt, samples, w, grads) << std::endl;
+        std::remove(samples.c_str());
+        PatternWeights ans;
+        for (int phase = 0; phase < Patterns::PHASES; phase++) {
+            for (int i = 0; i < PatternWeights::PHASE_SIZE; i++) {
+                const double x = std::round(w[std::size_t(phase) * PatternWeights::PHASE_SIZE + i] * PatternWeights::SCALE);
+                ans.at(phase, i) = std::int16_t(std::clamp(x, -32767.0, 32767.0));
+            }
+        }
+        ans.save(opt.out);
+    } catch (const ReversiError& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,76 @@
+#include "ttable.h"
+#include <bit>
+#include <algorithm>
+
+namespace Reversi {
+    TransTable::TransTable(std::size_t megabytes) {
+        // At least one pair.
+        const std::size_t cnt = std::bit_floor(std::max<std::size_t>(megabytes * 1024 * 1024 / sizeof(Pair), 1));
+        mPairs.reset(new Pair[cnt]);
+        mMask = cnt - 1;
+    }
+
+    // Layout: score in bits 0~15, depth in 16~23, bound in 24~31, move in 32~39.
+    std::uint64_t TransTable::pack(const Entry& e) noexcept {
+        return std::uint64_t(std::uint16_t(e.score))
+            | std::uint64_t(std::uint8_t(e.depth)) << 16
+            | std::uint64_t(e.bound) << 24
+            | std::uint64_t(std::uint8_t(e.move)) << 32;
+    }
+
+    TransTable::Entry TransTable::unpack(std::uint64_t data) noexcept {
+        return {
+            std::int16_t(std::uint16_t(data)),
+            std::int8_t(std::uint8_t(data >> 16)),
+            Bound(std::uint8_t(data >> 24)),
+            std::int8_t(std::uint8_t(data >> 32))
+        };
+    }
+
+    bool TransTable::read(const Slot& slot, std::uint64_t key, std::uint64_t& data) noexcept {
+        data = slot.data.load(std::memory_order_relaxed);
+        return (slot.check.load(std::memory_order_relaxed) ^ data) == key;
+    }
+
+    void TransTable::write(Slot& slot, std::uint64_t key, std::uint64_t data) noexcept {
+        slot.data.store(data, std::memory_order_relaxed);
+        slot.check.store(key ^ data, std::memory_order_relaxed);
+    }
+
+    bool TransTable::probe(std::uint64_t key, Entry& out) const noexcept {
+        const Slot* const pair = mPairs[key & mMask].slots;
+        std::uint64_t data;
+        if (!read(pair[0], key, data) && !read(pair[1], key, data))
+            return false;
+        out = unpack(data);
+        return out.bound != Bound::None;
+    }
+
+    void TransTable::store(std::uint64_t key, int score, int depth, Bound bound, int move) noexcept {
+        Slot* const pair = mPairs[key & mMask].slots;
+        const std::uint64_t data = pack({ std::int16_t(score), std::int8_t(depth), bound, std::int8_t(move) });
+        // The same position is only replaced by a search that is at least as
+        // deep, in whichever slot it is.
+        for (int i = 0; i < 2; i++) {
+            std::uint64_t old;
+            if (read(pair[i], key, old)) {
+                if (unpack(old).depth <= depth)
+                    write(pair[i], key, data);
+                return;
+            }
+        }
+        // Another position in the first slot only by one at least as deep.
+        // Only the depth of the old one matters, so a torn slot does no harm.
+        const int first_depth = unpack(pair[0].data.load(std::memory_order_relaxed)).depth;
+        write(pair[depth >= first_depth ? 0 : 1], key, data);
+    }
+
+    void TransTable::clear() noexcept {
+        for (std::uint64_t i = 0; i <= mMask; i++) {
+            for (Slot& slot : mPairs[i].slots) {
+                slot.data.store(0, std::memory_order_relaxed);
+                slot.check.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
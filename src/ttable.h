@@ -0,0 +1,73 @@
+// Transposition table for the alpha-beta searches
+#ifndef REVERSI_TTABLE_H
+#define REVERSI_TTABLE_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace Reversi {
+    // The table is shared by all the threads of a search without locks. Slots
+    // come in pairs: the first keeps the deepest result of the positions that
+    // share it, and the second whatever was stored last, so that deep results
+    // survive the flood of shallow ones. Each slot stores the data word and
+    // the key xor-ed with it. A slot torn by two
+    // concurrent writes fails the xor check and reads as a miss, which
+    // costs a little time and never gives a wrong answer.
+    class TransTable {
+    public:
+        // What the stored score means relative to the true score.
+        enum class Bound : std::uint8_t {
+            None, Lower, Upper, Exact
+        };
+
+        struct Entry {
+            std::int16_t score = 0;
+            // The remaining depth the score was searched with.
+            std::int8_t depth = -1;
+            Bound bound = Bound::None;
+            // The best move as a square index, or -1.
+            std::int8_t move = -1;
+        };
+
+    private:
+        struct Slot {
+            std::atomic<std::uint64_t> check{ 0 }, data{ 0 };
+        };
+
+        // Aligned so that a probe touches a single cache line.
+        struct alignas(2 * sizeof(Slot)) Pair {
+            Slot slots[2];
+        };
+
+        // The number of pairs is a power of two, so the index of the pair is
+        // key & mMask.
+        std::unique_ptr<Pair[]> mPairs;
+        std::uint64_t mMask;
+
+        static std::uint64_t pack(const Entry& e) noexcept;
+
+        static Entry unpack(std::uint64_t data) noexcept;
+
+        // Reads a slot, giving the data word if it holds `key`.
+        static bool read(const Slot& slot, std::uint64_t key, std::uint64_t& data) noexcept;
+
+        static void write(Slot& slot, std::uint64_t key, std::uint64_t data) noexcept;
+
+    public:
+        // Allocates a table of about `megabytes` MB.
+        explicit TransTable(std::size_t megabytes);
+
+        // Looks up `key`. Returns false if it isn't in the table.
+        bool probe(std::uint64_t key, Entry& out) const noexcept;
+
+        // Stores a search result. Entries searched to a greater depth are kept
+        // over shallower results for the same position, and over those of
+        // other positions in the first slot of the pair.
+        void store(std::uint64_t key, int score, int depth, Bound bound, int move) noexcept;
+
+        // Forgets everything. Not safe while a search is running.
+        void clear() noexcept;
+    };
+}
+
+#endif